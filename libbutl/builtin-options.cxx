@@ -2344,7 +2344,9 @@ namespace butl
   rm_options::
   rm_options ()
   : recursive_ (),
-    force_ ()
+    force_ (),
+    jobs_ (1),
+    jobs_specified_ (false)
   {
   }
 
@@ -2429,6 +2431,12 @@ namespace butl
       &::butl::cli::thunk< rm_options, &rm_options::force_ >;
       _cli_rm_options_map_["-f"] =
       &::butl::cli::thunk< rm_options, &rm_options::force_ >;
+      _cli_rm_options_map_["--jobs"] =
+      &::butl::cli::thunk< rm_options, std::size_t, &rm_options::jobs_,
+        &rm_options::jobs_specified_ >;
+      _cli_rm_options_map_["-j"] =
+      &::butl::cli::thunk< rm_options, std::size_t, &rm_options::jobs_,
+        &rm_options::jobs_specified_ >;
     }
   };
 
@@ -3167,7 +3175,14 @@ namespace butl
   checksum_options ()
   : binary_ (),
     text_ (),
-    sum_only_ ()
+    sum_only_ (),
+    tree_ (),
+    chunk_size_ (1048576),
+    chunk_size_specified_ (false),
+    jobs_ (),
+    jobs_specified_ (false),
+    cache_ (),
+    cache_specified_ (false)
   {
   }
 
@@ -3254,6 +3269,20 @@ namespace butl
       &::butl::cli::thunk< checksum_options, &checksum_options::text_ >;
       _cli_checksum_options_map_["--sum-only"] =
       &::butl::cli::thunk< checksum_options, &checksum_options::sum_only_ >;
+      _cli_checksum_options_map_["--tree"] =
+      &::butl::cli::thunk< checksum_options, &checksum_options::tree_ >;
+      _cli_checksum_options_map_["--chunk-size"] =
+      &::butl::cli::thunk< checksum_options, std::size_t, &checksum_options::chunk_size_,
+        &checksum_options::chunk_size_specified_ >;
+      _cli_checksum_options_map_["--jobs"] =
+      &::butl::cli::thunk< checksum_options, std::size_t, &checksum_options::jobs_,
+        &checksum_options::jobs_specified_ >;
+      _cli_checksum_options_map_["-j"] =
+      &::butl::cli::thunk< checksum_options, std::size_t, &checksum_options::jobs_,
+        &checksum_options::jobs_specified_ >;
+      _cli_checksum_options_map_["--cache"] =
+      &::butl::cli::thunk< checksum_options, std::string, &checksum_options::cache_,
+        &checksum_options::cache_specified_ >;
     }
   };
 
@@ -792,6 +792,12 @@ namespace butl
     const bool&
     force () const;
 
+    const std::size_t&
+    jobs () const;
+
+    bool
+    jobs_specified () const;
+
     // Implementation details.
     //
     protected:
@@ -807,6 +813,8 @@ namespace butl
     public:
     bool recursive_;
     bool force_;
+    std::size_t jobs_;
+    bool jobs_specified_;
   };
 
   class rmdir_options
@@ -1006,6 +1014,27 @@ namespace butl
     const bool&
     sum_only () const;
 
+    const bool&
+    tree () const;
+
+    const std::size_t&
+    chunk_size () const;
+
+    bool
+    chunk_size_specified () const;
+
+    const std::size_t&
+    jobs () const;
+
+    bool
+    jobs_specified () const;
+
+    const std::string&
+    cache () const;
+
+    bool
+    cache_specified () const;
+
     // Implementation details.
     //
     protected:
@@ -1022,6 +1051,13 @@ namespace butl
     bool binary_;
     bool text_;
     bool sum_only_;
+    bool tree_;
+    std::size_t chunk_size_;
+    bool chunk_size_specified_;
+    std::size_t jobs_;
+    bool jobs_specified_;
+    std::string cache_;
+    bool cache_specified_;
   };
 
   class sleep_options
@@ -238,6 +238,18 @@ namespace butl
     return this->force_;
   }
 
+  inline const std::size_t& rm_options::
+  jobs () const
+  {
+    return this->jobs_;
+  }
+
+  inline bool rm_options::
+  jobs_specified () const
+  {
+    return this->jobs_specified_;
+  }
+
   // rmdir_options
   //
 
@@ -295,6 +307,48 @@ namespace butl
     return this->sum_only_;
   }
 
+  inline const bool& checksum_options::
+  tree () const
+  {
+    return this->tree_;
+  }
+
+  inline const std::size_t& checksum_options::
+  chunk_size () const
+  {
+    return this->chunk_size_;
+  }
+
+  inline bool checksum_options::
+  chunk_size_specified () const
+  {
+    return this->chunk_size_specified_;
+  }
+
+  inline const std::size_t& checksum_options::
+  jobs () const
+  {
+    return this->jobs_;
+  }
+
+  inline bool checksum_options::
+  jobs_specified () const
+  {
+    return this->jobs_specified_;
+  }
+
+  inline const std::string& checksum_options::
+  cache () const
+  {
+    return this->cache_;
+  }
+
+  inline bool checksum_options::
+  cache_specified () const
+  {
+    return this->cache_specified_;
+  }
+
   // sleep_options
   //
 
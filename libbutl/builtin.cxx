@@ -32,6 +32,7 @@
 #include <cstdlib>      // strtoull()
 #include <cstring>      // strcmp()
 #include <exception>
+#include <type_traits>  // is_same
 #include <system_error>
 
 #ifndef _WIN32
@@ -39,6 +40,7 @@
 #endif
 
 #include <libbutl/regex.hxx>
+#include <libbutl/xxh3.hxx>
 #include <libbutl/xxh64.hxx>
 #include <libbutl/sha256.hxx>
 #include <libbutl/path-io.hxx>
@@ -47,6 +49,7 @@
 #include <libbutl/optional.hxx>
 #include <libbutl/filesystem.hxx>
 #include <libbutl/small-vector.hxx>
+#include <libbutl/file-hash-cache.hxx>
 
 #include <libbutl/builtin-options.hxx>
 
@@ -382,8 +385,26 @@ namespace butl
       //
       // Copy input stream to STDOUT.
       //
-      auto copy = [&cout] (istream& is)
+      // Note that nothing is read from the input stream before the copying
+      // and so, unless this is a small regular file, we first try to copy in
+      // kernel (see fdsplice() for details), flushing the pending output.
+      //
+      auto copy = [&cout] (ifdstream& is)
       {
+        entry_stat s (fdstat (is.fd ()));
+
+        if (s.type != entry_type::regular ||
+            s.size >= fdstreambuf::buffer_size)
+        {
+          cout.flush ();
+
+          if (fdsplice (is.fd (), cout.fd ()))
+          {
+            is.clear (istream::eofbit); // Sets eofbit.
+            return;
+          }
+        }
+
         if (is.peek () != ifdstream::traits_type::eof ())
           cout << is.rdbuf ();
 
@@ -474,22 +495,43 @@ namespace butl
     return 1;
   }
 
-  // sha256sum [(-b|--binary)|(-t|--text)] [--sum-only] <file>...
-  // xxh64sum  [(-b|--binary)|(-t|--text)] [--sum-only] <file>...
+  // Tree checksum calculator placeholder for the checksum builtins that
+  // don't support the tree mode (see below).
   //
-  // Common implementation of the sha256sum and xxh64sum builtins.
+  struct no_tree_checksum
+  {
+    no_tree_checksum (size_t, size_t) {assert (false);}
+    no_tree_checksum (istream&, size_t, size_t) {assert (false);}
+
+    const char*
+    string () const {assert (false); return nullptr;}
+  };
+
+  // sha256sum [(-b|--binary)|(-t|--text)] [--sum-only] [--cache <file>]
+  //           [--tree [--chunk-size <bytes>] [-j|--jobs <num>]] <file>...
+  // xxh64sum  [(-b|--binary)|(-t|--text)] [--sum-only] [--cache <file>]
+  //           [--tree [--chunk-size <bytes>] [-j|--jobs <num>]] <file>...
+  // xxh3sum   [(-b|--binary)|(-t|--text)] [--sum-only] [--cache <file>]
+  //           <file>...
+  //
+  // Common implementation of the sha256sum, xxh64sum, and xxh3sum builtins.
+  // The C and T template arguments are the plain and tree checksum
+  // calculators, respectively, with no_tree_checksum as T meaning that the
+  // tree mode is not supported. The alg argument is the file_hash_cache
+  // algorithm corresponding to C.
   //
   // Note that all the checksum builtins follow the sha256sum builtin in
   // regards to the command line interface, output format, and error handling.
   //
   // Also note that the name argument is only used for diagnostics.
   //
-  template <typename C>
+  template <typename C, typename T>
   static uint8_t
   checksum (const strings& args,
             auto_fd in, auto_fd out, auto_fd err,
             const dir_path& cwd,
             const builtin_callbacks& cbs,
+            file_hash_cache::algorithm alg,
             const char* name) noexcept
   try
   {
@@ -515,6 +557,24 @@ namespace butl
       if (ops.binary () && ops.text ())
         fail () << "both -b|--binary and -t|--text specified";
 
+      if (ops.tree () && is_same<T, no_tree_checksum>::value)
+        fail () << "--tree is not supported";
+
+      if (!ops.tree ())
+      {
+        if (ops.chunk_size_specified ())
+          fail () << "--chunk-size specified without --tree";
+
+        if (ops.jobs_specified ())
+          fail () << "-j|--jobs specified without --tree";
+      }
+
+      if (ops.chunk_size () == 0)
+        fail () << "invalid --chunk-size value 0";
+
+      if (ops.cache_specified () && ops.tree ())
+        fail () << "both --cache and --tree specified";
+
       ofdstream cout (out != nullfd ? move (out) : fddup (stdout_fd ()));
 
       ifdstream cin (
@@ -529,9 +589,9 @@ namespace butl
 
       // Print the checksum line to stdout.
       //
-      auto prn = [&cout, &ops] (C&& cs, const string& f)
+      auto prn = [&cout, &ops] (const char* cs, const string& f)
       {
-        cout << cs.string ();
+        cout << cs;
 
         if (!ops.sum_only ())
           cout << ' ' << (ops.binary () ? '*' : ' ') << f;
@@ -542,9 +602,16 @@ namespace butl
       // Calculate checksum over the input stream and print the checksum line
       // to stdout.
       //
-      auto sum = [&prn] (istream& is, const string& f)
+      // Note that in the tree mode the whole chunks in each block read from
+      // a file (up to 16MB, see below) are hashed using multiple threads (see
+      // sha256_tree for details).
+      //
+      auto sum = [&prn, &ops] (istream& is, const string& f)
       {
-        prn (C (is), f);
+        if (ops.tree ())
+          prn (T (is, ops.chunk_size (), ops.jobs ()).string (), f);
+        else
+          prn (C (is).string (), f);
       };
 
       // Path of a file being processed. An empty path represents stdin. Used
@@ -561,6 +628,31 @@ namespace butl
 
         dir_path wd;
 
+        // Open the checksum cache, if specified.
+        //
+        unique_ptr<file_hash_cache> cache;
+
+        if (ops.cache_specified ())
+        {
+          if (cwd.relative ())
+            wd = current_directory (cwd, fail);
+
+          path cp (parse_path (ops.cache (), !wd.empty () ? wd : cwd, fail));
+
+          try
+          {
+            cache.reset (new file_hash_cache (cp));
+          }
+          catch (const io_error& e)
+          {
+            fail () << "unable to open cache file '" << cp << "': " << e;
+          }
+          catch (const invalid_argument&)
+          {
+            fail () << "'" << cp << "' is not a cache file";
+          }
+        }
+
         // Calculate and print the file checksums.
         //
         fdopen_mode m (ops.binary () ? fdopen_mode::binary : fdopen_mode::none);
@@ -579,8 +671,10 @@ namespace butl
             //
             if (!cin.eof ())
               sum (cin, f);
+            else if (ops.tree ())
+              prn (T (ops.chunk_size (), ops.jobs ()).string (), f);
             else
-              prn (C (), f);
+              prn (C ().string (), f);
 
             continue;
           }
@@ -590,7 +684,34 @@ namespace butl
 
           p = parse_path (f, !wd.empty () ? wd : cwd, fail);
 
-          ifdstream is (p, m);
+          // Retrieve the checksum from the cache, if specified, and calculate
+          // (and cache) it otherwise.
+          //
+          if (cache != nullptr)
+          {
+            prn (cache->checksum (p, alg, m).c_str (), f);
+            continue;
+          }
+
+          // Note that we don't memory-map the file since it can be truncated
+          // by some other process while being hashed, which would result in
+          // SIGBUS terminating the whole build system process rather than
+          // in an I/O error (see fdstreambuf::mmap() for details).
+          //
+          // In the tree mode, however, we read the file in large blocks that
+          // contain multiple whole chunks, so that they can be hashed in
+          // parallel (see sha256_tree for details).
+          //
+          size_t bs (fdstreambuf::buffer_size);
+
+          if (ops.tree ())
+          {
+            const size_t tb (16 * 1024 * 1024);
+            size_t cs (ops.chunk_size ());
+            bs = cs < tb ? tb / cs * cs : tb;
+          }
+
+          ifdstream is (p, m, ifdstream::badbit | ifdstream::failbit, bs);
           sum (is, f);
           is.close ();
         }
@@ -638,7 +759,19 @@ namespace butl
     return 1;
   }
 
-  // sha256sum [(-b|--binary)|(-t|--text)] [--sum-only] <file>...
+  // sha256sum [(-b|--binary)|(-t|--text)] [--sum-only] [--cache <file>]
+  //           [--tree [--chunk-size <bytes>] [-j|--jobs <num>]] <file>...
+  //
+  // The --tree option is an extension which prints the SHA256 tree
+  // checksum (see sha256_tree for details) of the chunks of the specified
+  // size (1MB by default). The --jobs option specifies the maximum number of
+  // threads to use for hashing the chunks, with 0 (default) meaning the
+  // number of hardware threads.
+  //
+  // The --cache option is an extension which retrieves the file checksums
+  // from the specified persistent cache file, if they are up to date, and
+  // stores them there otherwise (see file_hash_cache for details). It cannot
+  // be combined with --tree. The stdin checksum is never cached.
   //
   // Note that after I/O operation failure the original GNU's implementation
   // issues diagnostics but proceeds with the rest of the arguments. The
@@ -657,11 +790,13 @@ namespace butl
              const dir_path& cwd,
              const builtin_callbacks& cbs) noexcept
   {
-    return checksum<sha256> (
-      args, move (in), move (out), move (err), cwd, cbs, "sha256sum");
+    return checksum<sha256, sha256_tree> (
+      args, move (in), move (out), move (err), cwd, cbs,
+      file_hash_cache::algorithm::sha256, "sha256sum");
   }
 
-  // xxh64sum [(-b|--binary)|(-t|--text)] [--sum-only] <file>...
+  // xxh64sum [(-b|--binary)|(-t|--text)] [--sum-only] [--cache <file>]
+  //          [--tree [--chunk-size <bytes>] [-j|--jobs <num>]] <file>...
   //
   // The noticeable deviations from the xxh64sum utility are:
   //
@@ -669,6 +804,10 @@ namespace butl
   // - Support for text mode (-t|--text option) and using it by default.
   // - Marking files read in the binary mode with '*' instead of ' '.
   // - No support for the --little-endian option.
+  // - Support for the tree checksum (--tree option; see sha256sum for
+  //   details).
+  // - Support for the checksum cache (--cache option; see sha256sum for
+  //   details).
   //
   // Note: must be executed asynchronously.
   //
@@ -678,8 +817,32 @@ namespace butl
             const dir_path& cwd,
             const builtin_callbacks& cbs) noexcept
   {
-    return checksum<xxh64> (
-      args, move (in), move (out), move (err), cwd, cbs, "xxh64sum");
+    return checksum<xxh64, xxh64_tree> (
+      args, move (in), move (out), move (err), cwd, cbs,
+      file_hash_cache::algorithm::xxh64, "xxh64sum");
+  }
+
+  // xxh3sum [(-b|--binary)|(-t|--text)] [--sum-only] [--cache <file>]
+  //         <file>...
+  //
+  // Print the XXH3 (64-bit) checksums. The noticeable deviations from the
+  // xxh3sum utility are the same as for xxh64sum (see above for details)
+  // plus:
+  //
+  // - No 'XXH3_' prefix in the checksum lines.
+  // - No support for the tree checksum.
+  //
+  // Note: must be executed asynchronously.
+  //
+  static uint8_t
+  xxh3sum (const strings& args,
+           auto_fd in, auto_fd out, auto_fd err,
+           const dir_path& cwd,
+           const builtin_callbacks& cbs) noexcept
+  {
+    return checksum<xxh3_64, no_tree_checksum> (
+      args, move (in), move (out), move (err), cwd, cbs,
+      file_hash_cache::algorithm::xxh3_64, "xxh3sum");
   }
 
   // Make a copy of a file at the specified path, preserving permissions, and
@@ -2140,7 +2303,7 @@ namespace butl
     return 1;
   }
 
-  // rm [-r|--recursive] [-f|--force] <path>...
+  // rm [-r|--recursive] [-f|--force] [-j|--jobs <num>] <path>...
   //
   // The implementation deviates from POSIX in a number of ways. It doesn't
   // interact with a user and fails immediately if unable to process an
@@ -2148,6 +2311,10 @@ namespace butl
   // consider files and directory permissions in any way just trying to remove
   // a filesystem entry. Always fails if empty path is specified.
   //
+  // The --jobs option specifies the maximum number of threads to use for
+  // removing directories recursively, with 0 meaning the number of hardware
+  // threads (see rmdir_r() for details).
+  //
   // Note: can be executed synchronously.
   //
   static uint8_t
@@ -2206,7 +2373,7 @@ namespace butl
             // The call can result in rmdir_status::not_exist. That's not very
             // likely but there is also nothing bad about it.
             //
-            try_rmdir_r (d);
+            try_rmdir_r (d, false /* ignore_error */, ops.jobs ());
           }
           else if (try_rmfile (p) == rmfile_status::not_exist &&
                    !ops.force ())
@@ -3142,6 +3309,7 @@ namespace butl
     {"test",      {&sync_impl<&test>,       1}},
     {"touch",     {&sync_impl<&touch>,      2}},
     {"true",      {&true_,                  0}},
+    {"xxh3sum",   {&async_impl<&xxh3sum>,   2}},
     {"xxh64sum",  {&async_impl<&xxh64sum>,  2}}
   };
 
@@ -8,12 +8,19 @@
 #ifndef _WIN32
 #  include <fcntl.h>      // open(), O_*, fcntl()
 #  include <unistd.h>     // close(), read(), write(), lseek(), dup(), pipe(),
-                          // ftruncate(), isatty(), ssize_t, STD*_FILENO
+                          // pipe2(), ftruncate(), isatty(), ssize_t,
+                          // STD*_FILENO
+#  include <limits.h>     // IOV_MAX
 #  include <sys/uio.h>    // writev(), iovec
+#  include <sys/mman.h>   // mmap(), munmap(), posix_madvise()
 #  include <sys/stat.h>   // stat(), fstat(), S_I*, mkfifo()
-#  include <sys/time.h>   // timeval
 #  include <sys/types.h>  // stat, off_t
-#  include <sys/select.h>
+#  include <poll.h>       // poll(), pollfd, POLL*
+
+#  ifdef __linux__
+#    include <sys/epoll.h>    // epoll_*()
+#    include <sys/sendfile.h> // sendfile()
+#  endif
 #else
 #  include <libbutl/win32-utility.hxx>
 
@@ -45,13 +52,13 @@ namespace this_thread = std::this_thread;
 #  include <libbutl/mingw-thread.hxx>
 namespace this_thread = mingw_stdthread::this_thread;
 #endif
-
-#  include <algorithm> // count()
 #endif
 
 #include <ios>          // ios_base::openmode, ios_base::failure
 #include <new>          // bad_alloc
+#include <atomic>
 #include <limits>       // numeric_limits
+#include <algorithm>    // min(), count()
 #include <cassert>
 #include <cstring>      // memcpy(), memmove(), memchr(), strcmp()
 #include <cstdlib>      // getenv()
@@ -182,12 +189,187 @@ namespace butl
 
     non_blocking_ = non_blocking (fd.get ());
 
-    setg (buf_, buf_, buf_);
-    setp (buf_, buf_ + sizeof (buf_) - 1); // Keep space for overflow's char.
+    // Allocate the buffer on the first open.
+    //
+    if (buf_ == nullptr)
+      buf_.reset (new char[bufsize_]);
+
+    char* b (buf_.get ());
+    setg (b, b, b);
+    setp (b, b + bufsize_ - 1); // Keep space for overflow's char.
     off_ = pos;
     fd_ = move (fd);
   }
 
+  fdstreambuf::
+  ~fdstreambuf ()
+  {
+    unmap ();
+  }
+
+  // The maximum size of the get area exposed for the memory-mapped file.
+  // Since the streambuf interface (gbump(), etc) as well as its users
+  // operate with int offsets, the mapped data is exposed in windows of this
+  // size, moving to the next window on underflow (see load() for details).
+  //
+  static const size_t map_window_max = 1024 * 1024 * 1024;
+  static atomic<size_t> map_window_size (map_window_max);
+
+  size_t fdstreambuf::
+  map_window (size_t n)
+  {
+    if (n == 0 || n > map_window_max)
+      throw invalid_argument ("invalid memory-mapped file window size");
+
+    return map_window_size.exchange (n, memory_order_relaxed);
+  }
+
+  bool fdstreambuf::
+  mmap ()
+  {
+    if (map_ != nullptr)
+      return true;
+
+    if (!is_open ())
+      throw_generic_ios_failure (EBADF); // POSIX value.
+
+#ifndef _WIN32
+    int fd (fd_.get ());
+
+    struct stat s;
+    if (fstat (fd, &s) != 0)
+      throw_generic_ios_failure (errno);
+
+    if (!S_ISREG (s.st_mode) ||
+        s.st_size <= 0      ||
+        static_cast<uint64_t> (s.st_size) > numeric_limits<size_t>::max ())
+      return false;
+
+    size_t n (static_cast<size_t> (s.st_size));
+
+    // Note that the get area may already contain some data, so the physical
+    // position to start from precedes the file descriptor position.
+    //
+    size_t gn (egptr () - gptr ());
+
+    off_t p (lseek (fd, 0, SEEK_CUR));
+    if (p == -1)
+      throw_generic_ios_failure (errno);
+
+    if (static_cast<size_t> (p) < gn || static_cast<size_t> (p) - gn > n)
+      return false;
+
+    size_t c (static_cast<size_t> (p) - gn);
+
+    void* m (::mmap (nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0));
+
+    // Fallback to the buffered reading if the filesystem doesn't support
+    // mapping, etc.
+    //
+    if (m == MAP_FAILED)
+      return false;
+
+    // Position the file descriptor at the end of the mapped data, as if it
+    // has all been read, so that, for example, the descriptor is consistent
+    // with the stream state if released.
+    //
+    if (lseek (fd, static_cast<off_t> (n), SEEK_SET) == -1)
+    {
+      int e (errno);
+      munmap (m, n);
+      throw_generic_ios_failure (e);
+    }
+
+    posix_madvise (m, n, POSIX_MADV_SEQUENTIAL); // Ignore errors.
+
+    // Preserve the logical position (see bufstreambuf::tellg()).
+    //
+    uint64_t pos (tellg ());
+
+    map_ = static_cast<char*> (m);
+    map_size_ = n;
+
+    size_t e (min (c + map_window_size.load (memory_order_relaxed), n));
+    setg (map_ + c, map_ + c, map_ + e);
+    off_ = pos + (e - c);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void fdstreambuf::
+  unmap () noexcept
+  {
+    if (map_ != nullptr)
+    {
+#ifndef _WIN32
+      munmap (map_, map_size_);
+#endif
+      map_ = nullptr;
+      map_size_ = 0;
+
+      char* b (buf_.get ());
+      setg (b, b, b);
+    }
+  }
+
+  void fdstreambuf::
+  bufsize (size_t n)
+  {
+    assert (n != 0);
+
+    if (n == bufsize_)
+      return;
+
+    // If the file is memory-mapped, then the buffer holds no data and we
+    // just reallocate it.
+    //
+    if (map_ != nullptr)
+    {
+      buf_.reset (new char[n]);
+      bufsize_ = n;
+
+      char* b (buf_.get ());
+      setp (b, b + n - 1);
+      return;
+    }
+
+    // If the buffer is not allocated yet, then just remember the size for
+    // the subsequent open().
+    //
+    if (buf_ == nullptr)
+    {
+      bufsize_ = n;
+      return;
+    }
+
+    // Note that only one of the get and put areas can contain data, depending
+    // on whether this is an input or output stream. Also note that for the
+    // output data we need to keep space for overflow's char (see open()).
+    //
+    size_t gn (egptr () - gptr ());
+    size_t pn (pptr () - pbase ());
+
+    if (gn > n || pn >= n)
+      throw_generic_ios_failure (EINVAL);
+
+    unique_ptr<char[]> nb (new char[n]);
+    char* b (nb.get ());
+
+    if (gn != 0)
+      memcpy (b, gptr (), gn);
+    else if (pn != 0)
+      memcpy (b, pbase (), pn);
+
+    setg (b, b, b + gn);
+    setp (b, b + n - 1);
+    pbump (static_cast<int> (pn));
+
+    buf_ = move (nb);
+    bufsize_ = n;
+  }
+
   bool fdstreambuf::
   blocking (bool m)
   {
@@ -223,9 +405,12 @@ namespace butl
     if (n > 0)
       return n;
 
+    if (map_ != nullptr)
+      return load () ? egptr () - gptr () : -1;
+
     if (non_blocking_)
     {
-      streamsize n (fdread (fd_.get (), buf_, sizeof (buf_)));
+      streamsize n (fdread (fd_.get (), buf_.get (), bufsize_));
 
       if (n == -1)
       {
@@ -238,7 +423,7 @@ namespace butl
       if (n == 0) // EOF.
         return -1;
 
-      setg (buf_, buf_, buf_ + n);
+      setg (buf_.get (), buf_.get (), buf_.get () + n);
       off_ += n;
 
       return n;
@@ -272,16 +457,33 @@ namespace butl
   bool fdstreambuf::
   load ()
   {
+    // If memory-mapped, then expose the next window of the mapped data, if
+    // any.
+    //
+    if (map_ != nullptr)
+    {
+      size_t b (egptr () - map_);
+
+      if (b == map_size_) // EOF.
+        return false;
+
+      size_t e (min (b + map_window_size.load (memory_order_relaxed),
+                     map_size_));
+      setg (map_ + b, map_ + b, map_ + e);
+      off_ += e - b;
+      return true;
+    }
+
     // Doesn't handle blocking mode and so should not be called.
     //
     assert (!non_blocking_);
 
-    streamsize n (fdread (fd_.get (), buf_, sizeof (buf_)));
+    streamsize n (fdread (fd_.get (), buf_.get (), bufsize_));
 
     if (n == -1)
       throw_generic_ios_failure (errno);
 
-    setg (buf_, buf_, buf_ + n);
+    setg (buf_.get (), buf_.get (), buf_.get () + n);
     off_ += n;
     return n != 0;
   }
@@ -295,6 +497,23 @@ namespace butl
     if (non_blocking_)
       throw_generic_ios_failure (ENOTSUP);
 
+    // If memory-mapped, then just reposition within the get area.
+    //
+    if (map_ != nullptr)
+    {
+      // Fail if trying to seek beyond the end of the stream.
+      //
+      if (off > map_size_)
+        throw_generic_ios_failure (EINVAL);
+
+      size_t b (static_cast<size_t> (off));
+      size_t e (min (b + map_window_size.load (memory_order_relaxed),
+                     map_size_));
+      setg (map_ + b, map_ + b, map_ + e);
+      off_ = e;
+      return;
+    }
+
     // The plan is to rewind to the beginning of the stream, read the
     // requested number of characters and reset the get area, so it will be
     // filled from scratch on the next read from the stream.
@@ -303,8 +522,8 @@ namespace butl
 
     for (uint64_t n (off); n != 0; )
     {
-      size_t m (n > sizeof (buf_) ? sizeof (buf_) : static_cast<size_t> (n));
-      streamsize r (fdread (fd_.get (), buf_, m));
+      size_t m (n > bufsize_ ? bufsize_ : static_cast<size_t> (n));
+      streamsize r (fdread (fd_.get (), buf_.get (), m));
 
       if (r == -1)
         throw_generic_ios_failure (errno);
@@ -318,7 +537,7 @@ namespace butl
     }
 
     off_ = off;
-    setg (buf_, buf_, buf_);
+    setg (buf_.get (), buf_.get (), buf_.get ());
   }
 
   fdstreambuf::int_type fdstreambuf::
@@ -377,7 +596,7 @@ namespace butl
       // descriptor opened for read-only access (while -1 with errno EBADF is
       // expected). This is in contrast with VC's _write() and POSIX's write().
       //
-      auto m (fdwrite (fd_.get (), buf_, n));
+      auto m (fdwrite (fd_.get (), buf_.get (), n));
 
       if (m == -1)
         throw_generic_ios_failure (errno);
@@ -387,7 +606,7 @@ namespace butl
       if (n != static_cast<size_t> (m))
         return false;
 
-      setp (buf_, buf_ + sizeof (buf_) - 1);
+      setp (buf_.get (), buf_.get () + bufsize_ - 1);
     }
 
     return true;
@@ -460,7 +679,7 @@ namespace butl
       return 0;
     }
 
-    setp (buf_, buf_ + sizeof (buf_) - 1);
+    setp (buf_.get (), buf_.get () + bufsize_ - 1);
     return m - bn;
 
 #else
@@ -492,7 +711,7 @@ namespace butl
     // Flush the buffer.
     //
     size_t wn (bn + an);
-    streamsize r (wn > 0 ? fdwrite (fd_.get (), buf_, wn) : 0);
+    streamsize r (wn > 0 ? fdwrite (fd_.get (), buf_.get (), wn) : 0);
 
     if (r == -1)
       throw_generic_ios_failure (errno);
@@ -510,7 +729,7 @@ namespace butl
       return m < bn ? 0 : m - bn;
     }
 
-    setp (buf_, buf_ + sizeof (buf_) - 1);
+    setp (buf_.get (), buf_.get () + bufsize_ - 1);
 
     // Now 'an' holds the size of the data portion written as a part of the
     // buffer flush.
@@ -546,6 +765,101 @@ namespace butl
 #endif
   }
 
+  void fdstreambuf::
+  xsputv (const fdstream_iov* v, size_t n)
+  {
+    // See xsputn() for details.
+    //
+    if (non_blocking_)
+      throw_generic_ios_failure (ENOTSUP);
+
+    size_t sn (0);
+    for (size_t i (0); i != n; ++i)
+      sn += v[i].size;
+
+    // Buffer the data if there is enough space.
+    //
+    if (sn <= static_cast<size_t> (epptr () - pptr ()))
+    {
+      for (size_t i (0); i != n; ++i)
+      {
+        if (size_t k = v[i].size) // See xsputn() for the NULL data case.
+        {
+          memcpy (pptr (), v[i].data, k);
+          pbump (static_cast<int> (k));
+        }
+      }
+
+      return;
+    }
+
+#ifndef _WIN32
+
+    // Write the buffered and new data skipping the empty chunks.
+    //
+    small_vector<iovec, 16> iov;
+
+    if (size_t bn = pptr () - pbase ())
+      iov.push_back (iovec {pbase (), bn});
+
+    for (size_t i (0); i != n; ++i)
+    {
+      if (v[i].size != 0)
+        iov.push_back (iovec {const_cast<void*> (v[i].data), v[i].size});
+    }
+
+#ifdef IOV_MAX
+    const size_t iov_max (IOV_MAX);
+#else
+    const size_t iov_max (16); // _XOPEN_IOV_MAX
+#endif
+
+    for (size_t i (0); i != iov.size (); )
+    {
+      size_t k (iov.size () - i);
+      ssize_t r (writev (fd_.get (),
+                         iov.data () + i,
+                         static_cast<int> (k < iov_max ? k : iov_max)));
+
+      if (r == -1)
+        throw_generic_ios_failure (errno);
+
+      size_t m (static_cast<size_t> (r));
+      off_ += m;
+
+      // Skip the fully written chunks and adjust the partially written one,
+      // if any.
+      //
+      for (; i != iov.size () && m >= iov[i].iov_len; ++i)
+        m -= iov[i].iov_len;
+
+      if (m != 0)
+      {
+        iovec& c (iov[i]);
+        c.iov_base = static_cast<char*> (c.iov_base) + m;
+        c.iov_len -= m;
+      }
+    }
+
+    setp (buf_.get (), buf_.get () + bufsize_ - 1);
+
+#else
+
+    // On Windows there is no writev() available so just write the chunks one
+    // by one. Note that a partial write here can only be caused by an error
+    // (no space on device, etc).
+    //
+    for (size_t i (0); i != n; ++i)
+    {
+      streamsize k (static_cast<streamsize> (v[i].size));
+
+      if (k != 0 && xsputn (static_cast<const char*> (v[i].data), k) != k)
+        throw_generic_ios_failure (EIO);
+    }
+
+#endif
+  }
+
   // Common call chains:
   //
   // - basic_ostream::seekp(pos)                    ->
@@ -631,6 +945,33 @@ namespace butl
       }
     case ios_base::in:
       {
+        // If memory-mapped, then just reposition within the get area. Note
+        // that after such a seek the logical position matches the physical
+        // one, the same as for the buffered reading.
+        //
+        if (map_ != nullptr)
+        {
+          off_type n (static_cast<off_type> (map_size_));
+          off_type p (dir == ios_base::beg ? off               :
+                      dir == ios_base::cur ? gptr () - map_ + off :
+                                             n + off);
+
+          if (p < 0 || p > n)
+            return static_cast<off_type> (-1);
+
+          // Don't reset the get area for noop seeks (see below).
+          //
+          if (dir == ios_base::cur && off == 0)
+            return p;
+
+          size_t b (static_cast<size_t> (p));
+          size_t e (min (b + map_window_size.load (memory_order_relaxed),
+                         map_size_));
+          setg (map_ + b, map_ + b, map_ + e);
+          off_ = e;
+          return p;
+        }
+
         // We may have unread data in the get area and need to subtract its
         // size from the offset if we seek from the current position.
         //
@@ -677,7 +1018,7 @@ namespace butl
 
         // Reset the get area.
         //
-        setg (buf_, buf_, buf_);
+        setg (buf_.get (), buf_.get (), buf_.get ());
         break;
       }
     default: return static_cast<off_type> (-1);
@@ -714,8 +1055,11 @@ namespace butl
   // fdstream_base
   //
   fdstream_base::
-  fdstream_base (auto_fd&& fd, fdstream_mode m, std::uint64_t pos)
-      : fdstream_base (mode (move (fd), m), pos)
+  fdstream_base (auto_fd&& fd,
+                 fdstream_mode m,
+                 std::uint64_t pos,
+                 std::size_t bufsize)
+      : fdstream_base (mode (move (fd), m), pos, bufsize)
   {
   }
 
@@ -773,7 +1117,7 @@ namespace butl
   }
 
   ifdstream::
-  ifdstream (const char* f, fdopen_mode m, iostate e)
+  ifdstream (const char* f, fdopen_mode m, iostate e, std::size_t bufsize)
       : ifdstream (fdopen (f,
                            // If fdopen_mode::in is not specified, then
                            // emulate the ios::in semantics.
@@ -781,7 +1125,10 @@ namespace butl
                            (m & fdopen_mode::in) == fdopen_mode::in
                            ? m
                            : m | translate_mode (in)),
-                   e)
+                   fdstream_mode::none,
+                   e,
+                   0 /* pos */,
+                   bufsize)
   {
   }
 
@@ -833,6 +1180,9 @@ namespace butl
   {
     open (mode (std::move (fd), m), pos);
     skip_ = (m & fdstream_mode::skip) == fdstream_mode::skip;
+
+    if (flag (m, fdstream_mode::mmap) && is_open ())
+      buf_.mmap ();
   }
 
   void ifdstream::
@@ -942,7 +1292,7 @@ namespace butl
   }
 
   ofdstream::
-  ofdstream (const char* f, fdopen_mode m, iostate e)
+  ofdstream (const char* f, fdopen_mode m, iostate e, std::size_t bufsize)
       : ofdstream (fdopen (f,
                            // If fdopen_mode::out is not specified, then
                            // emulate the ios::out semantics.
@@ -950,7 +1300,10 @@ namespace butl
                            (m & fdopen_mode::out) == fdopen_mode::out
                            ? m
                            : m | translate_mode (out)),
-                   e)
+                   fdstream_mode::none,
+                   e,
+                   0 /* pos */,
+                   bufsize)
   {
   }
 
@@ -987,6 +1340,31 @@ namespace butl
                   : m | translate_mode (out)));
   }
 
+  ofdstream& ofdstream::
+  write_iov (const fdstream_iov* v, size_t n)
+  {
+    sentry s (*this);
+
+    if (s)
+    {
+      try
+      {
+        buf_.xsputv (v, n);
+      }
+      catch (const ios_base::failure&)
+      {
+        // Set badbit without throwing the exception (see getline() for
+        // background).
+        //
+        exceptions (goodbit);
+        setstate (badbit);
+        throw;
+      }
+    }
+
+    return *this;
+  }
+
   istream&
   open_file_or_stdin (path_name& pn, ifdstream& ifs)
   {
@@ -1330,6 +1708,22 @@ namespace butl
     if ((f & FD_CLOEXEC) == 0)
       return dup ();
 
+    // Note that F_DUPFD_CLOEXEC (POSIX.1-2008) sets the flag atomically and
+    // so we don't need to acquire the process_spawn_mutex (which is also
+    // relied upon by process::concurrent_startup()).
+    //
+#ifdef F_DUPFD_CLOEXEC
+    {
+      auto_fd r (fcntl (fd, F_DUPFD_CLOEXEC, 0));
+
+      if (r.get () != -1)
+        return r;
+
+      if (errno != EINVAL) // Not supported by the kernel?
+        throw_generic_ios_failure (errno);
+    }
+#endif
+
     slock l (process_spawn_mutex);
     auto_fd r (dup ());
 
@@ -1421,9 +1815,20 @@ namespace butl
     // Note that the pipe file descriptors can leak into child processes before
     // we set FD_CLOEXEC flag for them. To prevent this we will acquire the
     // process_spawn_mutex (see process-details header) prior to creating the
-    // pipe. Also note there is pipe2() (available on Linux and FreeBSD but not
-    // on Max OS) that takes flags.
-    //
+    // pipe, unless pipe2() (available on Linux and BSDs but not on Mac OS) is
+    // available, which sets the flag atomically (this is also relied upon by
+    // process::concurrent_startup()).
+    //
+#if defined(__linux__)   || \
+    defined(__FreeBSD__) || \
+    defined(__NetBSD__)  || \
+    defined(__OpenBSD__)
+    int pd[2];
+    if (pipe2 (pd, O_CLOEXEC) == -1)
+      throw_generic_ios_failure (errno);
+
+    return fdpipe {auto_fd (pd[0]), auto_fd (pd[1])};
+#else
     slock l (process_spawn_mutex);
 
     int pd[2];
@@ -1440,6 +1845,93 @@ namespace butl
     }
 
     return r;
+#endif
+  }
+
+  size_t
+  fdpipe_size (int fd, size_t n)
+  {
+#ifdef F_SETPIPE_SZ
+    if (n > static_cast<size_t> (numeric_limits<int>::max ()))
+      throw_generic_ios_failure (EINVAL);
+
+    int r (fcntl (fd, F_SETPIPE_SZ, static_cast<int> (n)));
+    if (r == -1)
+      throw_generic_ios_failure (errno);
+
+    return static_cast<size_t> (r);
+#else
+    // Make sure the descriptor is valid, for consistency.
+    //
+    if (fcntl (fd, F_GETFD) == -1)
+      throw_generic_ios_failure (errno);
+
+    return 0;
+#endif
+  }
+
+  bool
+  fdsplice (int in, int out)
+  {
+#ifdef __linux__
+    struct stat si;
+    struct stat so;
+    if (fstat (in, &si) != 0 || fstat (out, &so) != 0)
+      throw_generic_ios_failure (errno);
+
+    // Note that splice() requires one of the descriptors to be a pipe and
+    // sendfile() requires the input to be mmap-able.
+    //
+    bool pipe (S_ISFIFO (si.st_mode) || S_ISFIFO (so.st_mode));
+
+    if (!pipe && !S_ISREG (si.st_mode))
+      return false;
+
+    // In the non-blocking mode we would need to wait for the descriptors to
+    // become ready which we leave to the buffered copying.
+    //
+    for (int fd: {in, out})
+    {
+      int f (fcntl (fd, F_GETFL));
+      if (f == -1)
+        throw_generic_ios_failure (errno);
+
+      if ((f & O_NONBLOCK) != 0)
+        return false;
+    }
+
+    for (bool copied (false);; )
+    {
+      // Note that both functions transfer at most 0x7ffff000 bytes at once.
+      //
+      ssize_t n (pipe
+                 ? splice (in, nullptr, out, nullptr, 0x7ffff000, SPLICE_F_MOVE)
+                 : sendfile (out, in, nullptr, 0x7ffff000));
+
+      if (n == 0)
+        return true;
+
+      if (n == -1)
+      {
+        if (errno == EINTR)
+          continue;
+
+        // For example, the output descriptor is opened in the append mode or
+        // the filesystem doesn't support these operations.
+        //
+        if (!copied && (errno == EINVAL || errno == ENOSYS))
+          return false;
+
+        throw_generic_ios_failure (errno);
+      }
+
+      copied = true;
+    }
+#else
+    (void) in;
+    (void) out;
+    return false;
+#endif
   }
 
   void
@@ -1503,53 +1995,15 @@ namespace butl
     return t != nullptr && strcmp (t, "dumb") != 0;
   }
 
-  static pair<size_t, size_t>
-  fdselect (fdselect_set& read,
-            fdselect_set& write,
-            const chrono::milliseconds* timeout)
+  // Repeat the poll() call while getting the EINTR error (recalculating the
+  // timeout, if specified) and throw on any other error. Return the number of
+  // ready descriptors.
+  //
+  static size_t
+  poll (pollfd* fds, size_t n, const chrono::milliseconds* timeout)
   {
     using namespace chrono;
 
-    // Copy fdselect_set into the native fd_set, updating max_fd. Also clear
-    // the ready flag in the source set.
-    //
-    int max_fd (-1);
-
-    auto copy_set = [&max_fd] (fdselect_set& from, fd_set& to)
-    {
-      FD_ZERO (&to);
-
-      for (fdselect_state& s: from)
-      {
-        s.ready = false;
-
-        if (s.fd == nullfd)
-          continue;
-
-        if (s.fd < 0)
-          throw invalid_argument ("invalid file descriptor");
-
-        FD_SET (s.fd, &to);
-
-        if (max_fd < s.fd)
-          max_fd = s.fd;
-      }
-    };
-
-    fd_set rds;
-    fd_set wds;
-    copy_set (read,  rds);
-    copy_set (write, wds);
-
-    if (max_fd == -1)
-      throw invalid_argument ("empty file descriptor set");
-
-    ++max_fd;
-
-    // Note that if the timeout is not NULL, then the select timeout needs to
-    // be recalculated for each select() call (of which we can potentially
-    // have multiple due to EINTR). So the timeout can be used as bool.
-    //
     timestamp now;
     timestamp deadline;
 
@@ -1559,34 +2013,23 @@ namespace butl
       deadline = now + *timeout;
     }
 
-    // Repeat the select() call while getting the EINTR error and throw on
-    // any other error.
-    //
-    // Note that select() doesn't modify the sets on failure (according to
-    // POSIX standard as well as to the Linux, FreeBSD and MacOS man pages).
-    //
-    for (timeval tv;;)
+    for (;;)
     {
+      int t (-1);
+
       if (timeout)
       {
-        if (now < deadline)
-        {
-          microseconds t (duration_cast<microseconds> (deadline - now));
-          tv.tv_sec  = t.count () / 1000000;
-          tv.tv_usec = t.count () % 1000000;
-        }
-        else
-        {
-          tv.tv_sec  = 0;
-          tv.tv_usec = 0;
-        }
+        // Round the remaining time up so not to spin with the zero timeout
+        // until the deadline.
+        //
+        t = now < deadline
+            ? static_cast<int> (
+                (duration_cast<microseconds> (deadline - now).count () + 999) /
+                1000)
+            : 0;
       }
 
-      int r (select (max_fd,
-                     &rds,
-                     &wds,
-                     nullptr /* exceptfds */,
-                     timeout ? &tv : nullptr));
+      int r (::poll (fds, static_cast<nfds_t> (n), t));
 
       if (r == -1)
       {
@@ -1604,12 +2047,56 @@ namespace butl
       if (!timeout)
         assert (r != 0); // We don't expect the timeout to occur.
 
-      break;
+      return static_cast<size_t> (r);
     }
+  }
+
+  static pair<size_t, size_t>
+  fdselect (fdselect_set& read,
+            fdselect_set& write,
+            const chrono::milliseconds* timeout)
+  {
+    // Copy fdselect_set into the native pollfd array. Also clear the ready
+    // flag in the source set.
+    //
+    // Note that in contrast to select(), poll() is not limited to
+    // descriptors less than FD_SETSIZE.
+    //
+    small_vector<pollfd, 8> fds;
+
+    auto copy_set = [&fds] (fdselect_set& from, short events)
+    {
+      for (fdselect_state& s: from)
+      {
+        s.ready = false;
+
+        if (s.fd == nullfd)
+          continue;
+
+        if (s.fd < 0)
+          throw invalid_argument ("invalid file descriptor");
+
+        fds.push_back (pollfd {s.fd, events, 0});
+      }
+    };
+
+    copy_set (read,  POLLIN);
+    copy_set (write, POLLOUT);
+
+    if (fds.empty ())
+      throw invalid_argument ("empty file descriptor set");
+
+    poll (fds.data (), fds.size (), timeout);
 
     // Set the resulting ready states.
     //
-    auto copy_states = [] (const fd_set& from, fdselect_set& to)
+    // Note that we treat the error and hangup conditions as readiness, the
+    // same way as select() does, so that the subsequent read/write reports
+    // EOF or the error.
+    //
+    const pollfd* p (fds.data ());
+
+    auto copy_states = [&p] (fdselect_set& to)
     {
       size_t r (0);
       for (fdselect_state& s: to)
@@ -1617,7 +2104,12 @@ namespace butl
         if (s.fd == nullfd)
           continue;
 
-        if (FD_ISSET (s.fd, &from))
+        short e ((p++)->revents);
+
+        if ((e & POLLNVAL) != 0)
+          throw_system_ios_failure (EBADF);
+
+        if (e != 0)
         {
           ++r;
           s.ready = true;
@@ -1627,7 +2119,8 @@ namespace butl
       return r;
     };
 
-    return make_pair (copy_states (rds, read), copy_states (wds, write));
+    size_t nr (copy_states (read));
+    return make_pair (nr, copy_states (write));
   }
 
   streamsize
@@ -1890,6 +2383,22 @@ namespace butl
     return {auto_fd (pd[0]), auto_fd (pd[1])};
   }
 
+  size_t
+  fdpipe_size (int fd, size_t)
+  {
+    // Note that the pipe buffer size can only be specified on creation on
+    // Windows. Make sure the descriptor is valid, for consistency.
+    //
+    fd_to_handle (fd);
+    return 0;
+  }
+
+  bool
+  fdsplice (int, int)
+  {
+    return false;
+  }
+
   void
   fdtruncate (int fd, uint64_t n)
   {
@@ -2272,4 +2781,295 @@ namespace butl
   {
     return fdselect (read, write, &timeout);
   }
+
+  // fdselector
+  //
+  fdselector::
+  fdselector ()
+  {
+#ifdef __linux__
+    epoll_fd_ = epoll_create1 (EPOLL_CLOEXEC);
+
+    // Fallback to fdselect() if epoll is not supported by the kernel.
+    //
+    if (epoll_fd_ == -1 && errno != ENOSYS)
+      throw_system_ios_failure (errno);
+#endif
+  }
+
+  fdselector::
+  ~fdselector ()
+  {
+    if (epoll_fd_ != -1)
+      fdclose (epoll_fd_); // Ignore errors.
+  }
+
+#ifdef __linux__
+  static inline uint32_t
+  epoll_events (bool read, bool write)
+  {
+    uint32_t r (0);
+
+    if (read)
+      r |= EPOLLIN;
+
+    if (write)
+      r |= EPOLLOUT;
+
+    return r;
+  }
+#endif
+
+  void fdselector::
+  add (int fd, bool write, void* data)
+  {
+    if (fd < 0)
+      throw invalid_argument ("invalid file descriptor");
+
+    auto i (entries_.find (fd));
+    bool exists (i != entries_.end ());
+
+    if (exists && (write ? i->second.write : i->second.read))
+      throw invalid_argument ("file descriptor is already added");
+
+    entry e (exists ? i->second : entry ());
+
+    if (write)
+    {
+      e.write = true;
+      e.write_data = data;
+    }
+    else
+    {
+      e.read = true;
+      e.read_data = data;
+    }
+
+#ifdef __linux__
+    if (epoll_fd_ != -1 && !e.always_ready)
+    {
+      epoll_event ev;
+      ev.events = epoll_events (e.read, e.write);
+      ev.data.fd = fd;
+
+      if (epoll_ctl (epoll_fd_,
+                     exists ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                     fd,
+                     &ev) == -1)
+      {
+        // Note that epoll doesn't support regular files and directories and
+        // fails with EPERM for them. Since select() always reports such
+        // descriptors as ready, we do the same.
+        //
+        if (errno != EPERM)
+          throw_system_ios_failure (errno);
+
+        e.always_ready = true;
+        ++always_ready_;
+      }
+    }
+#endif
+
+    entries_[fd] = e;
+  }
+
+  void fdselector::
+  remove (int fd, bool write)
+  {
+    auto i (entries_.find (fd));
+
+    if (i == entries_.end () || !(write ? i->second.write : i->second.read))
+      throw invalid_argument ("file descriptor is not added");
+
+    entry& e (i->second);
+
+    if (write)
+    {
+      e.write = false;
+      e.write_data = nullptr;
+    }
+    else
+    {
+      e.read = false;
+      e.read_data = nullptr;
+    }
+
+    int r (0);
+
+#ifdef __linux__
+    if (epoll_fd_ != -1 && !e.always_ready)
+    {
+      epoll_event ev;
+      ev.events = epoll_events (e.read, e.write);
+      ev.data.fd = fd;
+
+      if (epoll_ctl (epoll_fd_,
+                     e.read || e.write ? EPOLL_CTL_MOD : EPOLL_CTL_DEL,
+                     fd,
+                     &ev) == -1)
+        r = errno;
+    }
+#endif
+
+    // Note that we remove the descriptor from the set even if the above
+    // failed, so that a descriptor which has been closed prematurely (and
+    // thus already dropped by epoll) can still be removed.
+    //
+    if (!e.read && !e.write)
+    {
+      if (e.always_ready)
+        --always_ready_;
+
+      entries_.erase (i);
+    }
+
+    if (r != 0)
+      throw_system_ios_failure (r);
+  }
+
+  pair<size_t, size_t> fdselector::
+  wait (const chrono::milliseconds* timeout)
+  {
+    if (entries_.empty ())
+      throw invalid_argument ("empty file descriptor set");
+
+    read_ready_.clear ();
+    write_ready_.clear ();
+
+    auto ready = [this] (int fd, const entry& e, bool read, bool write)
+    {
+      if (read && e.read)
+      {
+        read_ready_.push_back (fdselect_state (fd, e.read_data));
+        read_ready_.back ().ready = true;
+      }
+
+      if (write && e.write)
+      {
+        write_ready_.push_back (fdselect_state (fd, e.write_data));
+        write_ready_.back ().ready = true;
+      }
+    };
+
+#ifdef __linux__
+    if (epoll_fd_ != -1)
+    {
+      using namespace chrono;
+
+      // If there are always ready descriptors, then just poll the rest.
+      //
+      const milliseconds zero (0);
+      if (always_ready_ != 0)
+        timeout = &zero;
+
+      // Note that while there can be more ready descriptors than we can fit
+      // into the array, they will be reported by the subsequent call.
+      //
+      epoll_event evs[64];
+
+      timestamp now;
+      timestamp deadline;
+
+      if (timeout)
+      {
+        now = system_clock::now ();
+        deadline = now + *timeout;
+      }
+
+      int r;
+      for (;;)
+      {
+        int t (-1);
+
+        if (timeout)
+        {
+          // See poll() for details.
+          //
+          t = now < deadline
+              ? static_cast<int> (
+                  (duration_cast<microseconds> (deadline - now).count () +
+                   999) / 1000)
+              : 0;
+        }
+
+        r = epoll_wait (epoll_fd_, evs, 64, t);
+
+        if (r == -1)
+        {
+          if (errno == EINTR)
+          {
+            if (timeout)
+              now = system_clock::now ();
+
+            continue;
+          }
+
+          throw_system_ios_failure (errno);
+        }
+
+        break;
+      }
+
+      for (int i (0); i != r; ++i)
+      {
+        const epoll_event& ev (evs[i]);
+        uint32_t e (ev.events);
+
+        auto j (entries_.find (ev.data.fd));
+        assert (j != entries_.end ());
+
+        // Treat the error and hangup conditions as readiness (see fdselect()
+        // for details).
+        //
+        bool f ((e & (EPOLLERR | EPOLLHUP)) != 0);
+
+        ready (j->first,
+               j->second,
+               f || (e & EPOLLIN) != 0,
+               f || (e & EPOLLOUT) != 0);
+      }
+
+      if (always_ready_ != 0)
+      {
+        for (const auto& p: entries_)
+        {
+          if (p.second.always_ready)
+            ready (p.first, p.second, true, true);
+        }
+      }
+
+      return make_pair (read_ready_.size (), write_ready_.size ());
+    }
+#endif
+
+    // Fallback to fdselect().
+    //
+    fdselect_set rds;
+    fdselect_set wds;
+
+    for (const auto& p: entries_)
+    {
+      if (p.second.read)
+        rds.push_back (fdselect_state (p.first, p.second.read_data));
+
+      if (p.second.write)
+        wds.push_back (fdselect_state (p.first, p.second.write_data));
+    }
+
+    fdselect (rds, wds, timeout);
+
+    for (const fdselect_state& s: rds)
+    {
+      if (s.ready)
+        read_ready_.push_back (s);
+    }
+
+    for (const fdselect_state& s: wds)
+    {
+      if (s.ready)
+        write_ready_.push_back (s);
+    }
+
+    return make_pair (read_ready_.size (), write_ready_.size ());
+  }
 }
@@ -7,9 +7,12 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <unordered_map>
 #include <istream>
 #include <ostream>
+#include <memory>  // unique_ptr
 #include <utility> // move(), pair
+#include <initializer_list>
 #include <cstdint> // uint16_t, uint64_t
 #include <cstddef> // size_t
 
@@ -101,6 +104,14 @@ namespace butl
     return !(x == y);
   }
 
+  // Data chunk for the scatter-gather output (see ofdstream::write_iov()).
+  //
+  struct fdstream_iov
+  {
+    const void* data;
+    std::size_t size;
+  };
+
   // An [io]fstream that can be initialized with a file descriptor in addition
   // to a file name and that also by default enables exceptions on badbit and
   // failbit. So instead of a dance like this:
@@ -133,12 +144,18 @@ namespace butl
   //   constructor for istream/ostream in GCC 4.9)
   // - passing to constructor auto_fd with a negative file descriptor is valid
   //   and results in the creation of an unopened object
+  // - the buffer is allocated on the heap when the stream is first opened
+  //   and its size can be changed per stream (see fdstreambuf::bufsize())
+  //
+  // - regular files can be memory-mapped for reading, in which case the
+  //   file is exposed in place as the get area (see fdstreambuf::mmap())
   //
   class LIBBUTL_SYMEXPORT fdstreambuf: public bufstreambuf
   {
   public:
-    // Reasonable (for stack allocation) buffer size that provides decent
-    // performance.
+    // Default buffer size that provides decent performance for the general
+    // use. Bulk transfers may benefit from a larger buffer (say, 1MB) while
+    // short-lived control pipes can get away with a much smaller one.
     //
     static const std::size_t buffer_size = 8192;
 
@@ -147,7 +164,12 @@ namespace butl
     // Unless specified, the current read/write position is assumed to
     // be 0 (note: not queried).
     //
-    fdstreambuf (auto_fd&&, std::uint64_t pos = 0);
+    fdstreambuf (auto_fd&&,
+                 std::uint64_t pos = 0,
+                 std::size_t bufsize = buffer_size);
+
+    virtual
+    ~fdstreambuf ();
 
     // Before we invented auto_fd into fdstreams we keept fdstreambuf opened
     // on faulty close attempt. Now fdstreambuf is always closed by close()
@@ -156,8 +178,11 @@ namespace butl
     // once.
     //
     void
-    close () {fd_.close ();}
+    close () {unmap (); fd_.close ();}
 
+    // Note that the unread data in the get area is discarded if the file is
+    // memory-mapped.
+    //
     auto_fd
     release ();
 
@@ -182,6 +207,53 @@ namespace butl
     bool
     blocking () const {return !non_blocking_;}
 
+    // Return the buffer size.
+    //
+    std::size_t
+    bufsize () const {return bufsize_;}
+
+    // Change the buffer size, which must not be zero. If the stream is open,
+    // then reallocate the buffer preserving the unread input or unflushed
+    // output data and throw ios::failure (EINVAL) if this data doesn't fit
+    // the new buffer.
+    //
+    void
+    bufsize (std::size_t);
+
+    // Map the regular file, opened for reading, into memory and expose it,
+    // starting from the current position, as the get area, so that it can
+    // be scanned in place without any copying or read() calls. Return false
+    // if the file cannot be mapped (not a regular file, empty file,
+    // unsupported by the platform or filesystem, etc), in which case the
+    // regular buffered reading is used. Throw ios::failure on the underlying
+    // OS error.
+    //
+    // Note that a large file is exposed in windows of up to 1GB, one at a
+    // time, since the streambuf interface operates with int offsets.
+    //
+    // Also note that the file content changes made after the mapping may or
+    // may not be visible in the stream and the data appended to the file is
+    // not visible at all. More importantly, if the file is truncated while
+    // mapped, then accessing the data past its new end results in the
+    // SIGBUS signal which, unless handled, terminates the process. Thus,
+    // this mode should only be used for files that are not expected to be
+    // truncated concurrently or in processes for which being terminated in
+    // this case is acceptable.
+    //
+    bool
+    mmap ();
+
+    bool
+    mapped () const {return map_ != nullptr;}
+
+    // Set the maximum size of the window in which the memory-mapped file is
+    // exposed (1GB by default) returning the previous value. Throw
+    // std::invalid_argument if the size is zero or exceeds the default. This
+    // is primarily useful for testing.
+    //
+    static std::size_t
+    map_window (std::size_t);
+
   public:
     using base = bufstreambuf;
 
@@ -227,6 +299,16 @@ namespace butl
     virtual std::streamsize
     xsputn (const char_type*, std::streamsize);
 
+    // Write the data chunks as if by calling xsputn() for each of them.
+    // Buffer the chunks if they all fit into the buffer and otherwise write
+    // the buffered data followed by the chunks with as few system calls as
+    // possible (using writev() on POSIX), without copying. Unlike xsputn(),
+    // always write all the data, throwing ios::failure on the underlying OS
+    // error.
+    //
+    void
+    xsputv (const fdstream_iov*, std::size_t);
+
     // Return the (logical) position of the next byte to be written.
     //
     using base::tellp;
@@ -244,9 +326,15 @@ namespace butl
     bool
     save ();
 
+    void
+    unmap () noexcept;
+
   private:
     auto_fd fd_;
-    char buf_[buffer_size];
+    std::unique_ptr<char[]> buf_;
+    std::size_t bufsize_ = buffer_size;
+    char* map_ = nullptr;
+    std::size_t map_size_ = 0;
     bool non_blocking_ = false;
   };
 
@@ -273,6 +361,12 @@ namespace butl
   // in the non-blocking mode and result in the badbit being set (note that
   // it is not the more appropriate failbit for implementation reasons).
   //
+  // The mmap flag instructs ifdstream to memory-map the file for reading, if
+  // possible, falling back to the regular buffered reading for pipes,
+  // terminals, and other non-mappable files. Note that this mode is unsafe
+  // for files that can be truncated concurrently (see fdstreambuf::mmap()
+  // for details). It is ignored by ofdstream.
+  //
   enum class fdstream_mode: std::uint16_t
   {
     text         = 0x01,
@@ -280,6 +374,7 @@ namespace butl
     skip         = 0x04,
     blocking     = 0x08,
     non_blocking = 0x10,
+    mmap         = 0x20,
 
     none = 0
   };
@@ -315,8 +410,15 @@ namespace butl
   {
   protected:
     fdstream_base () = default;
-    fdstream_base (auto_fd&&, std::uint64_t pos);
-    fdstream_base (auto_fd&&, fdstream_mode, std::uint64_t pos);
+
+    fdstream_base (auto_fd&&,
+                   std::uint64_t pos,
+                   std::size_t bufsize = fdstreambuf::buffer_size);
+
+    fdstream_base (auto_fd&&,
+                   fdstream_mode,
+                   std::uint64_t pos,
+                   std::size_t bufsize = fdstreambuf::buffer_size);
 
   public:
     int
@@ -325,6 +427,15 @@ namespace butl
     bool
     blocking () const {return buf_.blocking ();}
 
+    // Get/change the stream buffer size (see fdstreambuf::bufsize() for
+    // details).
+    //
+    std::size_t
+    bufsize () const {return buf_.bufsize ();}
+
+    void
+    bufsize (std::size_t n) {buf_.bufsize (n);}
+
   protected:
     fdstreambuf buf_;
   };
@@ -348,6 +459,11 @@ namespace butl
   // Passing auto_fd with a negative file descriptor is valid and results in
   // the creation of an unopened object.
   //
+  // iofdstream constructors that take fdstream_mode or fdopen_mode as an
+  // argument also allow to specify the stream buffer size. For example:
+  //
+  // ifdstream is (f, fdopen_mode::binary, badbit, 1024 * 1024);
+  //
   // Also note that open() and close() functions can be successfully called
   // for an opened and unopened objects respectively. That is in contrast with
   // iofstream that sets failbit in such cases.
@@ -430,7 +546,8 @@ namespace butl
     ifdstream (auto_fd&&,
                fdstream_mode m,
                iostate = badbit | failbit,
-               std::uint64_t pos = 0);
+               std::uint64_t pos = 0,
+               std::size_t bufsize = fdstreambuf::buffer_size);
 
     explicit
     ifdstream (const char*,
@@ -462,15 +579,18 @@ namespace butl
 
     ifdstream (const char*,
                fdopen_mode,
-               iostate = badbit | failbit);
+               iostate = badbit | failbit,
+               std::size_t bufsize = fdstreambuf::buffer_size);
 
     ifdstream (const std::string&,
                fdopen_mode,
-               iostate = badbit | failbit);
+               iostate = badbit | failbit,
+               std::size_t bufsize = fdstreambuf::buffer_size);
 
     ifdstream (const path&,
                fdopen_mode,
-               iostate = badbit | failbit);
+               iostate = badbit | failbit,
+               std::size_t bufsize = fdstreambuf::buffer_size);
 
     ~ifdstream () override;
 
@@ -545,7 +665,8 @@ namespace butl
     ofdstream (auto_fd&&,
                fdstream_mode m,
                iostate = badbit | failbit,
-               std::uint64_t pos = 0);
+               std::uint64_t pos = 0,
+               std::size_t bufsize = fdstreambuf::buffer_size);
 
     explicit
     ofdstream (const char*,
@@ -577,15 +698,18 @@ namespace butl
 
     ofdstream (const char*,
                fdopen_mode,
-               iostate = badbit | failbit);
+               iostate = badbit | failbit,
+               std::size_t bufsize = fdstreambuf::buffer_size);
 
     ofdstream (const std::string&,
                fdopen_mode,
-               iostate = badbit | failbit);
+               iostate = badbit | failbit,
+               std::size_t bufsize = fdstreambuf::buffer_size);
 
     ofdstream (const path&,
                fdopen_mode,
-               iostate = badbit | failbit);
+               iostate = badbit | failbit,
+               std::size_t bufsize = fdstreambuf::buffer_size);
 
     ~ofdstream () override;
 
@@ -617,6 +741,25 @@ namespace butl
     void close () {if (is_open ()) flush (); buf_.close ();}
     auto_fd release ();
     bool is_open () const {return buf_.is_open ();}
+
+    // Write the pre-built data chunks, as if by calling write() for each of
+    // them but with fewer copying and system calls (see
+    // fdstreambuf::xsputv() for details). For example:
+    //
+    // os.write_iov ({{h.data (), h.size ()}, {b.data (), b.size ()}});
+    //
+    // Note that if the write fails, then the badbit is set, the exception
+    // mask is cleared (there is no way to restore it without the exception
+    // being thrown), and the original exception is rethrown.
+    //
+    ofdstream&
+    write_iov (const fdstream_iov*, std::size_t);
+
+    ofdstream&
+    write_iov (std::initializer_list<fdstream_iov> v)
+    {
+      return write_iov (v.begin (), v.size ());
+    }
   };
 
   // Open a file or, if the file name is `-`, stdin/stdout.
@@ -875,6 +1018,16 @@ namespace butl
   LIBBUTL_SYMEXPORT fdpipe
   fdopen_pipe (fdopen_mode = fdopen_mode::none);
 
+  // Change the capacity of the pipe referred to by the specified descriptor
+  // (either end) to be at least the specified number of bytes and return the
+  // resulting capacity. Return 0 if changing the capacity is not supported
+  // on this platform (currently only supported on Linux). Throw ios::failure
+  // on the underlying OS error (for example, if the size exceeds the
+  // system-wide limit for an unprivileged process; see fcntl(2) for
+  // details).
+  //
+  LIBBUTL_SYMEXPORT std::size_t
+  fdpipe_size (int, std::size_t);
 
   // Create a named pipe (FIFO) at the specified path.
   //
@@ -1006,6 +1159,117 @@ namespace butl
     return fdselect (ifds, ofds, timeout).second;
   }
 
+  // Persistent set of file descriptors to wait on for readiness.
+  //
+  // In contrast to fdselect(), which builds the native descriptor set from
+  // scratch on each call, the descriptors are added and removed
+  // incrementally. On Linux the set is maintained by the kernel (epoll) and
+  // waiting is proportional to the number of ready descriptors rather than
+  // to the total number. On other platforms (or if epoll is unavailable) the
+  // implementation falls back to fdselect().
+  //
+  // Note that a descriptor must be removed before it is closed since the
+  // descriptor number can be reused. Also note that similar to select(),
+  // descriptors that refer to regular files are always ready.
+  //
+  // On Windows only pipes and only their input (read) ends are supported.
+  //
+  class LIBBUTL_SYMEXPORT fdselector
+  {
+  public:
+    // Throw ios::failure on the underlying OS error.
+    //
+    fdselector ();
+    ~fdselector ();
+
+    fdselector (const fdselector&) = delete;
+    fdselector& operator= (const fdselector&) = delete;
+
+    // Start waiting for the descriptor to become ready for input (reading)
+    // or output (writing), associating arbitrary data with it. Throw
+    // std::invalid_argument if the descriptor is invalid or is already added
+    // for this direction. Throw ios::failure on the underlying OS error.
+    //
+    void
+    add_read (int fd, void* data = nullptr) {add (fd, false, data);}
+
+    void
+    add_write (int fd, void* data = nullptr) {add (fd, true, data);}
+
+    // Stop waiting for the descriptor readiness for input or output. Throw
+    // std::invalid_argument if the descriptor is not added for this
+    // direction. Throw ios::failure on the underlying OS error, in which case
+    // the descriptor is nevertheless removed (this way a descriptor that has
+    // been closed prematurely can still be removed).
+    //
+    void
+    remove_read (int fd) {remove (fd, false);}
+
+    void
+    remove_write (int fd) {remove (fd, true);}
+
+    bool
+    empty () const {return entries_.empty ();}
+
+    // Wait until one or more descriptors become ready for input or output.
+    // Return the pair of numbers of descriptors that are ready and save them
+    // in the respective ready sets (see below). Throw std::invalid_argument
+    // if the set is empty. Throw ios::failure on the underlying OS error.
+    //
+    // Note that the ready sets are cleared on each call.
+    //
+    std::pair<std::size_t, std::size_t>
+    wait () {return wait (nullptr);}
+
+    // As above but wait up to the specified timeout returning a pair of
+    // zeroes if none of the descriptors became ready.
+    //
+    template <typename R, typename P>
+    std::pair<std::size_t, std::size_t>
+    wait (const std::chrono::duration<R, P>& timeout)
+    {
+      using namespace std::chrono;
+      milliseconds t (duration_cast<milliseconds> (timeout));
+      return wait (&t);
+    }
+
+    // The descriptors (with the ready flag set) that became ready during the
+    // last wait() call, in an unspecified order.
+    //
+    const fdselect_set&
+    read_ready () const {return read_ready_;}
+
+    const fdselect_set&
+    write_ready () const {return write_ready_;}
+
+  private:
+    void
+    add (int fd, bool write, void* data);
+
+    void
+    remove (int fd, bool write);
+
+    std::pair<std::size_t, std::size_t>
+    wait (const std::chrono::milliseconds*);
+
+    struct entry
+    {
+      bool read = false;
+      bool write = false;
+      bool always_ready = false; // Not supported by epoll (regular file).
+      void* read_data = nullptr;
+      void* write_data = nullptr;
+    };
+
+    std::unordered_map<int, entry> entries_;
+    std::size_t always_ready_ = 0; // Number of always ready entries.
+
+    fdselect_set read_ready_;
+    fdselect_set write_ready_;
+
+    int epoll_fd_ = -1; // -1 if fdselect() is used.
+  };
+
   // POSIX read() function wrapper. Note that it does not translate errors
   // to exceptions, instead leaving them in errno.
   //
@@ -1021,6 +1285,20 @@ namespace butl
   //
   LIBBUTL_SYMEXPORT std::streamsize
   fdwrite (int, const void*, std::size_t) noexcept;
+
+  // Copy the data from the input descriptor (starting from its current
+  // position) to the output descriptor until the end of input, in kernel,
+  // without passing it through the user space buffers. Return false if this
+  // is not supported for the specified descriptors, in which case nothing is
+  // copied and the caller should fall back to the buffered copying. Throw
+  // ios::failure on the underlying OS error.
+  //
+  // Currently only supported on Linux for descriptors in the blocking mode
+  // if either of them is a pipe (via splice(2)) or the input is a regular
+  // file (via sendfile(2)).
+  //
+  LIBBUTL_SYMEXPORT bool
+  fdsplice (int in, int out);
 }
 
 #include <libbutl/fdstream.ixx>
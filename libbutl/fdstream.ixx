@@ -32,8 +32,11 @@ namespace butl
   // fdstreambuf
   //
   inline fdstreambuf::
-  fdstreambuf (auto_fd&& fd, std::uint64_t pos)
+  fdstreambuf (auto_fd&& fd, std::uint64_t pos, std::size_t bufsize)
+      : bufsize_ (bufsize)
   {
+    assert (bufsize != 0);
+
     if (fd.get () >= 0)
       open (std::move (fd), pos);
   }
@@ -41,14 +44,15 @@ namespace butl
   inline auto_fd fdstreambuf::
   release ()
   {
+    unmap ();
     return std::move (fd_);
   }
 
   // fdstream_base
   //
   inline fdstream_base::
-  fdstream_base (auto_fd&& fd, std::uint64_t pos)
-      : buf_ (std::move (fd), pos)
+  fdstream_base (auto_fd&& fd, std::uint64_t pos, std::size_t bufsize)
+      : buf_ (std::move (fd), pos, bufsize)
   {
   }
 
@@ -69,13 +73,20 @@ namespace butl
   }
 
   inline ifdstream::
-  ifdstream (auto_fd&& fd, fdstream_mode m, iostate e, std::uint64_t pos)
-      : fdstream_base (std::move (fd), m, pos),
+  ifdstream (auto_fd&& fd,
+             fdstream_mode m,
+             iostate e,
+             std::uint64_t pos,
+             std::size_t bufsize)
+      : fdstream_base (std::move (fd), m, pos, bufsize),
         std::istream (&buf_),
         skip_ ((m & fdstream_mode::skip) == fdstream_mode::skip)
   {
     assert (e & badbit);
     exceptions (e);
+
+    if ((m & fdstream_mode::mmap) == fdstream_mode::mmap && is_open ())
+      buf_.mmap ();
   }
 
   inline ifdstream::
@@ -91,14 +102,17 @@ namespace butl
   }
 
   inline ifdstream::
-  ifdstream (const std::string& f, fdopen_mode m, iostate e)
-      : ifdstream (f.c_str (), m, e)
+  ifdstream (const std::string& f,
+             fdopen_mode m,
+             iostate e,
+             std::size_t bufsize)
+      : ifdstream (f.c_str (), m, e, bufsize)
   {
   }
 
   inline ifdstream::
-  ifdstream (const path& f, fdopen_mode m, iostate e)
-      : ifdstream (f.string (), m, e)
+  ifdstream (const path& f, fdopen_mode m, iostate e, std::size_t bufsize)
+      : ifdstream (f.string (), m, e, bufsize)
   {
   }
 
@@ -191,8 +205,12 @@ namespace butl
   }
 
   inline ofdstream::
-  ofdstream (auto_fd&& fd, fdstream_mode m, iostate e, std::uint64_t pos)
-      : fdstream_base (std::move (fd), m, pos), std::ostream (&buf_)
+  ofdstream (auto_fd&& fd,
+             fdstream_mode m,
+             iostate e,
+             std::uint64_t pos,
+             std::size_t bufsize)
+      : fdstream_base (std::move (fd), m, pos, bufsize), std::ostream (&buf_)
   {
     assert (e & badbit);
     exceptions (e);
@@ -211,14 +229,17 @@ namespace butl
   }
 
   inline ofdstream::
-  ofdstream (const std::string& f, fdopen_mode m, iostate e)
-      : ofdstream (f.c_str (), m, e)
+  ofdstream (const std::string& f,
+             fdopen_mode m,
+             iostate e,
+             std::size_t bufsize)
+      : ofdstream (f.c_str (), m, e, bufsize)
   {
   }
 
   inline ofdstream::
-  ofdstream (const path& f, fdopen_mode m, iostate e)
-      : ofdstream (f.string (), m, e)
+  ofdstream (const path& f, fdopen_mode m, iostate e, std::size_t bufsize)
+      : ofdstream (f.string (), m, e, bufsize)
   {
   }
 
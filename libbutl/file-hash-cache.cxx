@@ -0,0 +1,514 @@
+// file      : libbutl/file-hash-cache.cxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#include <libbutl/file-hash-cache.hxx>
+
+#ifndef _WIN32
+#  include <errno.h>     // errno, E*
+#  include <fcntl.h>     // posix_fallocate()
+#  include <unistd.h>    // pread(), pwrite(), ftruncate()
+#  include <sys/file.h>  // flock()
+#  include <sys/mman.h>  // mmap(), munmap()
+#  include <sys/stat.h>  // fstat(), S_ISREG()
+#endif
+
+#include <chrono>
+#include <limits>      // numeric_limits
+#include <cstddef>     // offsetof()
+#include <cstring>     // memcmp(), memcpy(), memset()
+#include <stdexcept>   // invalid_argument
+#include <algorithm>   // max(), min()
+#include <type_traits> // is_standard_layout
+
+#include <libbutl/xxh3.hxx>
+#include <libbutl/xxh64.hxx>
+#include <libbutl/sha256.hxx>
+#include <libbutl/utility.hxx> // throw_generic_ios_failure()
+
+using namespace std;
+
+namespace butl
+{
+#ifndef _WIN32
+  // The cache file consists of the header followed by the entries (see
+  // file_hash_cache for the overall design). The data is stored in the host
+  // byte order, so the cache file is not portable (the version check will
+  // most likely fail, causing the file to be reinitialized).
+  //
+  struct cache_header
+  {
+    char          magic[8];
+    uint32_t      version;
+    uint32_t      entry_size;
+    uint64_t      capacity;
+    unsigned char reserved[40];
+  };
+
+  struct cache_entry
+  {
+    // Key.
+    //
+    uint64_t      dev;
+    uint64_t      ino;
+    uint8_t       algorithm;
+    uint8_t       flags;          // 0x01 - file is read in the binary mode.
+    unsigned char reserved[6];
+
+    // Metadata.
+    //
+    uint64_t      size;
+    int64_t       mtime;          // Nanoseconds since epoch.
+    int64_t       ctime;          // Nanoseconds since epoch.
+
+    unsigned char digest[32];
+    uint64_t      check;          // XXH64 of the above.
+  };
+
+  static_assert (sizeof (cache_header) == 64 &&
+                 sizeof (cache_entry) == 88 &&
+                 is_standard_layout<cache_entry>::value,
+                 "unexpected file hash cache layout");
+
+  static const char cache_magic[8] = {'b', 'u', 't', 'l',
+                                      'f', 'h', 'c', '\0'};
+
+  static const uint32_t cache_version = 1;
+
+  // Number of entries to probe starting from the one the key maps to.
+  //
+  static const uint64_t cache_probe = 8;
+
+  static inline uint64_t
+  entry_check (const cache_entry& e)
+  {
+    return xxh64::hash (&e, offsetof (cache_entry, check));
+  }
+
+  static inline bool
+  entry_valid (const cache_entry& e)
+  {
+    return e.check == entry_check (e);
+  }
+
+  static inline bool
+  same_key (const cache_entry& x, const cache_entry& y)
+  {
+    return x.dev       == y.dev       &&
+           x.ino       == y.ino       &&
+           x.algorithm == y.algorithm &&
+           x.flags     == y.flags;
+  }
+
+  static inline bool
+  same_metadata (const cache_entry& x, const cache_entry& y)
+  {
+    return x.size  == y.size  &&
+           x.mtime == y.mtime &&
+           x.ctime == y.ctime;
+  }
+
+  // Return the index of the entry the key maps to.
+  //
+  static inline uint64_t
+  entry_home (const cache_entry& k, uint64_t capacity)
+  {
+    return xxh64::hash (&k, offsetof (cache_entry, size)) % capacity;
+  }
+
+  // Figuring out whether we have the nanoseconds in struct stat (see
+  // filesystem.cxx for details).
+  //
+  template <typename S>
+  static inline constexpr auto
+  mnsec (const S* s, bool) -> decltype(s->st_mtim.tv_nsec)
+  {
+    return s->st_mtim.tv_nsec; // POSIX (GNU/Linux, Solaris).
+  }
+
+  template <typename S>
+  static inline constexpr auto
+  mnsec (const S* s, int) -> decltype(s->st_mtimespec.tv_nsec)
+  {
+    return s->st_mtimespec.tv_nsec; // *BSD, MacOS.
+  }
+
+  template <typename S>
+  static inline constexpr auto
+  mnsec (const S* s, float) -> decltype(s->st_mtime_n)
+  {
+    return s->st_mtime_n; // AIX 5.2 and later.
+  }
+
+  template <typename S>
+  static inline constexpr auto
+  cnsec (const S* s, bool) -> decltype(s->st_ctim.tv_nsec)
+  {
+    return s->st_ctim.tv_nsec;
+  }
+
+  template <typename S>
+  static inline constexpr auto
+  cnsec (const S* s, int) -> decltype(s->st_ctimespec.tv_nsec)
+  {
+    return s->st_ctimespec.tv_nsec;
+  }
+
+  template <typename S>
+  static inline constexpr auto
+  cnsec (const S* s, float) -> decltype(s->st_ctime_n)
+  {
+    return s->st_ctime_n;
+  }
+
+  // Fill the entry key and metadata from the file status. Return false if
+  // the file is not a regular file and so cannot be cached.
+  //
+  static bool
+  file_metadata (int fd, cache_entry& e)
+  {
+    struct stat s;
+    if (fstat (fd, &s) != 0)
+      throw_generic_ios_failure (errno);
+
+    e.dev   = static_cast<uint64_t> (s.st_dev);
+    e.ino   = static_cast<uint64_t> (s.st_ino);
+    e.size  = static_cast<uint64_t> (s.st_size);
+    e.mtime = static_cast<int64_t> (s.st_mtime) * 1000000000 +
+              mnsec<struct stat> (&s, true);
+    e.ctime = static_cast<int64_t> (s.st_ctime) * 1000000000 +
+              cnsec<struct stat> (&s, true);
+
+    return S_ISREG (s.st_mode);
+  }
+
+  // Hold the file lock for the duration of the scope.
+  //
+  namespace
+  {
+    class file_lock
+    {
+    public:
+      file_lock (int fd, bool exclusive)
+          : fd_ (fd)
+      {
+        while (flock (fd, exclusive ? LOCK_EX : LOCK_SH) != 0)
+        {
+          if (errno != EINTR)
+            throw_generic_ios_failure (errno);
+        }
+      }
+
+      ~file_lock ()
+      {
+        flock (fd_, LOCK_UN);
+      }
+
+      file_lock (const file_lock&) = delete;
+      file_lock& operator= (const file_lock&) = delete;
+
+    private:
+      int fd_;
+    };
+  }
+#endif
+
+  file_hash_cache::
+  file_hash_cache (const path& f, size_t capacity)
+  {
+#ifndef _WIN32
+    fd_ = fdopen (f,
+                  fdopen_mode::in | fdopen_mode::out | fdopen_mode::create);
+
+    int fd (fd_.get ());
+
+    // Validate or (re)initialize the cache file while holding the exclusive
+    // lock so that we don't race with other processes doing the same.
+    //
+    file_lock l (fd, true /* exclusive */);
+
+    struct stat s;
+    if (fstat (fd, &s) != 0)
+      throw_generic_ios_failure (errno);
+
+    const uint64_t hn (sizeof (cache_header));
+    const uint64_t en (sizeof (cache_entry));
+    const uint64_t max_capacity ((numeric_limits<size_t>::max () - hn) / en);
+
+    uint64_t n (static_cast<uint64_t> (s.st_size));
+
+    // Only (re)initialize the file if it is empty or is a cache file,
+    // potentially created by an incompatible version. Otherwise, it is
+    // likely some other file specified by mistake which we must not
+    // overwrite.
+    //
+    if (!S_ISREG (s.st_mode))
+      throw invalid_argument ("not a cache file");
+
+    cache_header h;
+    bool valid (false);
+
+    if (n != 0)
+    {
+      ssize_t r;
+      while ((r = pread (fd, &h, sizeof (h), 0)) == -1 && errno == EINTR) ;
+
+      if (r == -1)
+        throw_generic_ios_failure (errno);
+
+      if (static_cast<size_t> (r) < sizeof (h.magic) ||
+          memcmp (h.magic, cache_magic, sizeof (h.magic)) != 0)
+        throw invalid_argument ("not a cache file");
+
+      valid = r == sizeof (h)            &&
+              h.version == cache_version &&
+              h.entry_size == en         &&
+              h.capacity != 0            &&
+              h.capacity <= max_capacity &&
+              n == hn + h.capacity * en;
+    }
+
+    if (valid)
+    {
+      capacity_ = h.capacity;
+    }
+    else
+    {
+      // First write the header that only contains the magic, so that if we
+      // fail or crash half way through, the file is reinitialized on the
+      // next open rather than considered not a cache file.
+      //
+      memset (&h, 0, sizeof (h));
+      memcpy (h.magic, cache_magic, sizeof (h.magic));
+
+      ssize_t r;
+      while ((r = pwrite (fd, &h, sizeof (h), 0)) == -1 && errno == EINTR) ;
+
+      if (r == -1)
+        throw_generic_ios_failure (errno);
+
+      if (r != sizeof (h))
+        throw_generic_ios_failure (EIO);
+
+      // Note that we never shrink the file not to pull it from under
+      // someone else who may still have it mapped.
+      //
+      capacity_ = min<uint64_t> (max<uint64_t> (capacity, 1), max_capacity);
+
+      if (n > hn)
+        capacity_ = max (capacity_, (n - hn + en - 1) / en);
+
+      off_t sz (static_cast<off_t> (hn + capacity_ * en));
+
+      // Allocate the disk space for the whole file rather than just extend
+      // it, since on a full filesystem writing via the shared mapping into
+      // a hole results in SIGBUS rather than in an error. Fall back to
+      // extending the file if unsupported by the platform or filesystem.
+      //
+      bool ext (true);
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__)
+      int e;
+      while ((e = posix_fallocate (fd, 0, sz)) == EINTR) ;
+
+      if (e == 0)
+        ext = false;
+      else if (e != EINVAL && e != EOPNOTSUPP && e != ENOSYS)
+        throw_generic_ios_failure (e);
+#endif
+
+      if (ext && ftruncate (fd, sz) != 0)
+        throw_generic_ios_failure (errno);
+    }
+
+    map_size_ = static_cast<size_t> (hn + capacity_ * en);
+
+    void* m (::mmap (nullptr,
+                     map_size_,
+                     PROT_READ | PROT_WRITE,
+                     MAP_SHARED,
+                     fd,
+                     0));
+
+    if (m == MAP_FAILED)
+      throw_generic_ios_failure (errno);
+
+    map_ = m;
+
+    if (!valid)
+    {
+      // Clear the entries and only then write the complete header.
+      //
+      memset (static_cast<char*> (map_) + hn, 0, map_size_ - hn);
+
+      h.version = cache_version;
+      h.entry_size = static_cast<uint32_t> (en);
+      h.capacity = capacity_;
+
+      memcpy (map_, &h, sizeof (h));
+    }
+#else
+    // Not supported on Windows (see the class description).
+    //
+    (void) f;
+    (void) capacity;
+#endif
+  }
+
+  file_hash_cache::
+  ~file_hash_cache ()
+  {
+#ifndef _WIN32
+    if (map_ != nullptr)
+      munmap (map_, map_size_);
+#endif
+  }
+
+  static const char hex_map[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+    'a', 'b', 'c', 'd', 'e', 'f'};
+
+  string file_hash_cache::
+  checksum (const path& f, algorithm a, fdopen_mode m)
+  {
+    size_t dn (a == algorithm::sha256 ? 32 : 8);
+
+    auto hex = [dn] (const unsigned char* d)
+    {
+      string r (dn * 2, '\0');
+      for (size_t i (0); i != dn; ++i)
+      {
+        r[i * 2]     = hex_map[d[i] >> 4];
+        r[i * 2 + 1] = hex_map[d[i] & 0x0f];
+      }
+      return r;
+    };
+
+    auto_fd fd (fdopen (f, m | fdopen_mode::in));
+
+#ifndef _WIN32
+    using namespace chrono;
+
+    // Note that we take the current time before obtaining the file metadata
+    // (see below for details).
+    //
+    int64_t now (duration_cast<nanoseconds> (
+                   system_clock::now ().time_since_epoch ()).count ());
+
+    cache_entry k {};
+    k.algorithm = static_cast<uint8_t> (a);
+    k.flags = (m & fdopen_mode::binary) == fdopen_mode::binary ? 0x01 : 0x00;
+
+    bool cache (file_metadata (fd.get (), k));
+
+    if (cache)
+    {
+      file_lock l (fd_.get (), false /* exclusive */);
+
+      cache_entry* es (
+        reinterpret_cast<cache_entry*> (
+          static_cast<char*> (map_) + sizeof (cache_header)));
+
+      uint64_t h (entry_home (k, capacity_));
+
+      for (uint64_t i (0); i != min (cache_probe, capacity_); ++i)
+      {
+        cache_entry e (es[(h + i) % capacity_]);
+
+        if (entry_valid (e) && same_key (e, k))
+        {
+          if (same_metadata (e, k))
+          {
+            ++hits_;
+            return hex (e.digest);
+          }
+
+          break;
+        }
+      }
+    }
+#endif
+
+    ++misses_;
+
+    // Hash the file.
+    //
+    // Note that we don't memory-map the file since it can be truncated by
+    // some other process while being hashed, which would result in SIGBUS
+    // rather than in an I/O error (see fdstreambuf::mmap() for details).
+    //
+    ifdstream is (move (fd));
+
+    unsigned char d[32];
+    switch (a)
+    {
+    case algorithm::sha256:  memcpy (d, sha256 (is).binary (), 32); break;
+    case algorithm::xxh64:   memcpy (d, xxh64 (is).binary (), 8);   break;
+    case algorithm::xxh3_64: memcpy (d, xxh3_64 (is).binary (), 8); break;
+    }
+
+#ifndef _WIN32
+    // Store the checksum unless the file has changed while being hashed or
+    // has been changed too recently, so that a subsequent change may not be
+    // reflected in its times. We assume that the timestamp granularity is
+    // under 100ms unless both times have no sub-second part, in which case
+    // we assume the granularity may be as coarse as 2 seconds (FAT).
+    //
+    if (cache)
+    {
+      cache_entry e {};
+      cache = file_metadata (is.fd (), e) && same_metadata (e, k);
+
+      if (cache)
+      {
+        const int64_t s (1000000000);
+        int64_t w (k.mtime % s == 0 && k.ctime % s == 0 ? 2 * s : s / 10);
+
+        cache = max (k.mtime, k.ctime) + w < now;
+      }
+    }
+
+    if (cache)
+    {
+      memcpy (k.digest, d, dn);
+      k.check = entry_check (k);
+
+      file_lock l (fd_.get (), true /* exclusive */);
+
+      cache_entry* es (
+        reinterpret_cast<cache_entry*> (
+          static_cast<char*> (map_) + sizeof (cache_header)));
+
+      // Overwrite the entry for the same key, if present. Otherwise, use the
+      // first free (or invalid) entry, evicting the one the key maps to if
+      // there are none.
+      //
+      uint64_t h (entry_home (k, capacity_));
+      cache_entry* r (nullptr);
+
+      for (uint64_t i (0); i != min (cache_probe, capacity_); ++i)
+      {
+        cache_entry& e (es[(h + i) % capacity_]);
+
+        if (!entry_valid (e))
+        {
+          if (r == nullptr)
+            r = &e;
+        }
+        else if (same_key (e, k))
+        {
+          r = &e;
+          break;
+        }
+      }
+
+      if (r == nullptr)
+        r = &es[h];
+
+      *r = k;
+    }
+#endif
+
+    is.close ();
+    return hex (d);
+  }
+}
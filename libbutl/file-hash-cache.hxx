@@ -0,0 +1,93 @@
+// file      : libbutl/file-hash-cache.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#pragma once
+
+#include <string>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint64_t
+
+#include <libbutl/path.hxx>
+#include <libbutl/fdstream.hxx> // auto_fd, fdopen_mode
+
+#include <libbutl/export.hxx>
+
+namespace butl
+{
+  // Persistent file checksum cache.
+  //
+  // The cache is stored in a file as a fixed-capacity hash table which is
+  // memory-mapped and shared between processes. The checksums are keyed by
+  // the file identity (device and inode) and the checksum algorithm and are
+  // only returned if the file size as well as modification and status change
+  // times (with nanosecond precision, if available) are the same as when the
+  // checksum was calculated. Otherwise, the file is hashed and the result is
+  // stored, potentially evicting an older entry.
+  //
+  // Using the same cache file from multiple processes is safe: lookups and
+  // updates are performed under a shared and exclusive file lock,
+  // respectively, and every entry is protected with a checksum so that a
+  // partially written entry (for example, due to a crash) is ignored. Note,
+  // however, that an instance should not be used by multiple threads
+  // simultaneously (use an instance per thread instead).
+  //
+  // Since on filesystems with coarse timestamps a file can be modified
+  // without changing its times, the checksum is not stored if the file has
+  // been changed within the last couple of seconds before it was hashed or
+  // while it was being hashed.
+  //
+  // Note that currently the cache is only supported on POSIX systems. On
+  // Windows the files are always hashed.
+  //
+  class LIBBUTL_SYMEXPORT file_hash_cache
+  {
+  public:
+    enum class algorithm: std::uint8_t {sha256 = 1, xxh64, xxh3_64};
+
+    static const std::size_t default_capacity = 16384;
+
+    // Open the cache file, creating it with space for the specified number
+    // of entries if it doesn't exist or is empty, and reinitializing it if
+    // it is a cache file that is not valid (for example, was created by an
+    // incompatible version). The capacity of an existing valid cache file is
+    // preserved. Throw invalid_argument if the file is not empty and is not
+    // a cache file (so that a file specified by mistake is not overwritten)
+    // and ios::failure on the underlying OS error, including if there is not
+    // enough disk space for the file being (re)initialized.
+    //
+    explicit
+    file_hash_cache (const path&, std::size_t capacity = default_capacity);
+
+    ~file_hash_cache ();
+
+    file_hash_cache (const file_hash_cache&) = delete;
+    file_hash_cache& operator= (const file_hash_cache&) = delete;
+
+    // Return the checksum of the file in the string representation (see
+    // sha256::string(), xxh64::string(), etc), retrieving it from the cache,
+    // if possible, and storing it otherwise. The mode argument is the
+    // additional mode the file is opened in (binary or none; see fdopen() for
+    // details). Throw ios::failure if unable to read the file.
+    //
+    std::string
+    checksum (const path&, algorithm, fdopen_mode = fdopen_mode::binary);
+
+    // The number of checksums since the instance creation that were and
+    // were not retrieved from the cache, respectively.
+    //
+    std::size_t
+    hits () const {return hits_;}
+
+    std::size_t
+    misses () const {return misses_;}
+
+  private:
+    auto_fd fd_;
+    void* map_ = nullptr;
+    std::size_t map_size_ = 0;
+    std::uint64_t capacity_ = 0;
+
+    std::size_t hits_ = 0;
+    std::size_t misses_ = 0;
+  };
+}
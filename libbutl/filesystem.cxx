@@ -13,6 +13,14 @@
 #  include <sys/time.h>  // utimes()
 #  include <sys/types.h> // stat
 #  include <sys/stat.h>  // stat(), lstat(), S_I*, mkdir(), chmod()
+#  include <fcntl.h>     // openat(), O_*, AT_*
+
+#  ifdef __linux__
+#    include <linux/fs.h>     // FICLONE
+#    include <sys/ioctl.h>    // ioctl()
+#    include <sys/syscall.h>  // syscall(), SYS_*
+#    include <sys/sendfile.h> // sendfile()
+#  endif
 #else
 #  include <libbutl/win32-utility.hxx>
 
@@ -33,13 +41,28 @@
 #  include <type_traits> // is_same
 #endif
 
+#include <map>
+#include <deque>
+#include <atomic>
 #include <chrono>
 #include <vector>
 #include <memory>       // unique_ptr
+#include <unordered_map>
 #include <cassert>
-#include <algorithm>    // find(), copy()
+#include <algorithm>    // find(), find_if(), copy(), sort(), unique()
+#include <exception>    // exception_ptr, current_exception()
 #include <system_error>
 
+#ifndef LIBBUTL_MINGW_STDTHREAD
+#  include <mutex>
+#  include <thread>
+#  include <condition_variable>
+#else
+#  include <libbutl/mingw-mutex.hxx>
+#  include <libbutl/mingw-thread.hxx>
+#  include <libbutl/mingw-condition_variable.hxx>
+#endif
+
 #include <libbutl/path.hxx>
 #include <libbutl/utility.hxx>      // throw_generic_error()
 #include <libbutl/fdstream.hxx>
@@ -1137,15 +1160,372 @@ namespace butl
     return r;
   }
 
+#ifndef _WIN32
+  struct dir_deleter
+  {
+    void operator() (DIR* p) const {if (p != nullptr) closedir (p);}
+  };
+
+  template <typename D>
+  static inline /*constexpr*/ optional<entry_type>
+  d_type (const D* d, decltype(d->d_type)*)
+  {
+    switch (d->d_type)
+    {
+#ifdef DT_DIR
+    case DT_DIR: return entry_type::directory;
+#endif
+#ifdef DT_REG
+    case DT_REG: return entry_type::regular;
+#endif
+#ifdef DT_LNK
+    case DT_LNK: return entry_type::symlink;
+#endif
+#ifdef DT_BLK
+    case DT_BLK:
+#endif
+#ifdef DT_CHR
+    case DT_CHR:
+#endif
+#ifdef DT_FIFO
+    case DT_FIFO:
+#endif
+#ifdef DT_SOCK
+    case DT_SOCK:
+#endif
+      return entry_type::other;
+
+    default: return nullopt;
+    }
+  }
+
+  template <typename D>
+  static inline constexpr optional<entry_type>
+  d_type (...) {return nullopt;}
+
+  // Recursive directory content removal engine.
+  //
+  // Removes entries relative to the open directory file descriptors (using
+  // openat(), unlinkat(), etc) rather than to the paths, which would need to
+  // be built and resolved by the OS for every entry. The subdirectories are
+  // queued and can be removed by multiple threads concurrently.
+  //
+  // Note that we process the queued subdirectories in the LIFO order, so
+  // that the number of open directories stays close to the tree depth (times
+  // the number of threads) rather than its width.
+  //
+  class rmdir_r_engine
+  {
+  public:
+    rmdir_r_engine (bool ignore_error): ignore_error_ (ignore_error) {}
+
+    void
+    run (const dir_path&, size_t threads);
+
+  private:
+    // A directory being removed. Note that it keeps its parent directory
+    // open (and alive) until it is removed from it.
+    //
+    struct directory
+    {
+      shared_ptr<directory> parent; // NULL for the top directory.
+      string name;                  // Name in the parent directory.
+      DIR* handle = nullptr;        // Open while being removed.
+
+      // Number of subdirectories that are not yet removed plus one while the
+      // directory is being traversed.
+      //
+      atomic<size_t> pending {1};
+
+      directory (shared_ptr<directory> p, string n)
+          : parent (move (p)), name (move (n)) {}
+
+      ~directory () {if (handle != nullptr) closedir (handle);}
+    };
+
+    void
+    work ();
+
+    void
+    traverse (const shared_ptr<directory>&);
+
+    // Remove the directory from its parent and, if that was the last
+    // pending subdirectory, the parent itself, and so on.
+    //
+    void
+    complete (directory*);
+
+    // Record the error unless ignoring errors. Return false if the
+    // removal should be stopped.
+    //
+    bool
+    fail (int);
+
+    bool
+    failed () const {return error_.load (memory_order_relaxed) != 0;}
+
+  private:
+    bool ignore_error_;
+    atomic<int> error_ {0};
+
+    mutex mutex_;
+    condition_variable condv_;
+    vector<shared_ptr<directory>> queue_;
+    size_t active_ = 0; // Number of directories being traversed.
+    bool multi_ = false;
+  };
+
+  bool rmdir_r_engine::
+  fail (int e)
+  {
+    if (ignore_error_)
+      return true;
+
+    int x (0);
+    error_.compare_exchange_strong (x, e);
+
+    if (multi_)
+    {
+      lock_guard<mutex> l (mutex_);
+      condv_.notify_all ();
+    }
+
+    return false;
+  }
+
+  void rmdir_r_engine::
+  complete (directory* d)
+  {
+    for (; d->parent != nullptr; d = d->parent.get ())
+    {
+      closedir (d->handle);
+      d->handle = nullptr;
+
+      directory& p (*d->parent);
+
+      if (unlinkat (dirfd (p.handle), d->name.c_str (), AT_REMOVEDIR) != 0 &&
+          !fail (errno))
+        return;
+
+      if (--p.pending != 0)
+        return;
+    }
+  }
+
+  void rmdir_r_engine::
+  traverse (const shared_ptr<directory>& d)
+  {
+    if (d->handle == nullptr)
+    {
+      const directory& p (*d->parent);
+
+      int fd (openat (dirfd (p.handle),
+                      d->name.c_str (),
+                      O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+
+      if (fd == -1 || (d->handle = fdopendir (fd)) == nullptr)
+      {
+        if (fd != -1)
+          ::close (fd);
+
+        // If ignoring errors, then still account for the directory in its
+        // parent, so that the parent is handled (and fails to be removed)
+        // as usual.
+        //
+        if (fail (errno) && --d->parent->pending == 0)
+          complete (d->parent.get ());
+
+        return;
+      }
+    }
+
+    int fd (dirfd (d->handle));
+
+    for (;;)
+    {
+      if (failed ())
+        return;
+
+      errno = 0;
+      struct dirent* de (readdir (d->handle));
+
+      if (de == nullptr)
+      {
+        if (errno != 0 && !fail (errno))
+          return;
+
+        break;
+      }
+
+      const char* n (de->d_name);
+
+      // Skip '.' and '..'.
+      //
+      if (n[0] == '.' && (n[1] == '\0' || (n[1] == '.' && n[2] == '\0')))
+        continue;
+
+      optional<entry_type> t (d_type<struct dirent> (de, nullptr));
+
+      if (!t)
+      {
+        struct stat s;
+        if (fstatat (fd, n, &s, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+          // Skip the entry if it is already removed.
+          //
+          if (errno != ENOENT && !fail (errno))
+            return;
+
+          continue;
+        }
+
+        t = S_ISDIR (s.st_mode) ? entry_type::directory : entry_type::regular;
+      }
+
+      if (*t == entry_type::directory)
+      {
+        ++d->pending;
+
+        shared_ptr<directory> sd (make_shared<directory> (d, n));
+
+        if (multi_)
+        {
+          lock_guard<mutex> l (mutex_);
+          queue_.push_back (move (sd));
+          condv_.notify_one ();
+        }
+        else
+          queue_.push_back (move (sd));
+      }
+      else if (unlinkat (fd, n, 0) != 0 && errno != ENOENT && !fail (errno))
+        return;
+    }
+
+    if (--d->pending == 0)
+      complete (d.get ());
+  }
+
+  void rmdir_r_engine::
+  work ()
+  {
+    for (;;)
+    {
+      shared_ptr<directory> d;
+
+      if (multi_)
+      {
+        unique_lock<mutex> l (mutex_);
+
+        condv_.wait (l, [this] ()
+                     {
+                       return !queue_.empty () || active_ == 0 || failed ();
+                     });
+
+        if (queue_.empty () || failed ())
+          break;
+
+        d = move (queue_.back ());
+        queue_.pop_back ();
+        ++active_;
+      }
+      else
+      {
+        if (queue_.empty () || failed ())
+          break;
+
+        d = move (queue_.back ());
+        queue_.pop_back ();
+      }
+
+      traverse (d);
+      d = nullptr;
+
+      if (multi_)
+      {
+        lock_guard<mutex> l (mutex_);
+
+        if (--active_ == 0 && queue_.empty ())
+          condv_.notify_all ();
+      }
+    }
+  }
+
+  void rmdir_r_engine::
+  run (const dir_path& p, size_t threads)
+  {
+    // Note that, similar to opendir(), we follow the top directory symlink.
+    //
+    int fd (open (p.string ().c_str (),
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+
+    DIR* h (fd != -1 ? fdopendir (fd) : nullptr);
+
+    if (h == nullptr)
+    {
+      int e (errno);
+
+      if (fd != -1)
+        ::close (fd);
+
+      if (!ignore_error_)
+        throw_generic_error (e);
+
+      return;
+    }
+
+    shared_ptr<directory> top (make_shared<directory> (nullptr, string ()));
+    top->handle = h;
+
+    // Traverse the top directory in this thread and only start the helper
+    // threads if there are some subdirectories to be removed.
+    //
+    traverse (top);
+
+    if (threads == 0)
+      threads = thread::hardware_concurrency ();
+
+    vector<thread> ts;
+
+    if (threads > 1 && queue_.size () != 0 && !failed ())
+    {
+      multi_ = true;
+
+      try
+      {
+        for (size_t i (1); i != threads; ++i)
+          ts.emplace_back ([this] () {work ();});
+      }
+      catch (const system_error&)
+      {
+        // Proceed with whatever threads we have managed to start.
+      }
+    }
+
+    work ();
+
+    for (thread& t: ts)
+      t.join ();
+
+    if (int e = error_.load ())
+      throw_generic_error (e);
+  }
+#endif
+
   void
-  rmdir_r (const dir_path& p, bool dir, bool ignore_error)
+  rmdir_r (const dir_path& p, bool dir, bool ignore_error, size_t threads)
   {
+#ifndef _WIN32
+    rmdir_r_engine (ignore_error).run (p, threads);
+#else
     // An nftw()-based implementation (for platforms that support it)
     // might be a faster way.
     //
     // @@ Get rid of these try/catch clauses when ignore_error flag is
     //    implemented for dir_iterator() constructor.
     //
+    // @@ Spreading the removal across multiple threads is not yet
+    //    implemented.
+    //
     try
     {
       for (const dir_entry& de: dir_iterator (p, dir_iterator::no_follow))
@@ -1153,7 +1533,10 @@ namespace butl
         path ep (p / de.path ()); //@@ Would be good to reuse the buffer.
 
         if (de.ltype () == entry_type::directory)
-          rmdir_r (path_cast<dir_path> (move (ep)), true, ignore_error);
+          rmdir_r (path_cast<dir_path> (move (ep)),
+                   true,
+                   ignore_error,
+                   threads);
         else
           try_rmfile (ep, ignore_error);
       }
@@ -1163,6 +1546,7 @@ namespace butl
       if (!ignore_error)
         throw;
     }
+#endif
 
     if (dir)
     {
@@ -1687,43 +2071,175 @@ namespace butl
     }
   }
 
-  // For I/O operations cpfile() can throw ios_base::failure exception that is
-  // not derived from system_error for old versions of g++ (as of 4.9). From
-  // the other hand cpfile() must throw system_error only. Let's catch
-  // ios_base::failure and rethrow as system_error in such a case.
+#ifdef __linux__
+  // Return true if the error code returned by the kernel-side copying
+  // function (ioctl(FICLONE), copy_file_range(), or sendfile()) indicates
+  // that the operation is not supported for the specified file descriptors.
   //
-  template <bool v>
-  static inline typename enable_if<v>::type
-  cpfile (const path& from, const path& to,
-          cpflags fl,
-          permissions perm,
-          auto_rmfile& rm)
+  static inline bool
+  cpfile_unsupported (int ec)
   {
-    ifdstream ifs (from, fdopen_mode::binary);
+    return ec == ENOSYS     ||
+           ec == ENOTTY     ||
+           ec == EXDEV      ||
+           ec == EINVAL     ||
+           ec == EOPNOTSUPP ||
+           ec == EPERM      ||
+           ec == EBADF      ||
+           ec == ETXTBSY;
+  }
 
-    fdopen_mode om (fdopen_mode::out      |
-                    fdopen_mode::truncate |
-                    fdopen_mode::create   |
-                    fdopen_mode::binary);
+  // Copy the file content in kernel, without passing it through the user
+  // space buffers. Return false if this is not supported for the specified
+  // file descriptors, in which case nothing is copied and the caller should
+  // fall back to the buffered copying. Throw system_error on failure.
+  //
+  // Note that the file offsets of both descriptors are expected to be 0.
+  //
+  static bool
+  cpfile_kernel (int ifd, int ofd, cpflags fl)
+  {
+    bool clone    ((fl & cpflags::reflink)    == cpflags::reflink);
+    bool no_clone ((fl & cpflags::no_reflink) == cpflags::no_reflink);
 
-    if ((fl & cpflags::overwrite_content) != cpflags::overwrite_content)
-      om |= fdopen_mode::exclusive;
+    assert (!clone || !no_clone);
 
-    ofdstream ofs (fdopen (to, om, perm));
+    // Note that some special files (for example, in procfs) report zero size
+    // while having some content which copy_file_range() and sendfile() may
+    // fail to copy. Thus, unless cloning is required, we only copy regular
+    // files in kernel and let the buffered copying deal with the rest. We
+    // also leave to it small files that it copies with a single read/write
+    // pair anyway.
+    //
+    struct stat s;
+    if (fstat (ifd, &s) != 0)
+      throw_generic_error (errno);
 
-    rm = auto_rmfile (to);
+    if (!clone &&
+        (!S_ISREG (s.st_mode) ||
+         static_cast<uint64_t> (s.st_size) < fdstreambuf::buffer_size))
+      return false;
 
-    // Throws ios::failure on fdstreambuf read/write failures.
-    //
-    // Note that the eof check is important: if the stream is at eof (empty
-    // file) then this write will fail.
+    if (!no_clone)
+    {
+#ifdef FICLONE
+      if (ioctl (ofd, FICLONE, ifd) == 0)
+        return true;
+
+      if (clone || !cpfile_unsupported (errno))
+        throw_generic_error (errno);
+#else
+      if (clone)
+        throw_generic_error (EOPNOTSUPP);
+#endif
+    }
+
+    // Copy the content using the specified function that is expected to
+    // behave as read() in regards to the return value and to advance the
+    // file offsets. Return false if the function is not supported and
+    // nothing is copied.
     //
-    if (ifs.peek () != ifdstream::traits_type::eof ())
-      ofs << ifs.rdbuf ();
+    auto copy = [ifd, ofd] (auto f) -> bool
+    {
+      for (bool copied (false);; )
+      {
+        // Note that both functions transfer at most 0x7ffff000 bytes at
+        // once.
+        //
+        ssize_t n (f (ifd, ofd, 0x7ffff000));
 
-    ifs.close (); // Throws ios::failure on failure.
-    ofs.close (); // Throws ios::failure on flush/close failure.
-  }
+        if (n == 0)
+          return true;
+
+        if (n == -1)
+        {
+          if (errno == EINTR)
+            continue;
+
+          if (!copied && cpfile_unsupported (errno))
+            return false;
+
+          throw_generic_error (errno);
+        }
+
+        copied = true;
+      }
+    };
+
+    // Note that copy_file_range() can potentially clone the content on some
+    // filesystems (Btrfs, XFS, NFS, etc) and so we skip it if cloning is
+    // forbidden.
+    //
+#ifdef SYS_copy_file_range
+    if (!no_clone &&
+        copy ([] (int i, int o, size_t n)
+              {
+                return static_cast<ssize_t> (
+                  syscall (SYS_copy_file_range,
+                           i, nullptr, o, nullptr, n, 0U));
+              }))
+      return true;
+#endif
+
+    return copy ([] (int i, int o, size_t n)
+                 {
+                   return sendfile (o, i, nullptr, n);
+                 });
+  }
+#endif
+
+  // For I/O operations cpfile() can throw ios_base::failure exception that is
+  // not derived from system_error for old versions of g++ (as of 4.9). From
+  // the other hand cpfile() must throw system_error only. Let's catch
+  // ios_base::failure and rethrow as system_error in such a case.
+  //
+  template <bool v>
+  static inline typename enable_if<v>::type
+  cpfile (const path& from, const path& to,
+          cpflags fl,
+          permissions perm,
+          auto_rmfile& rm)
+  {
+    auto_fd ifd (fdopen (from, fdopen_mode::in | fdopen_mode::binary));
+
+    fdopen_mode om (fdopen_mode::out      |
+                    fdopen_mode::truncate |
+                    fdopen_mode::create   |
+                    fdopen_mode::binary);
+
+    if ((fl & cpflags::overwrite_content) != cpflags::overwrite_content)
+      om |= fdopen_mode::exclusive;
+
+    auto_fd ofd (fdopen (to, om, perm));
+
+    rm = auto_rmfile (to);
+
+#ifdef __linux__
+    if (cpfile_kernel (ifd.get (), ofd.get (), fl))
+    {
+      ifd.close (); // Throws ios::failure on failure.
+      ofd.close (); // Throws ios::failure on failure.
+      return;
+    }
+#else
+    if ((fl & cpflags::reflink) == cpflags::reflink)
+      throw_generic_error (ENOTSUP);
+#endif
+
+    ifdstream ifs (move (ifd));
+    ofdstream ofs (move (ofd));
+
+    // Throws ios::failure on fdstreambuf read/write failures.
+    //
+    // Note that the eof check is important: if the stream is at eof (empty
+    // file) then this write will fail.
+    //
+    if (ifs.peek () != ifdstream::traits_type::eof ())
+      ofs << ifs.rdbuf ();
+
+    ifs.close (); // Throws ios::failure on failure.
+    ofs.close (); // Throws ios::failure on flush/close failure.
+  }
 
   template <bool v>
   static inline typename enable_if<!v>::type
@@ -1939,6 +2455,36 @@ namespace butl
 
   // dir_entry
   //
+#ifdef __linux__
+  dir_iterator::
+  ~dir_iterator ()
+  {
+    if (h_ != -1)
+      ::close (h_); // Ignore any errors.
+  }
+
+  dir_iterator& dir_iterator::
+  operator= (dir_iterator&& x)
+  {
+    if (this != &x)
+    {
+      e_ = move (x.e_);
+
+      if (h_ != -1 && ::close (h_) == -1)
+        throw_generic_error (errno);
+
+      h_ = x.h_;
+      x.h_ = -1;
+
+      buf_ = move (x.buf_);
+      bn_ = x.bn_;
+      bi_ = x.bi_;
+
+      mode_ = x.mode_;
+    }
+    return *this;
+  }
+#else
   dir_iterator::
   ~dir_iterator ()
   {
@@ -1963,6 +2509,7 @@ namespace butl
     }
     return *this;
   }
+#endif
 
   static inline entry_type
   type (const struct stat& s) noexcept
@@ -2008,11 +2555,53 @@ namespace butl
 
   // dir_iterator
   //
-  struct dir_deleter
+#ifdef __linux__
+  // The getdents64(2) directory entry (the wrapper function and the struct
+  // are only provided by glibc starting from 2.30).
+  //
+  struct linux_dirent64
   {
-    void operator() (DIR* p) const {if (p != nullptr) closedir (p);}
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[1]; // NULL-terminated, variable length.
   };
 
+  // Size of the buffer the directory entries are read into. Note that
+  // readdir() in glibc reads them in the 32K batches.
+  //
+  static const size_t dir_iterator_buffer_size = 64 * 1024;
+
+  dir_iterator::
+  dir_iterator (const dir_path& d, mode m)
+    : mode_ (m)
+  {
+    h_ = open (d.string ().c_str (), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (h_ == -1)
+      throw_generic_error (errno);
+
+    try
+    {
+      buf_.reset (new char[dir_iterator_buffer_size]);
+
+      e_.b_ = d; // Used by next() to detect dangling symlinks.
+
+      next ();
+    }
+    catch (...)
+    {
+      if (h_ != -1)
+      {
+        ::close (h_);
+        h_ = -1;
+      }
+
+      throw;
+    }
+  }
+#else
   dir_iterator::
   dir_iterator (const dir_path& d, mode m)
     : mode_ (m)
@@ -2029,52 +2618,49 @@ namespace butl
 
     h.release ();
   }
-
-  template <typename D>
-  static inline /*constexpr*/ optional<entry_type>
-  d_type (const D* d, decltype(d->d_type)*)
-  {
-    switch (d->d_type)
-    {
-#ifdef DT_DIR
-    case DT_DIR: return entry_type::directory;
-#endif
-#ifdef DT_REG
-    case DT_REG: return entry_type::regular;
-#endif
-#ifdef DT_LNK
-    case DT_LNK: return entry_type::symlink;
-#endif
-#ifdef DT_BLK
-    case DT_BLK:
 #endif
-#ifdef DT_CHR
-    case DT_CHR:
-#endif
-#ifdef DT_FIFO
-    case DT_FIFO:
-#endif
-#ifdef DT_SOCK
-    case DT_SOCK:
-#endif
-      return entry_type::other;
-
-    default: return nullopt;
-    }
-  }
-
-  template <typename D>
-  static inline constexpr optional<entry_type>
-  d_type (...) {return nullopt;}
 
   void dir_iterator::
   next ()
   {
     for (;;)
     {
+#ifdef __linux__
+      // Read the next batch of entries, if the current one is exhausted.
+      //
+      if (bi_ == bn_)
+      {
+        long n (syscall (SYS_getdents64,
+                         h_,
+                         buf_.get (),
+                         dir_iterator_buffer_size));
+
+        if (n == -1)
+          throw_generic_error (errno);
+
+        if (n == 0)
+        {
+          // End of stream.
+          //
+          ::close (h_);
+          h_ = -1;
+          break;
+        }
+
+        bn_ = static_cast<size_t> (n);
+        bi_ = 0;
+      }
+
+      const linux_dirent64* de (
+        reinterpret_cast<const linux_dirent64*> (buf_.get () + bi_));
+
+      bi_ += de->d_reclen;
+      {
+#else
       errno = 0;
       if (struct dirent* de = readdir (h_))
       {
+#endif
         // We can accept some overhead for '.' and '..' (relying on short
         // string optimization) in favor of a more compact code.
         //
@@ -2086,7 +2672,11 @@ namespace butl
           continue;
 
         e_.p_ = move (p);
+#ifdef __linux__
+        e_.t_ = d_type<linux_dirent64> (de, nullptr);
+#else
         e_.t_ = d_type<struct dirent> (de, nullptr);
+#endif
         e_.lt_ = nullopt;
 
         e_.mtime_ = timestamp_unknown;
@@ -2104,13 +2694,33 @@ namespace butl
           // details) and so throw. We, however, need to skip the entry if it
           // is already removed (due to a race) and throw on any other error.
           //
+#ifdef __linux__
+          // Stat the entry relative to the directory file descriptor rather
+          // than making the OS to resolve its full path.
+          //
+          const char* n (de->d_name);
+
+          auto lstat_entry = [this, n] (struct stat& s)
+          {
+            return fstatat (h_, n, &s, AT_SYMLINK_NOFOLLOW);
+          };
+
+          auto stat_entry = [this, n] (struct stat& s)
+          {
+            return fstatat (h_, n, &s, 0);
+          };
+#else
           path fp (e_.base () / e_.path ());
           const char* p (fp.string ().c_str ());
 
+          auto lstat_entry = [p] (struct stat& s) {return lstat (p, &s);};
+          auto stat_entry  = [p] (struct stat& s) {return stat (p, &s);};
+#endif
+
           if (!e_.t_)
           {
             struct stat s;
-            if (lstat (p, &s) != 0)
+            if (lstat_entry (s) != 0)
             {
               // Given that we have already enumerated the filesystem entry,
               // these error codes can only mean that the entry doesn't exist
@@ -2151,7 +2761,7 @@ namespace butl
           if (*e_.t_ == entry_type::symlink)
           {
             struct stat s;
-            if (stat (p, &s) != 0)
+            if (stat_entry (s) != 0)
             {
               if (errno == ENOENT || errno == ENOTDIR || errno == EACCES)
               {
@@ -2180,6 +2790,7 @@ namespace butl
           //        (e_.lt_ && (dd || *e_.lt_ != entry_type::unknown)));
         }
       }
+#ifndef __linux__
       else if (errno == 0)
       {
         // End of stream.
@@ -2189,6 +2800,7 @@ namespace butl
       }
       else
         throw_generic_error (errno);
+#endif
 
       break;
     }
@@ -2513,6 +3125,63 @@ namespace butl
   //
   using preskip = function<bool (const dir_entry&)>;
 
+  // Canonicalize the pattern component collapsing consecutive stars (used to
+  // express that it is recursive) into a single one.
+  //
+  static void
+  canonicalize_pattern (string& pcr)
+  {
+    auto j (pcr.begin ());
+    bool prev_star (false);
+    for (const path_pattern_term& t: path_pattern_iterator (pcr))
+    {
+      // Skip the repeated star wildcard.
+      //
+      if (t.star () && prev_star)
+        continue;
+
+      // Note: we only need to copy the pattern term if a star have already
+      // been skipped.
+      //
+      assert (j <= t.begin);
+
+      if (j != t.begin)
+        copy (t.begin, t.end, j);
+
+      j += t.size ();
+
+      prev_star = t.star ();
+    }
+
+    if (j != pcr.end ())
+      pcr.resize (j - pcr.begin ());
+  }
+
+  // Return the number of the pattern components.
+  //
+  static inline size_t
+  pattern_size (const path& p)
+  {
+    size_t r (0);
+    for (auto i (p.begin ()); i != p.end (); ++i)
+      ++r;
+    return r;
+  }
+
+  // Match the name against the pattern component, using the compiled pattern
+  // component, if specified.
+  //
+  static inline bool
+  match_component (const string& name,
+                   const string& pcr,
+                   const compiled_path_pattern* cpattern,
+                   size_t pci)
+  {
+    return cpattern != nullptr
+      ? cpattern->match (name, pci)
+      : path_match (name, pcr);
+  }
+
   template <typename FS>
   static bool
   search (
@@ -2521,7 +3190,8 @@ namespace butl
     path_match_flags fl,
     const function<bool (path&&, const string& pattern, bool interm)>& func,
     const function<bool (const dir_entry&)>& dangling_func,
-    FS& filesystem)
+    FS& filesystem,
+    const compiled_path_pattern* cpattern)
   {
     bool follow_symlinks ((fl & path_match_flags::follow_symlinks) !=
                           path_match_flags::none);
@@ -2568,6 +3238,13 @@ namespace butl
     path pc (pattern.begin (), ++pattern.begin ());
     string pcr (pc.representation ());
 
+    // If the compiled pattern is specified, then the index of its component
+    // that corresponds to the pattern leftmost component.
+    //
+    size_t pci (cpattern != nullptr
+                ? cpattern->size () - pattern_size (pattern)
+                : 0);
+
     // Note that if the pattern has multiple components (is not a simple path),
     // then the leftmost one has a trailing separator, and so will match
     // sub-directories only.
@@ -2616,33 +3293,7 @@ namespace butl
       },
       move (ps)));
 
-    // Canonicalize the pattern component collapsing consecutive stars (used to
-    // express that it is recursive) into a single one.
-    //
-    auto j (pcr.begin ());
-    bool prev_star (false);
-    for (const path_pattern_term& t: path_pattern_iterator (pcr))
-    {
-      // Skip the repeated star wildcard.
-      //
-      if (t.star () && prev_star)
-        continue;
-
-      // Note: we only need to copy the pattern term if a star have already
-      // been skipped.
-      //
-      assert (j <= t.begin);
-
-      if (j != t.begin)
-        copy (t.begin, t.end, j);
-
-      j += t.size ();
-
-      prev_star = t.star ();
-    }
-
-    if (j != pcr.end ())
-      pcr.resize (j - pcr.begin ());
+    canonicalize_pattern (pcr);
 
     // Note that the callback function can be called for the same directory
     // twice: first time as intermediate match from iterator's preopen() call,
@@ -2676,7 +3327,7 @@ namespace butl
                                          ? pattern_dir
                                          : filesystem.start_dir ()));
 
-      if (!path_match (se.leaf ().representation (), pcr))
+      if (!match_component (se.leaf ().representation (), pcr, cpattern, pci))
         continue;
 
       // If the callback function returns false, then we stop the entire search
@@ -2700,7 +3351,8 @@ namespace butl
                               fl,
                               func,
                               dangling_func,
-                              filesystem))
+                              filesystem,
+                              cpattern))
         return false;
     }
 
@@ -2719,7 +3371,8 @@ namespace butl
                  fl,
                  func,
                  dangling_func,
-                 filesystem))
+                 filesystem,
+                 cpattern))
     {
       return false;
     }
@@ -2980,18 +3633,1134 @@ namespace butl
     const function<bool (const dir_entry&)>& dangling_func)
   {
     real_filesystem fs (pattern.relative () ? start : empty_dir);
-    search (pattern, dir_path (), flags, func, dangling_func, fs);
+    search (pattern, dir_path (), flags, func, dangling_func, fs, nullptr);
   }
 
-  // Search path in the directory tree represented by a path.
+  void
+  path_search (
+    const compiled_path_pattern& pattern,
+    const function<bool (path&&, const string& pattern, bool interm)>& func,
+    const dir_path& start,
+    path_match_flags flags,
+    const function<bool (const dir_entry&)>& dangling_func)
+  {
+    const path& p (pattern.pattern ());
+    real_filesystem fs (p.relative () ? start : empty_dir);
+    search (p, dir_path (), flags, func, dangling_func, fs, &pattern);
+  }
+
+  // Search path in the real filesystem, breadth-first and/or in parallel.
   //
-  // Iterate over path prefixes, as recursive_dir_iterator (see above) would
-  // iterate over the real directory tree.
+  // Instead of iterating over the directory tree recursively (see search()
+  // above), represent the search in each directory as a task that iterates
+  // over the directory sub-entries, matching them against the pattern
+  // leftmost component, and schedules tasks for the sub-directories that
+  // need to be searched. The recursive pattern component is handled by
+  // scheduling the continuation task for each traversed sub-directory that
+  // matches the same pattern but doesn't match the directory itself and
+  // doesn't handle absent-matching.
   //
-  class path_iterator
+  // The tasks are processed by a pool of threads, each having its own task
+  // queue. The thread takes the tasks from its own queue (from the back for
+  // the depth-first order and from the front for the breadth-first order)
+  // and, if it is empty, steals them from the front of the other threads'
+  // queues. Note that for the depth-first order the task at the front of a
+  // queue normally represents the largest unexplored subtree.
+  //
+  class path_search_engine
   {
   public:
-    path_iterator (path p, bool recursive, bool self, preopen po)
+    using func_type = function<bool (path&&, const string&, bool)>;
+    using dangling_type = function<bool (const dir_entry&)>;
+
+    path_search_engine (const dir_path& start,
+                        path_match_flags fl,
+                        const func_type& func,
+                        const dangling_type& dangling_func,
+                        path_search_order order,
+                        bool sorted,
+                        const compiled_path_pattern* cpattern)
+        : fs_ (start),
+          follow_symlinks_ ((fl & path_match_flags::follow_symlinks) !=
+                            path_match_flags::none),
+          match_absent_ ((fl & path_match_flags::match_absent) !=
+                         path_match_flags::none),
+          func_ (func),
+          dangling_func_ (dangling_func),
+          fifo_ (order == path_search_order::breadth_first),
+          sorted_ (sorted),
+          cpattern_ (cpattern)
+    {
+      assert (follow_symlinks_ || dangling_func_ == nullptr);
+    }
+
+    void
+    run (path pattern, size_t threads)
+    {
+      if (threads == 0)
+      {
+        threads = thread_type::hardware_concurrency ();
+
+        if (threads == 0)
+          threads = 1;
+      }
+
+      // Make sure the start directory is computed before any of the worker
+      // threads may need it.
+      //
+      fs_.start_dir ();
+
+      for (size_t i (0); i != threads; ++i)
+        queues_.push_back (unique_ptr<task_queue> (new task_queue));
+
+      submit (task {move (pattern), dir_path (), false /* continuation */},
+              0);
+
+      // Start the helper threads and join the search ourselves. If we fail to
+      // start a thread, then just proceed with the threads we already have
+      // (the tasks of the queues of the threads that are not started are
+      // stolen by others).
+      //
+      vector<thread_type> ts;
+      ts.reserve (threads - 1);
+
+      for (size_t i (1); i != threads; ++i)
+      {
+        try
+        {
+          ts.emplace_back ([this, i] {work (i);});
+        }
+        catch (const system_error&)
+        {
+          break;
+        }
+      }
+
+      work (0);
+
+      for (thread_type& t: ts)
+        t.join ();
+
+      if (exception_ != nullptr)
+        rethrow_exception (exception_);
+
+      // Report the collected final matches in the path order.
+      //
+      if (sorted_)
+      {
+        sort (matches_.begin (), matches_.end ());
+
+        for (pair<path, string>& m: matches_)
+        {
+          if (!func_ (move (m.first), m.second, false /* interm */))
+            break;
+        }
+      }
+    }
+
+  private:
+    struct task
+    {
+      path pattern;
+      dir_path dir;      // Relative to the start directory.
+      bool continuation; // Continuation of the recursive component search.
+    };
+
+    void
+    process (task&& t, size_t w)
+    {
+      path& pattern (t.pattern);
+      dir_path& pattern_dir (t.dir);
+
+      // Fast-forward the leftmost pattern non-wildcard components (see
+      // search() for details). Note that the continuation task pattern
+      // always starts with a wildcard.
+      //
+      if (!t.continuation)
+      {
+        auto b (pattern.begin ());
+        auto e (pattern.end ());
+        auto i (b);
+        for (; i != e && !path_pattern (*i); ++i) ;
+
+        if (i == e)
+        {
+          path p (pattern_dir / pattern);
+          auto pe (fs_.path_entry (p, follow_symlinks_));
+
+          if (pe.first &&
+              ((pe.second.type == entry_type::directory) == p.to_directory ()))
+            report (move (p), string (), false /* interm */);
+
+          return;
+        }
+        else if (i != b)
+        {
+          path p (b, i);
+          pattern = pattern.leaf (p);
+          pattern_dir /= path_cast<dir_path> (move (p));
+        }
+      }
+
+      assert (!pattern.empty ());
+
+      path pc (pattern.begin (), ++pattern.begin ());
+      string pcr (pc.representation ());
+
+      size_t pci (cpattern_ != nullptr
+                  ? cpattern_->size () - pattern_size (pattern)
+                  : 0);
+
+      bool simple (pattern.simple ());
+      bool recursive (path_pattern_recursive (pcr));
+      bool self (!t.continuation && path_pattern_self_matching (pcr));
+      bool fs (follow_symlinks_ || !simple);
+
+      canonicalize_pattern (pcr);
+
+      // Match the sub-entry leaf against the pattern leftmost component and,
+      // if matches, report it and/or schedule the search in it using the
+      // trailing part of the pattern. Return false if the search must be
+      // stopped.
+      //
+      auto match = [this, &pattern, &pc, &pcr, pci, simple, w]
+                   (const path& p, const path& leaf)
+      {
+        if (!match_component (leaf.representation (), pcr, cpattern_, pci))
+          return true;
+
+        if (simple)
+          return report (path (p), pcr, false /* interm */);
+
+        if (report (path (p), pcr, true /* interm */))
+          submit (task {pattern.leaf (pc), path_cast<dir_path> (p), false},
+                  w);
+
+        return true;
+      };
+
+      // Note that as recursive_dir_iterator does, we call the preopen
+      // callback for the directory itself, if it is self-matching, prior to
+      // traversing it and ignore the non-existent directory (see the
+      // recursive_dir_iterator class for details).
+      //
+      bool traverse (!self ||
+                     report (path_cast<path> (pattern_dir),
+                             any_dir,
+                             true /* interm */));
+
+      optional<dir_iterator> di;
+
+      if (traverse)
+      {
+        dir_path d (fs_.start () / pattern_dir);
+
+        try
+        {
+          di = dir_iterator (!d.empty () ? d : dir_path ("."),
+                             fs
+                             ? dir_iterator::detect_dangling
+                             : dir_iterator::no_follow);
+        }
+        catch (const system_error& e)
+        {
+          if (e.code ().category () != generic_category ())
+            throw;
+
+          int ec (e.code ().value ());
+          if (ec != ENOENT && ec != ENOTDIR)
+            throw;
+        }
+      }
+
+      if (!traverse || di)
+      {
+        if (di)
+        {
+          for (const dir_entry& de: *di)
+          {
+            if (stop_)
+              return;
+
+            entry_type et (fs ? de.type () : de.ltype ());
+
+            // Skip the inaccessible/dangling entry.
+            //
+            if (et == entry_type::unknown)
+            {
+              if (dangling_func_ == nullptr)
+                throw_generic_error (
+                  de.ltype () == entry_type::symlink ? ENOENT : EACCES);
+
+              if (!dangling_func_ (de))
+              {
+                stop ();
+                return;
+              }
+
+              continue;
+            }
+
+            path p (et == entry_type::directory
+                    ? path_cast<dir_path> (pattern_dir / de.path ())
+                    : pattern_dir / de.path ());
+
+            // Schedule the recursive traversal of the sub-directory, unless
+            // the preopen callback disallows it.
+            //
+            if (recursive                   &&
+                et == entry_type::directory &&
+                report (path (p), any_dir, true /* interm */))
+              submit (task {pattern, path_cast<dir_path> (p), true}, w);
+
+            if (!match (p, p.leaf ()))
+              return;
+          }
+        }
+
+        // Match the directory itself, if requested (see search() for
+        // details).
+        //
+        if (self)
+        {
+          const dir_path& d (!pattern_dir.empty ()
+                             ? pattern_dir
+                             : fs_.start_dir ());
+
+          if (!match (pattern_dir, d.leaf ()))
+            return;
+        }
+      }
+
+      // If requested, also search with the absent-matching pattern path
+      // component omitted (see search() for details).
+      //
+      if (!t.continuation                                    &&
+          match_absent_                                      &&
+          pc.to_directory ()                                 &&
+          (!pattern_dir.empty () || !simple)                 &&
+          pc.string ().find_first_not_of ('*') == string::npos)
+        submit (task {pattern.leaf (pc), move (pattern_dir), false}, w);
+    }
+
+    // Call the callback function or, for a final match in the sorted mode,
+    // save the match. Stop the search if false is returned for a final
+    // match.
+    //
+    bool
+    report (path&& p, const string& pattern, bool interm)
+    {
+      if (sorted_ && !interm)
+      {
+        unique_lock l (mutex_);
+        matches_.emplace_back (move (p), pattern);
+        return true;
+      }
+
+      if (func_ (move (p), pattern, interm))
+        return true;
+
+      if (!interm)
+        stop ();
+
+      return false;
+    }
+
+    void
+    submit (task&& t, size_t w)
+    {
+      ++pending_;
+
+      {
+        task_queue& q (*queues_[w]);
+        unique_lock l (q.mutex);
+        q.tasks.push_back (move (t));
+      }
+
+      ++queued_;
+
+      if (queues_.size () != 1)
+      {
+        unique_lock l (mutex_);
+
+        if (idle_ != 0)
+          condition_.notify_one ();
+      }
+    }
+
+    bool
+    take (size_t w, task& t)
+    {
+      size_t n (queues_.size ());
+
+      for (size_t i (0); i != n; ++i)
+      {
+        task_queue& q (*queues_[(w + i) % n]);
+        unique_lock l (q.mutex);
+
+        if (!q.tasks.empty ())
+        {
+          // Take from the back of our own queue in the depth-first order and
+          // from the front otherwise.
+          //
+          if (i == 0 && !fifo_)
+          {
+            t = move (q.tasks.back ());
+            q.tasks.pop_back ();
+          }
+          else
+          {
+            t = move (q.tasks.front ());
+            q.tasks.pop_front ();
+          }
+
+          --queued_;
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    void
+    work (size_t w)
+    {
+      for (task t; !stop_; )
+      {
+        if (!take (w, t))
+        {
+          unique_lock l (mutex_);
+
+          ++idle_;
+          condition_.wait (l, [this] {
+              return queued_ != 0 || pending_ == 0 || stop_;});
+          --idle_;
+
+          if (pending_ == 0)
+            break;
+
+          continue;
+        }
+
+        try
+        {
+          process (move (t), w);
+        }
+        catch (...)
+        {
+          {
+            unique_lock l (mutex_);
+
+            if (exception_ == nullptr)
+              exception_ = current_exception ();
+          }
+
+          stop ();
+        }
+
+        if (--pending_ == 0)
+        {
+          unique_lock l (mutex_);
+          condition_.notify_all ();
+        }
+      }
+    }
+
+    void
+    stop ()
+    {
+      stop_ = true;
+
+      unique_lock l (mutex_);
+      condition_.notify_all ();
+    }
+
+  private:
+#ifndef LIBBUTL_MINGW_STDTHREAD
+    using mutex_type = std::mutex;
+    using condition_variable_type = std::condition_variable;
+    using thread_type = std::thread;
+    using unique_lock = std::unique_lock<mutex_type>;
+#else
+    using mutex_type = mingw_stdthread::mutex;
+    using condition_variable_type = mingw_stdthread::condition_variable;
+    using thread_type = mingw_stdthread::thread;
+    using unique_lock = mingw_stdthread::unique_lock<mutex_type>;
+#endif
+
+    struct task_queue
+    {
+      mutex_type mutex;
+      deque<task> tasks;
+    };
+
+    // Note: start_dir() is only called by the worker threads after it is
+    // computed in run().
+    //
+    class filesystem: public real_filesystem
+    {
+    public:
+      using real_filesystem::real_filesystem;
+
+      const dir_path&
+      start () const {return start_;}
+    };
+
+    filesystem fs_;
+    bool follow_symlinks_;
+    bool match_absent_;
+    const func_type& func_;
+    const dangling_type& dangling_func_;
+    bool fifo_;
+    bool sorted_;
+    const compiled_path_pattern* cpattern_;
+
+    vector<unique_ptr<task_queue>> queues_;
+
+    atomic<size_t> pending_ {0}; // Submitted but not yet processed tasks.
+    atomic<size_t> queued_ {0};  // Tasks in the queues.
+    atomic<bool> stop_ {false};
+
+    mutex_type mutex_;          // Protects the below data members.
+    condition_variable_type condition_;
+    size_t idle_ = 0;
+    exception_ptr exception_;
+    vector<pair<path, string>> matches_;
+  };
+
+  static void
+  path_search (
+    const path& pattern,
+    const compiled_path_pattern* cpattern,
+    const function<bool (path&&, const string& pattern, bool interm)>& func,
+    const dir_path& start,
+    path_match_flags flags,
+    const function<bool (const dir_entry&)>& dangling_func,
+    path_search_order order,
+    size_t threads,
+    bool sorted)
+  {
+    // Use the recursive search for the single-threaded depth-first unsorted
+    // search to preserve the call sequence guarantees (see the header for
+    // details).
+    //
+    if (order == path_search_order::depth_first && threads == 1 && !sorted)
+    {
+      real_filesystem fs (pattern.relative () ? start : empty_dir);
+      search (pattern, dir_path (), flags, func, dangling_func, fs, cpattern);
+      return;
+    }
+
+    path_search_engine e (pattern.relative () ? start : empty_dir,
+                          flags,
+                          func,
+                          dangling_func,
+                          order,
+                          sorted,
+                          cpattern);
+    e.run (pattern, threads);
+  }
+
+  void
+  path_search (
+    const path& pattern,
+    const function<bool (path&&, const string& pattern, bool interm)>& func,
+    const dir_path& start,
+    path_match_flags flags,
+    const function<bool (const dir_entry&)>& dangling_func,
+    path_search_order order,
+    size_t threads,
+    bool sorted)
+  {
+    path_search (pattern,
+                 nullptr /* cpattern */,
+                 func,
+                 start,
+                 flags,
+                 dangling_func,
+                 order,
+                 threads,
+                 sorted);
+  }
+
+  void
+  path_search (
+    const compiled_path_pattern& pattern,
+    const function<bool (path&&, const string& pattern, bool interm)>& func,
+    const dir_path& start,
+    path_match_flags flags,
+    const function<bool (const dir_entry&)>& dangling_func,
+    path_search_order order,
+    size_t threads,
+    bool sorted)
+  {
+    path_search (pattern.pattern (),
+                 &pattern,
+                 func,
+                 start,
+                 flags,
+                 dangling_func,
+                 order,
+                 threads,
+                 sorted);
+  }
+
+  // Search for paths matching the pattern set in the real filesystem.
+  //
+  // Think of running all the patterns simultaneously as NFAs over the
+  // directory tree. Each directory being traversed is associated with a set
+  // of states, with each state being a pattern and its component that needs
+  // to be matched against the directory sub-entries. The directory is listed
+  // once, matching each sub-entry against all the states and computing the
+  // state sets for the sub-directories. The sub-directories that end up with
+  // no include pattern states are not traversed.
+  //
+  // Note that the leading non-wildcard pattern components are fast-forwarded
+  // (as in search() above), so the traversal may start from multiple base
+  // directories. If such a base directory is reached from the other one,
+  // then their state sets are merged.
+  //
+  class path_set_search
+  {
+  public:
+    using func_type = function<bool (path&&, const vector<size_t>&, bool)>;
+    using dangling_type = function<bool (const dir_entry&)>;
+
+    path_set_search (const path_pattern_set& ps,
+                     const dir_path& start,
+                     path_match_flags fl,
+                     const func_type& func,
+                     const dangling_type& dangling_func)
+        : patterns_ (ps.patterns ()),
+          start_ (start),
+          follow_symlinks_ ((fl & path_match_flags::follow_symlinks) !=
+                            path_match_flags::none),
+          match_absent_ ((fl & path_match_flags::match_absent) !=
+                         path_match_flags::none),
+          func_ (func),
+          dangling_func_ (dangling_func)
+    {
+      assert (follow_symlinks_ || dangling_func_ == nullptr);
+    }
+
+    void
+    run ();
+
+  private:
+    struct component
+    {
+      string representation;
+      bool wildcard;
+      bool recursive;
+      bool self;     // Self-matching.
+      bool absent;   // Can match absent directory component.
+      bool last;
+    };
+
+    struct state
+    {
+      size_t pattern;
+      size_t component;
+      bool continuation; // Continuation of the recursive component match.
+    };
+
+    using state_set = vector<state>;
+
+    // Matches and sub-directories of a directory, identified by the
+    // sub-entry names.
+    //
+    struct match
+    {
+      string name;
+      path entry;
+      vector<size_t> includes;
+      bool excluded;
+    };
+
+    struct subdir
+    {
+      string name;
+      state_set states;
+      bool verify; // Only added via non-wildcard components.
+    };
+
+    // The matches and sub-directories in the order of addition, indexed by
+    // the sub-entry names so that adding to an entry is O(1) regardless of
+    // the number of entries in the directory.
+    //
+    template <typename T>
+    struct entry_set
+    {
+      vector<T> entries;
+      unordered_map<string, size_t> index;
+
+      // Return the entry for the name, creating it if absent.
+      //
+      template <typename... A>
+      T&
+      get (const string& n, A&&... a)
+      {
+        auto r (index.emplace (n, entries.size ()));
+
+        if (r.second)
+          entries.push_back (T {n, forward<A> (a)...});
+
+        return entries[r.first->second];
+      }
+    };
+
+    using match_set = entry_set<match>;
+    using subdir_set = entry_set<subdir>;
+
+    const component&
+    comp (const state& s) const {return components_[s.pattern][s.component];}
+
+    bool
+    exclude (const state& s) const {return patterns_[s.pattern].exclude;}
+
+    bool
+    includes (const state_set&) const;
+
+    static void
+    add_state (state_set&, const state&);
+
+    void
+    add_match (match_set&, const string& name, path&&, size_t pattern);
+
+    void
+    add_subdir (subdir_set&, const string& name, const state&, bool lit);
+
+    void
+    expand (const dir_path&, state_set&, match_set&, const string& name);
+
+    bool
+    report (match_set&);
+
+    void
+    traverse (const dir_path&, state_set&&);
+
+    bool
+    exists (const dir_path& d) const
+    {
+      auto pe (path_entry (fs_path (d), true /* follow_symlinks */));
+      return pe.first && pe.second.type == entry_type::directory;
+    }
+
+    path
+    fs_path (const path& p) const
+    {
+      path r (p.relative () ? start_ / p : p);
+      return !r.empty () ? r : path (".");
+    }
+
+  private:
+    const vector<path_pattern_set::pattern_type>& patterns_;
+    const dir_path& start_;
+    bool follow_symlinks_;
+    bool match_absent_;
+    const func_type& func_;
+    const dangling_type& dangling_func_;
+
+    vector<vector<component>> components_;
+    map<dir_path, state_set> bases_;
+    dir_path start_dir_;
+    bool stop_ = false;
+  };
+
+  bool path_set_search::
+  includes (const state_set& ss) const
+  {
+    for (const state& s: ss)
+    {
+      if (!exclude (s))
+        return true;
+    }
+
+    return false;
+  }
+
+  void path_set_search::
+  add_state (state_set& ss, const state& s)
+  {
+    for (const state& x: ss)
+    {
+      if (x.pattern      == s.pattern   &&
+          x.component    == s.component &&
+          x.continuation == s.continuation)
+        return;
+    }
+
+    ss.push_back (s);
+  }
+
+  void path_set_search::
+  add_match (match_set& ms, const string& n, path&& p, size_t pattern)
+  {
+    match& m (ms.get (n, move (p), vector<size_t> (), false));
+
+    if (patterns_[pattern].exclude)
+      m.excluded = true;
+    else
+      m.includes.push_back (pattern);
+  }
+
+  void path_set_search::
+  add_subdir (subdir_set& ds, const string& n, const state& s, bool lit)
+  {
+    subdir& d (ds.get (n, state_set (), true));
+
+    add_state (d.states, s);
+
+    if (!lit)
+      d.verify = false;
+  }
+
+  // Add the states that apply to the directory itself (self-matching and
+  // absent-matching pattern components), adding the final matches for the
+  // directory under the specified name.
+  //
+  void path_set_search::
+  expand (const dir_path& d, state_set& ss, match_set& ms, const string& n)
+  {
+    for (size_t i (0); i != ss.size (); ++i)
+    {
+      state s (ss[i]); // Note: ss can be modified below.
+
+      if (s.continuation)
+        continue;
+
+      const component& c (comp (s));
+
+      // Note that the start directory leaf is used for matching if the
+      // first pattern component is self-matching (see search() for
+      // details).
+      //
+      if (c.self)
+      {
+        const dir_path& sd (!d.empty () ? d : start_dir_);
+
+        if (patterns_[s.pattern].pattern.match (
+              sd.leaf ().representation (), s.component))
+        {
+          if (c.last)
+            add_match (ms, n, path (d), s.pattern);
+          else
+            add_state (ss, state {s.pattern, s.component + 1, false});
+        }
+      }
+
+      if (match_absent_ && c.absent && (!d.empty () || !c.last))
+      {
+        if (c.last)
+          add_match (ms, n, path (d), s.pattern);
+        else
+          add_state (ss, state {s.pattern, s.component + 1, false});
+      }
+    }
+  }
+
+  // Report the final matches. Return false if the search is stopped.
+  //
+  bool path_set_search::
+  report (match_set& ms)
+  {
+    for (match& m: ms.entries)
+    {
+      if (m.excluded || m.includes.empty ())
+        continue;
+
+      vector<size_t>& is (m.includes);
+      sort (is.begin (), is.end ());
+      is.erase (unique (is.begin (), is.end ()), is.end ());
+
+      if (!func_ (move (m.entry), is, false /* interm */))
+      {
+        stop_ = true;
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  void path_set_search::
+  run ()
+  {
+    size_t n (patterns_.size ());
+    components_.resize (n);
+
+    for (size_t i (0); i != n; ++i)
+    {
+      const path& p (patterns_[i].pattern.pattern ());
+
+      assert (!p.empty ());
+
+      vector<component>& cs (components_[i]);
+      for (auto j (p.begin ()); j != p.end (); ++j)
+      {
+        string r (*j);
+        if (char s = j.separator ())
+          r += s;
+
+        bool w (path_pattern (r));
+
+        cs.push_back (component {r,
+                                 w,
+                                 w && path_pattern_recursive (r),
+                                 w && path_pattern_self_matching (r),
+                                 false,
+                                 false});
+
+        // Only wildcard-only directory components can match an absent
+        // component.
+        //
+        component& c (cs.back ());
+        c.absent = w                                           &&
+                   path::traits_type::is_separator (r.back ()) &&
+                   r.find_first_not_of ('*') == r.size () - 1;
+      }
+
+      cs.back ().last = true;
+
+      // Fast-forward the leading non-wildcard components, leaving the last
+      // component to be matched in the base directory.
+      //
+      size_t k (0);
+      auto j (p.begin ());
+      for (; k != cs.size () - 1 && !cs[k].wildcard; ++k, ++j) ;
+
+      dir_path b (path_cast<dir_path> (path (p.begin (), j)));
+      bases_[move (b)].push_back (state {i, k, false});
+    }
+
+    start_dir_ = !start_.empty () ? start_ : dir_path::current_directory ();
+
+    while (!bases_.empty () && !stop_)
+    {
+      auto i (bases_.begin ());
+      dir_path d (i->first);
+      state_set ss (move (i->second));
+      bases_.erase (i);
+
+      if (!includes (ss) || !exists (d))
+        continue;
+
+      match_set ms;
+      expand (d, ss, ms, d.representation ());
+
+      if (report (ms))
+        traverse (d, move (ss));
+    }
+  }
+
+  void path_set_search::
+  traverse (const dir_path& d, state_set&& ss)
+  {
+    match_set ms;
+    subdir_set ds;
+
+    // Handle the non-wildcard component states without listing the
+    // directory, which we only do if there are any wildcard component
+    // states. Note that the recursive component continuation states are
+    // always wildcard.
+    //
+    bool list (false);
+    bool follow (false);
+
+    for (const state& s: ss)
+    {
+      const component& c (comp (s));
+
+      if (c.wildcard)
+      {
+        list = true;
+
+        if (!c.last || follow_symlinks_)
+          follow = true;
+      }
+      else if (c.last)
+      {
+        path p (d / path (c.representation));
+        auto pe (path_entry (fs_path (p), follow_symlinks_));
+
+        if (pe.first &&
+            ((pe.second.type == entry_type::directory) == p.to_directory ()))
+          add_match (ms, c.representation, move (p), s.pattern);
+      }
+      else
+        add_subdir (ds,
+                    c.representation,
+                    state {s.pattern, s.component + 1, false},
+                    true /* literal */);
+    }
+
+    if (list)
+    {
+      optional<dir_iterator> di;
+
+      try
+      {
+        di = dir_iterator (path_cast<dir_path> (fs_path (d)),
+                           follow
+                           ? dir_iterator::detect_dangling
+                           : dir_iterator::no_follow);
+      }
+      catch (const system_error& e)
+      {
+        // Ignore non-existent directory (see recursive_dir_iterator for
+        // details).
+        //
+        if (e.code ().category () != generic_category ())
+          throw;
+
+        int ec (e.code ().value ());
+        if (ec != ENOENT && ec != ENOTDIR)
+          throw;
+      }
+
+      if (di)
+      {
+        for (const dir_entry& de: *di)
+        {
+          entry_type lt (de.ltype ());
+          entry_type ft (follow ? de.type () : lt);
+
+          // Skip the inaccessible/dangling entry.
+          //
+          if (ft == entry_type::unknown)
+          {
+            if (dangling_func_ == nullptr)
+              throw_generic_error (
+                lt == entry_type::symlink ? ENOENT : EACCES);
+
+            if (!dangling_func_ (de))
+            {
+              stop_ = true;
+              return;
+            }
+
+            continue;
+          }
+
+          // The sub-entry names with the trailing separator for directories,
+          // with and without following symlinks.
+          //
+          string ln (lt == entry_type::directory
+                     ? path_cast<dir_path> (de.path ()).representation ()
+                     : de.path ().string ());
+
+          string fn (ft == entry_type::directory
+                     ? path_cast<dir_path> (de.path ()).representation ()
+                     : de.path ().string ());
+
+          for (const state& s: ss)
+          {
+            const component& c (comp (s));
+
+            if (!c.wildcard)
+              continue;
+
+            // Note that as in search() we follow symlinks for the
+            // non-rightmost components regardless of the flag.
+            //
+            bool f (!c.last || follow_symlinks_);
+            const string& n (f ? fn : ln);
+
+            if (patterns_[s.pattern].pattern.match (n, s.component))
+            {
+              if (c.last)
+                add_match (ms, n, d / path (n), s.pattern);
+              else
+                add_subdir (ds,
+                            n,
+                            state {s.pattern, s.component + 1, false},
+                            false /* literal */);
+            }
+
+            if (c.recursive && (f ? ft : lt) == entry_type::directory)
+              add_subdir (ds,
+                          n,
+                          state {s.pattern, s.component, true},
+                          false /* literal */);
+          }
+        }
+      }
+    }
+
+    // Complete the sub-directory state sets, merging in the states of the
+    // base directories, if any, and adding their matches.
+    //
+    for (subdir& sd: ds.entries)
+    {
+      dir_path cd (d / dir_path (sd.name));
+
+      auto i (bases_.find (cd));
+      if (i != bases_.end ())
+      {
+        for (const state& s: i->second)
+          add_state (sd.states, s);
+
+        bases_.erase (i);
+      }
+
+      if (!includes (sd.states) || (sd.verify && !exists (cd)))
+      {
+        sd.states.clear ();
+        continue;
+      }
+
+      expand (cd, sd.states, ms, sd.name);
+    }
+
+    if (!report (ms))
+      return;
+
+    for (subdir& sd: ds.entries)
+    {
+      if (stop_)
+        return;
+
+      if (sd.states.empty ())
+        continue;
+
+      vector<size_t> is;
+      for (const state& s: sd.states)
+      {
+        if (!exclude (s))
+          is.push_back (s.pattern);
+      }
+
+      sort (is.begin (), is.end ());
+      is.erase (unique (is.begin (), is.end ()), is.end ());
+
+      dir_path cd (d / dir_path (sd.name));
+
+      if (func_ (path (cd), is, true /* interm */))
+        traverse (cd, move (sd.states));
+    }
+  }
+
+  void
+  path_search (
+    const path_pattern_set& patterns,
+    const function<bool (path&&, const vector<size_t>&, bool interm)>& func,
+    const dir_path& start,
+    path_match_flags flags,
+    const function<bool (const dir_entry&)>& dangling_func)
+  {
+    path_set_search s (patterns, start, flags, func, dangling_func);
+    s.run ();
+  }
+
+  // Search path in the directory tree represented by a path.
+  //
+  // Iterate over path prefixes, as recursive_dir_iterator (see above) would
+  // iterate over the real directory tree.
+  //
+  class path_iterator
+  {
+  public:
+    path_iterator (path p, bool recursive, bool self, preopen po)
         : path_ (move (p)),
           recursive_ (recursive),
           self_ (self),
@@ -3198,6 +4967,30 @@ namespace butl
     path_match_flags flags)
   {
     path_filesystem fs (start, entry);
-    search (pattern, dir_path (), flags, func, nullptr /* dangle_func */, fs);
+    search (pattern,
+            dir_path (),
+            flags,
+            func,
+            nullptr /* dangle_func */,
+            fs,
+            nullptr /* cpattern */);
+  }
+
+  void
+  path_search (
+    const compiled_path_pattern& pattern,
+    const path& entry,
+    const function<bool (path&&, const string& pattern, bool interm)>& func,
+    const dir_path& start,
+    path_match_flags flags)
+  {
+    path_filesystem fs (start, entry);
+    search (pattern.pattern (),
+            dir_path (),
+            flags,
+            func,
+            nullptr /* dangle_func */,
+            fs,
+            &pattern);
   }
 }
@@ -21,16 +21,18 @@
 #endif
 
 #include <string>
-#include <cstddef>    // ptrdiff_t
+#include <memory>     // unique_ptr
+#include <cstddef>    // ptrdiff_t, size_t
 #include <cstdint>    // uint16_t, etc
 #include <utility>    // move(), pair
+#include <vector>
 #include <iterator>   // input_iterator_tag
 #include <functional>
 
 #include <libbutl/path.hxx>
 #include <libbutl/optional.hxx>
 #include <libbutl/timestamp.hxx>
-#include <libbutl/path-pattern.hxx> // path_match_flags
+#include <libbutl/path-pattern.hxx> // path_match_flags, path_pattern_set, etc
 
 #include <libbutl/export.hxx>
 
@@ -205,15 +207,26 @@ namespace butl
   // The '-r' (recursive) version of the above. Note that it will
   // never return not_empty.
   //
+  // On POSIX the directory content is removed relative to the open directory
+  // file descriptors and the subdirectories can be removed concurrently by
+  // up to the specified number of threads, including the calling thread
+  // (with 0 meaning the number of hardware threads). On Windows the removal
+  // is always sequential.
+  //
   LIBBUTL_SYMEXPORT rmdir_status
-  try_rmdir_r (const dir_path&, bool ignore_error = false);
+  try_rmdir_r (const dir_path&,
+               bool ignore_error = false,
+               std::size_t threads = 1);
 
   // As above but throws rather than returns not_exist if the directory
   // does not exist (unless ignore_error is true), so check before calling.
   // If the second argument is false, then the directory itself is not removed.
   //
   LIBBUTL_SYMEXPORT void
-  rmdir_r (const dir_path&, bool dir = true, bool ignore_error = false);
+  rmdir_r (const dir_path&,
+           bool dir = true,
+           bool ignore_error = false,
+           std::size_t threads = 1);
 
   // Try to remove the file (or symlink) returning not_exist if it does not
   // exist. Unless ignore_error is true, all other errors are reported by
@@ -409,6 +422,9 @@ namespace butl
 
     copy_timestamps       = 0x4, // Copy timestamps from source.
 
+    reflink               = 0x8,  // Require copy-on-write cloning of content.
+    no_reflink            = 0x10, // Forbid copy-on-write cloning of content.
+
     none = 0
   };
 
@@ -434,6 +450,16 @@ namespace butl
   // destination is a dangling symbolic link, then this function will still
   // fail.
   //
+  // On Linux the content is copied in kernel, without passing it through the
+  // user space buffers, if supported by the underlying filesystem(s). By
+  // default, the copy-on-write cloning (reflink) is attempted first, falling
+  // back to copy_file_range(2), then to sendfile(2), and finally to the
+  // buffered copying. If the reflink flag is specified, then fail with the
+  // underlying OS error (for example, EOPNOTSUPP or EXDEV; ENOTSUP on other
+  // platforms) if cloning is not possible. If the no_reflink flag is
+  // specified, then make sure the content is physically copied. Note that
+  // the reflink and no_reflink flags are mutually exclusive.
+  //
   LIBBUTL_SYMEXPORT void
   cpfile (const path& from,
           const path& to,
@@ -790,10 +816,19 @@ namespace butl
   private:
     dir_entry e_;
 
-#ifndef _WIN32
-    DIR* h_ = nullptr;
-#else
+#if defined(_WIN32)
     intptr_t h_ = -1; // INVALID_HANDLE_VALUE
+#elif defined(__linux__)
+    // On Linux we read the directory entries in batches using getdents64()
+    // rather than one by one using readdir() and stat them relative to the
+    // directory file descriptor.
+    //
+    int h_ = -1;                  // Directory file descriptor.
+    std::unique_ptr<char[]> buf_; // Directory entries batch buffer.
+    std::size_t bn_ = 0;          // Batch size.
+    std::size_t bi_ = 0;          // Next entry position in the batch.
+#else
+    DIR* h_ = nullptr;
 #endif
 
     mode mode_ = no_follow;
@@ -887,9 +922,9 @@ namespace butl
   // (a/b/,   b*/, true)
   // (a/b/c/, c*/, false)
   //
-  // Note that recursive iterating through directories currently goes depth-
-  // first which make sense for the cleanup use cases. In the future we may
-  // want to make this controllable.
+  // Note that recursive iterating through directories goes depth-first which
+  // make sense for the cleanup use cases. See below for the overload that
+  // allows to control the traversal order and to search in parallel.
   //
   // If the match flags contain follow_symlinks, then call the dangling
   // callback function for inaccessible/dangling entries if specified, and
@@ -928,6 +963,124 @@ namespace butl
                                          bool interm)>&,
                const dir_path& start = dir_path (),
                path_match_flags = path_match_flags::none);
+
+  // Directory tree traversal order for path_search().
+  //
+  enum class path_search_order
+  {
+    depth_first,
+    breadth_first
+  };
+
+  // Same as the first path_search() overload above but traverse the
+  // directory tree in the specified order and, optionally, in parallel.
+  //
+  // If the threads argument is greater than 1, then search in up to this
+  // number of threads (0 means the number of hardware threads), distributing
+  // the sub-directory searches between them (the calling thread also
+  // participates). In this case the callback functions can be called
+  // concurrently from multiple threads and so must be thread-safe. Note that
+  // the search order is then only approximately the requested one. If the
+  // search is stopped, then the callbacks can still be called for a few more
+  // paths being processed by other threads.
+  //
+  // Unless the search is single-threaded and depth-first, the sequence of the
+  // callback function calls for the directory tree differs from the one
+  // described above. Specifically, the intermediate match for a
+  // sub-directory may be reported before or after the matches below it, and
+  // the final matches from different sub-directories can be interleaved.
+  //
+  // If the sorted argument is true, then, for deterministic results, the
+  // final matches are collected and reported from the calling thread in the
+  // path order after the traversal completes (the intermediate matches are
+  // still reported during the traversal). In this case the search cannot be
+  // stopped early by returning false for a final match (but the remaining
+  // matches are not reported). Note that the same path can still be
+  // reported multiple times (see above).
+  //
+  LIBBUTL_SYMEXPORT void
+  path_search (const path& pattern,
+               const std::function<bool (path&&,
+                                         const std::string& pattern,
+                                         bool interm)>&,
+               const dir_path& start,
+               path_match_flags,
+               const std::function<bool (const dir_entry&)>& dangling,
+               path_search_order,
+               std::size_t threads = 1,
+               bool sorted = false);
+
+  // Same as the above path_search() overloads but match the compiled pattern
+  // (see compiled_path_pattern for details). Note that the pattern component
+  // reported to the callback function is still the string representation of
+  // the respective component.
+  //
+  LIBBUTL_SYMEXPORT void
+  path_search (const compiled_path_pattern&,
+               const std::function<bool (path&&,
+                                         const std::string& pattern,
+                                         bool interm)>&,
+               const dir_path& start = dir_path (),
+               path_match_flags = path_match_flags::follow_symlinks,
+               const std::function<bool (const dir_entry&)>& dangling =
+                 nullptr);
+
+  LIBBUTL_SYMEXPORT void
+  path_search (const compiled_path_pattern&,
+               const path& entry,
+               const std::function<bool (path&&,
+                                         const std::string& pattern,
+                                         bool interm)>&,
+               const dir_path& start = dir_path (),
+               path_match_flags = path_match_flags::none);
+
+  LIBBUTL_SYMEXPORT void
+  path_search (const compiled_path_pattern&,
+               const std::function<bool (path&&,
+                                         const std::string& pattern,
+                                         bool interm)>&,
+               const dir_path& start,
+               path_match_flags,
+               const std::function<bool (const dir_entry&)>& dangling,
+               path_search_order,
+               std::size_t threads = 1,
+               bool sorted = false);
+
+  // Search for paths matching the pattern set (see path_pattern_set for
+  // details), matching all the patterns in a single directory tree
+  // traversal.
+  //
+  // The callback function is called once for each path that matches any of
+  // the include patterns and none of the exclude patterns (final match,
+  // interm is false) with the patterns argument containing the (ascending)
+  // indexes of the include patterns that matched it. If false is returned for
+  // a final match, then the entire search is stopped.
+  //
+  // Before traversing a sub-directory the callback function is also called
+  // for it with interm being true and the patterns argument containing the
+  // indexes of the include patterns that can match something at or below
+  // it. If false is returned, then the sub-directory is not traversed. Note
+  // that a sub-directory is never traversed if there is no such include
+  // pattern (for example, because only the exclude patterns can match below
+  // it).
+  //
+  // The start directory, match flags, and dangling callback semantics are
+  // the same as for the single pattern search (see above). Unlike the single
+  // pattern search, however, each path is reported at most once, even if
+  // the patterns contain multiple recursive components. Also note that the
+  // start directory itself is not passed to the callback function as an
+  // intermediate match.
+  //
+  LIBBUTL_SYMEXPORT void
+  path_search (const path_pattern_set&,
+               const std::function<bool (
+                 path&&,
+                 const std::vector<std::size_t>& patterns,
+                 bool interm)>&,
+               const dir_path& start = dir_path (),
+               path_match_flags = path_match_flags::follow_symlinks,
+               const std::function<bool (const dir_entry&)>& dangling =
+                 nullptr);
 }
 
 #include <libbutl/filesystem.ixx>
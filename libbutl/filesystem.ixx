@@ -29,14 +29,14 @@ namespace butl
   }
 
   inline rmdir_status
-  try_rmdir_r (const dir_path& p, bool ignore_error)
+  try_rmdir_r (const dir_path& p, bool ignore_error, std::size_t threads)
   {
     //@@ What if it exists but is not a directory?
     //
     bool e (dir_exists (p, ignore_error));
 
     if (e)
-      rmdir_r (p, true, ignore_error);
+      rmdir_r (p, true, ignore_error, threads);
 
     return e ? rmdir_status::success : rmdir_status::not_exist;
   }
@@ -156,6 +156,19 @@ namespace butl
 
   // dir_iterator
   //
+#ifdef __linux__
+  inline dir_iterator::
+  dir_iterator (dir_iterator&& x) noexcept
+    : e_ (std::move (x.e_)),
+      h_ (x.h_),
+      buf_ (std::move (x.buf_)),
+      bn_ (x.bn_),
+      bi_ (x.bi_),
+      mode_ (x.mode_)
+  {
+    x.h_ = -1;
+  }
+#else
   inline dir_iterator::
   dir_iterator (dir_iterator&& x) noexcept
     : e_ (std::move (x.e_)), h_ (x.h_), mode_ (x.mode_)
@@ -166,6 +179,7 @@ namespace butl
     x.h_ = -1;
 #endif
   }
+#endif
 
   inline bool
   operator== (const dir_iterator& x, const dir_iterator& y)
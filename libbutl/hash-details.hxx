@@ -0,0 +1,32 @@
+// file      : libbutl/hash-details.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#pragma once
+
+#include <vector>
+#include <utility>    // pair
+#include <cstddef>    // size_t
+#include <functional>
+
+namespace butl
+{
+  // Hash a batch of chunks, potentially using multiple threads, by calling
+  // the specified function for the [b, e) ranges of chunk indexes. The
+  // function must be safe to call concurrently for non-overlapping ranges.
+  //
+  // If threads is 0, then use the hardware concurrency. Only start the
+  // helper threads if the chunks total at least min_size bytes, so that
+  // there is enough work for them to outweigh the startup overhead. The
+  // chunks are handed out in groups that are a multiple of the granularity
+  // in size (except for the last group) to reduce the contention while
+  // still giving each thread several groups to balance the load. If unable
+  // to start a helper thread, then proceed with the threads already
+  // started. Defined in sha256.cxx.
+  //
+  void
+  hash_batch (const std::vector<std::pair<const void*, std::size_t>>&,
+              std::size_t threads,
+              std::size_t min_size,
+              std::size_t granularity,
+              const std::function<void (std::size_t, std::size_t)>&);
+}
@@ -337,6 +337,254 @@ namespace butl
     return r;
   }
 
+  bool
+  path_match (const path& entry,
+              const compiled_path_pattern& pattern,
+              const dir_path& start,
+              path_match_flags flags)
+  {
+    bool r (false);
+
+    auto match = [&entry, &r] (path&& p, const string&, bool interim)
+    {
+      if (p == entry && !interim)
+      {
+        r = true;
+        return false;
+      }
+
+      return true;
+    };
+
+    path_search (pattern, entry, match, start, flags);
+    return r;
+  }
+
+  // path_pattern_set
+  //
+  size_t path_pattern_set::
+  include (path p)
+  {
+    patterns_.push_back (
+      pattern_type {compiled_path_pattern (move (p)), false});
+
+    return patterns_.size () - 1;
+  }
+
+  size_t path_pattern_set::
+  exclude (path p)
+  {
+    patterns_.push_back (
+      pattern_type {compiled_path_pattern (move (p)), true});
+
+    return patterns_.size () - 1;
+  }
+
+  bool path_pattern_set::
+  match (const path& entry,
+         const dir_path& start,
+         path_match_flags flags) const
+  {
+    bool r (false);
+
+    for (const pattern_type& p: patterns_)
+    {
+      // Note that we don't need to match against the include patterns once
+      // we have a match, but still need to check all the exclude patterns.
+      //
+      if (p.exclude || !r)
+      {
+        if (path_match (entry, p.pattern, start, flags))
+        {
+          if (p.exclude)
+            return false;
+
+          r = true;
+        }
+      }
+    }
+
+    return r;
+  }
+
+  // compiled_path_pattern
+  //
+  compiled_path_pattern::
+  compiled_path_pattern (path p)
+      : pattern_ (move (p))
+  {
+    for (auto i (pattern_.begin ()); i != pattern_.end (); ++i)
+    {
+      // Note that the trailing separator makes the pattern component match
+      // directories only (see path_match() for details).
+      //
+      const string& pc (*i);
+      component c {i.separator () != '\0', false, 0, {}};
+
+      segment sg {terms_.size (), terms_.size ()};
+
+      for (const path_pattern_term& t: path_pattern_iterator (pc))
+      {
+        term ct {term::any, '\0', 0};
+
+        switch (t.type)
+        {
+        case path_pattern_term_type::star:
+          {
+            // Terminate the current segment. Note that we end up with an
+            // empty segment for consecutive stars.
+            //
+            c.star = true;
+            c.segments.push_back (sg);
+            sg.begin = sg.end = terms_.size ();
+            continue;
+          }
+        case path_pattern_term_type::question:
+          {
+            break;
+          }
+        case path_pattern_term_type::literal:
+          {
+            ct.type = term::literal;
+#ifndef _WIN32
+            ct.character = get_literal (t);
+#else
+            ct.character = lcase (get_literal (t));
+#endif
+            break;
+          }
+        case path_pattern_term_type::bracket:
+          {
+            // Note that match_bracket() matches case-insensitively on
+            // Windows, so the set contains both cases.
+            //
+            bitset<256> cs;
+            for (size_t j (0); j != cs.size (); ++j)
+            {
+              if (match_bracket (static_cast<char> (j), t))
+                cs.set (j);
+            }
+
+            ct.type = term::set;
+            ct.set_index = static_cast<uint32_t> (sets_.size ());
+            sets_.push_back (cs);
+            break;
+          }
+        }
+
+        terms_.push_back (ct);
+        ++sg.end;
+        ++c.min_size;
+      }
+
+      c.segments.push_back (sg);
+      components_.push_back (move (c));
+    }
+  }
+
+  bool compiled_path_pattern::
+  match (const char* s, const segment& sg) const
+  {
+    for (size_t i (sg.begin); i != sg.end; ++i, ++s)
+    {
+      const term& t (terms_[i]);
+
+      switch (t.type)
+      {
+      case term::literal:
+        {
+#ifndef _WIN32
+          if (*s != t.character)
+#else
+          if (lcase (*s) != t.character)
+#endif
+            return false;
+
+          break;
+        }
+      case term::any:
+        {
+          break;
+        }
+      case term::set:
+        {
+          if (!sets_[t.set_index][static_cast<unsigned char> (*s)])
+            return false;
+
+          break;
+        }
+      }
+    }
+
+    return true;
+  }
+
+  bool compiled_path_pattern::
+  match (const string& name, size_t ci) const
+  {
+    assert (ci < components_.size ());
+
+    const component& c (components_[ci]);
+
+    // The name doesn't match the pattern if it is of a different type than
+    // the pattern is.
+    //
+    size_t n (name.size ());
+    bool nd (n != 0 && path::traits_type::is_separator (name[n - 1]));
+
+    if (nd != c.dir)
+      return false;
+
+    if (nd)
+      --n;
+
+    if (n < c.min_size)
+      return false;
+
+    const char* s (name.c_str ());
+    const vector<segment>& ss (c.segments);
+
+    if (!c.star)
+      return n == c.min_size && match (s, ss.front ());
+
+    // Match the prefix (precedes the first star) and the suffix (follows the
+    // last star). Note that they may not overlap since the name is not
+    // shorter than all the segments together.
+    //
+    const segment& ps (ss.front ());
+    const segment& sf (ss.back ());
+
+    if (!match (s, ps) || !match (s + n - sf.size (), sf))
+      return false;
+
+    // Match the remaining segments leftmost-first in between. Since they are
+    // separated by stars, matching a segment at the leftmost position can
+    // only leave more room for the subsequent segments and so there is no
+    // need to backtrack.
+    //
+    const char* b (s + ps.size ());
+    const char* e (s + n - sf.size ());
+
+    for (size_t i (1); i < ss.size () - 1; ++i)
+    {
+      const segment& sg (ss[i]);
+      size_t m (sg.size ());
+
+      for (;; ++b)
+      {
+        if (static_cast<size_t> (e - b) < m)
+          return false;
+
+        if (match (b, sg))
+          break;
+      }
+
+      b += m;
+    }
+
+    return true;
+  }
+
   // path_pattern_iterator
   //
   void path_pattern_iterator::
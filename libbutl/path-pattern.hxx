@@ -3,7 +3,9 @@
 
 #pragma once
 
+#include <bitset>
 #include <string>
+#include <vector>
 #include <cassert>
 #include <cstdint>  // uint16_t
 #include <cstddef>  // ptrdiff_t, size_t
@@ -92,6 +94,149 @@ namespace butl
               const dir_path& start = dir_path (),
               path_match_flags = path_match_flags::none);
 
+  // Compiled wildcard pattern.
+  //
+  // Matching the name against the pattern string (see above) re-interprets
+  // the pattern on every call and may involve backtracking. If the same
+  // pattern needs to be matched against a large number of names, it can be
+  // compiled once into the matcher object which is then passed to the
+  // path_match() and path_search() overloads (see below and filesystem.hxx).
+  //
+  // Each pattern component is compiled into a sequence of segments separated
+  // by the star wildcards, with each segment being a fixed-length sequence of
+  // the literal character, the question mark, and the bracket expression
+  // terms. The bracket expressions are compiled into the character sets. The
+  // name is first checked against the minimum length and the (anchored)
+  // prefix and suffix segments and only then the remaining segments are
+  // matched, leftmost-first, without backtracking.
+  //
+  // Note that the leading and trailing segments are quite often literal
+  // (*.txt, foo*, etc) so most of the non-matching names are rejected
+  // without looking at the rest of the pattern.
+  //
+  class LIBBUTL_SYMEXPORT compiled_path_pattern
+  {
+  public:
+    // Compile the pattern which may contain multiple components (see
+    // path_search() for details).
+    //
+    explicit
+    compiled_path_pattern (path);
+
+    // Return the pattern this object was compiled from.
+    //
+    const path&
+    pattern () const {return pattern_;}
+
+    // Return the number of the pattern components.
+    //
+    std::size_t
+    size () const {return components_.size ();}
+
+    // Return true if name matches the specified pattern component. The name
+    // semantics is the same as for path_match(name, pattern) (see above).
+    //
+    bool
+    match (const std::string& name, std::size_t component = 0) const;
+
+  private:
+    struct term
+    {
+      enum type_type: std::uint8_t {literal, any, set};
+
+      type_type     type;
+      char          character; // Literal (lower-cased on Windows).
+      std::uint32_t set_index; // Character set index in sets_.
+    };
+
+    // Segment is the [begin, end) range of terms.
+    //
+    struct segment
+    {
+      std::size_t begin;
+      std::size_t end;
+
+      std::size_t
+      size () const {return end - begin;}
+    };
+
+    struct component
+    {
+      bool dir;                      // Matches directories only.
+      bool star;                     // Contains star wildcards.
+      std::size_t min_size;          // Minimum name size (sans separator).
+      std::vector<segment> segments; // At least one, possibly empty.
+    };
+
+    bool
+    match (const char*, const segment&) const;
+
+  private:
+    path pattern_;
+    std::vector<component> components_;
+    std::vector<term> terms_;
+    std::vector<std::bitset<256>> sets_;
+  };
+
+  // Set of compiled patterns with the include/exclude semantics: a path
+  // matches the set if it matches any of the include patterns and none of
+  // the exclude patterns. The patterns are identified by their indexes in
+  // the order of addition.
+  //
+  // See also path_search() for the pattern set.
+  //
+  class LIBBUTL_SYMEXPORT path_pattern_set
+  {
+  public:
+    struct pattern_type
+    {
+      compiled_path_pattern pattern;
+      bool exclude;
+    };
+
+    // Compile and add the include/exclude pattern returning its index.
+    //
+    std::size_t
+    include (path);
+
+    std::size_t
+    exclude (path);
+
+    const std::vector<pattern_type>&
+    patterns () const {return patterns_;}
+
+    std::size_t
+    size () const {return patterns_.size ();}
+
+    bool
+    empty () const {return patterns_.empty ();}
+
+    // Return true if the path entry matches the set (see path_match(entry,
+    // pattern) for details).
+    //
+    bool
+    match (const path& entry,
+           const dir_path& start = dir_path (),
+           path_match_flags = path_match_flags::none) const;
+
+  private:
+    std::vector<pattern_type> patterns_;
+  };
+
+  // Match the name against the pattern that must have a single component.
+  //
+  bool
+  path_match (const std::string& name, const compiled_path_pattern&);
+
+  // Match the path entry against the compiled pattern (see the above
+  // overload for details).
+  //
+  LIBBUTL_SYMEXPORT bool
+  path_match (const path& entry,
+              const compiled_path_pattern&,
+              const dir_path& start = dir_path (),
+              path_match_flags = path_match_flags::none);
+
   // Return true if a name contains the wildcard characters.
   //
   bool
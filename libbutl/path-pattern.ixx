@@ -71,6 +71,15 @@ namespace butl
     return path_pattern_iterator ();
   }
 
+  // compiled_path_pattern
+  //
+  inline bool
+  path_match (const std::string& name, const compiled_path_pattern& p)
+  {
+    assert (p.size () == 1);
+    return p.match (name);
+  }
+
   // patterns
   //
   inline char
@@ -3,6 +3,8 @@
 
 #include <libbutl/process.hxx>
 
+#include <memory>   // unique_ptr
+#include <cassert>
 #include <cstdlib>  // exit()
 #include <iostream> // cerr
 
@@ -19,14 +21,18 @@ namespace butl
                  const char* const* envvars,
                  process::pipe in,
                  process::pipe out,
-                 process::pipe err)
+                 process::pipe err,
+                 const process_limits* limits)
   {
     try
     {
-      return process (pp, cmd,
-                      move (in), move (out), move (err),
-                      cwd != nullptr ? cwd->string ().c_str () : nullptr,
-                      envvars);
+      const char* wd (cwd != nullptr ? cwd->string ().c_str () : nullptr);
+
+      return limits != nullptr
+        ? process (pp, cmd, move (in), move (out), move (err),
+                   wd, envvars, *limits)
+        : process (pp, cmd, move (in), move (out), move (err),
+                   wd, envvars);
     }
     catch (const process_child_error& e)
     {
@@ -34,4 +40,124 @@ namespace butl
       exit (1);
     }
   }
+
+  vector<process>
+  process_start_batch (const process_env& env, const vector<process_job>& js)
+  {
+    assert (env.path != nullptr);
+
+    const process_path& pp (*env.path);
+
+    process_spawn_spec ss (process_path (pp,
+                                         (pp.initial !=
+                                          pp.recall.string ().c_str ())),
+                           0, 1, 2,
+                           (env.cwd != nullptr
+                            ? env.cwd->string ().c_str ()
+                            : nullptr),
+                           env.vars,
+                           env.limits);
+
+    vector<process> r;
+    r.reserve (js.size ());
+
+    for (const process_job& j: js)
+    {
+      try
+      {
+        r.push_back (ss.start (j.args, j.in, j.out, j.err));
+      }
+      catch (const process_child_error& e)
+      {
+        cerr << "unable to execute " << j.args[0] << ": " << e << endl;
+        exit (1);
+      }
+      catch (const process_error&)
+      {
+        // Close our pipe ends not to block the already started processes
+        // which are waited for on destruction.
+        //
+        for (process& pr: r)
+        {
+          pr.out_fd.reset ();
+          pr.in_ofd.reset ();
+          pr.in_efd.reset ();
+        }
+
+        throw;
+      }
+    }
+
+    return r;
+  }
+
+  void process_sink::
+  write (const char* b, size_t n)
+  {
+    if (string_ != nullptr)
+    {
+      size_t s (string_->size ());
+      size_t r (s < limit_ ? limit_ - s : 0);
+
+      if (n > r)
+      {
+        n = r;
+        truncated = true;
+      }
+
+      string_->append (b, n);
+    }
+    else if (stream_ != nullptr)
+      stream_->write (b, static_cast<streamsize> (n));
+    else
+      callback_ (b, n);
+  }
+
+  void
+  process_capture (process_sinks& ss)
+  {
+    // Note that the streams are destroyed (and their descriptors are closed)
+    // on exception.
+    //
+    small_vector<unique_ptr<ifdstream>, 2> iss;
+    fdselect_set fds;
+
+    for (process_sink& s: ss)
+    {
+      iss.push_back (
+        unique_ptr<ifdstream> (
+          new ifdstream (move (s.in),
+                         fdstream_mode::non_blocking,
+                         ifdstream::badbit)));
+
+      fds.push_back (iss.back ()->fd ());
+    }
+
+    char buf[fdstreambuf::buffer_size];
+
+    for (size_t n (iss.size ()); n != 0; )
+    {
+      ifdselect (fds);
+
+      for (size_t i (0); i != fds.size (); ++i)
+      {
+        fdselect_state& s (fds[i]);
+
+        if (s.fd == nullfd || !s.ready)
+          continue;
+
+        ifdstream& is (*iss[i]);
+
+        for (streamsize m; (m = is.readsome (buf, sizeof (buf))) != 0; )
+          ss[i].write (buf, static_cast<size_t> (m));
+
+        if (is.eof ())
+        {
+          is.close ();
+          s.fd = nullfd;
+          --n;
+        }
+      }
+    }
+  }
 }
@@ -114,7 +114,8 @@ namespace butl
                  const char* const* envvars,
                  process::pipe in,
                  process::pipe out,
-                 process::pipe err);
+                 process::pipe err,
+                 const process_limits* limits);
 
   template <typename V, typename T>
   inline const char*
@@ -172,7 +173,8 @@ namespace butl
                           env.vars,
                           std::move (in_i),
                           std::move (out_i),
-                          std::move (err_i));
+                          std::move (err_i),
+                          env.limits);
   }
 
   template <typename C,
@@ -11,9 +11,25 @@
                          // sigismember(), pthread_sigmask(), sigaction(),
                          // sigpending()
 #  include <unistd.h>    // execvp, fork, dup2, pipe, chdir, *_FILENO, getpid
-#  include <sys/wait.h>  // waitpid
+#  include <sys/wait.h>  // waitpid(), wait4()
+#  include <sys/resource.h> // rusage, setrlimit()
 #  include <sys/types.h> // _stat
 #  include <sys/stat.h>  // _stat(), S_IS*
+#  include <poll.h>      // poll()
+#  include <fcntl.h>     // open()
+
+#  if defined(__linux__)
+#    include <sys/syscall.h> // syscall(), SYS_*
+#    if !defined(SYS_pidfd_open) && !defined(__alpha__)
+#      define SYS_pidfd_open 434 // Same for all architectures except Alpha.
+#    endif
+#  elif defined(__FreeBSD__) || \
+        defined(__OpenBSD__) || \
+        defined(__NetBSD__)  || \
+        defined(__APPLE__)
+#    include <sys/event.h> // kqueue(), kevent()
+#    define LIBBUTL_KQUEUE
+#  endif
 
 // On POSIX systems we will use posix_spawn() if available and fallback to
 // the less efficient fork()/exec() method otherwise.
@@ -101,6 +117,7 @@
 #  include <sys/types.h>  // stat
 #  include <sys/stat.h>   // stat(), S_IS*
 #  include <processenv.h> // {Get,Free}EnvironmentStringsA()
+#  include <psapi.h>      // GetProcessMemoryInfo()
 
 #  ifdef _MSC_VER // Unlikely to be fixed in newer versions.
 #    define S_ISREG(m) (((m) & S_IFMT) == S_IFREG)
@@ -116,16 +133,21 @@
 #include <cstring>  // strlen(), strchr(), strpbrk(), str[n]cmp(), strncpy(),
                     // memset()
 #include <utility>  // move()
+#include <cstdio>   // snprintf()
 #include <ostream>
 #include <cassert>
+#include <stdexcept> // invalid_argument
+#include <atomic>
+#include <algorithm> // find(), find_if()
 
 #ifndef _WIN32
+#  include <mutex>
+#  include <limits> // numeric_limits
 #  include <thread> // this_thread::sleep_for()
 #else
 #  include <map>
 #  include <ratio>     // milli
 #  include <cstdlib>   // __argv[]
-#  include <algorithm> // find()
 #endif
 
 #include <libbutl/process-details.hxx>
@@ -138,6 +160,8 @@ namespace butl
 #include <libbutl/path-io.hxx>
 #include <libbutl/utility.hxx>  // icasecmp()
 #include <libbutl/fdstream.hxx> // fdopen_null()
+#include <libbutl/timestamp.hxx>
+#include <libbutl/filesystem.hxx> // dir_mtime()
 
 using namespace std;
 
@@ -154,6 +178,57 @@ extern char** environ;
 
 namespace butl
 {
+  // process_stats
+  //
+  string
+  to_string (const process_stats& ps)
+  {
+    char b[64];
+
+    auto time = [&b] (auto d) -> const char*
+    {
+      snprintf (b, sizeof (b),
+                "%.2fs", chrono::duration<double> (d).count ());
+      return b;
+    };
+
+    auto size = [&b] (uint64_t n) -> const char*
+    {
+      double v (static_cast<double> (n));
+
+      if (n >= 1024 * 1024 * 1024)
+        snprintf (b, sizeof (b), "%.2fGB", v / (1024 * 1024 * 1024));
+      else if (n >= 1024 * 1024)
+        snprintf (b, sizeof (b), "%.1fMB", v / (1024 * 1024));
+      else
+        snprintf (b, sizeof (b), "%.1fKB", v / 1024);
+
+      return b;
+    };
+
+    string r ("wall ");
+    r += time (ps.wall_time);
+    r += ", user ";
+    r += time (ps.user_time);
+    r += ", system ";
+    r += time (ps.system_time);
+    r += ", max rss ";
+    r += size (ps.max_rss);
+    r += ", i/o ";
+    r += std::to_string (ps.input_ops);
+    r += '/';
+    r += std::to_string (ps.output_ops);
+
+#ifndef _WIN32
+    r += ", context switches ";
+    r += std::to_string (ps.voluntary_switches);
+    r += '/';
+    r += std::to_string (ps.involuntary_switches);
+#endif
+
+    return r;
+  }
+
   // process_exit
   //
   LIBBUTL_SYMEXPORT string
@@ -277,11 +352,30 @@ namespace butl
     return r;
   }
 
+#ifndef _WIN32
+  static process_path
+  cached_path_search (const char*, const dir_path&, bool, const char*);
+#endif
+
+  static atomic<bool> path_cache_ (false);
+
+  bool process::
+  path_cache (bool v)
+  {
+    return path_cache_.exchange (v, memory_order_relaxed);
+  }
+
   process_path process::
   try_path_search (const char* f, bool init,
                    const dir_path& fb, bool po, const char* ps)
   {
+#ifndef _WIN32
+    process_path r (path_cache_.load (memory_order_relaxed)
+                    ? cached_path_search (f, fb, po, ps)
+                    : butl::path_search (f, fb, po, ps));
+#else
     process_path r (butl::path_search (f, fb, po, ps));
+#endif
 
     if (!init && !r.empty ())
     {
@@ -329,6 +423,20 @@ namespace butl
     } while (*p != nullptr);
   }
 
+  static atomic<bool> concurrent_startup_ (false);
+
+  bool process::
+  concurrent_startup (bool v)
+  {
+    return concurrent_startup_.exchange (v, memory_order_relaxed);
+  }
+
+  bool process::
+  concurrent_startup ()
+  {
+    return concurrent_startup_.load (memory_order_relaxed);
+  }
+
   // Return true if the NULL-terminated variable list contains an (un)set of
   // the specified variable. The NULL list argument denotes an empty list.
   //
@@ -483,12 +591,247 @@ namespace butl
     return process_path ();
   }
 
+  // The path_search() results cache.
+  //
+  struct path_cache_entry
+  {
+    path recall;
+    path effect;
+    bool found;
+
+    // The searched directories with their modification times.
+    //
+    vector<pair<string, timestamp>> dirs;
+
+    // When the entry was last validated.
+    //
+    chrono::steady_clock::time_point checked;
+  };
+
+  // The interval during which a cached result is returned without being
+  // revalidated.
+  //
+  static const chrono::milliseconds path_cache_interval (1000);
+
+  static mutex path_cache_mutex;
+  static unordered_map<string, path_cache_entry> path_cache_map;
+  static process::path_cache_stats_type path_cache_stats_;
+
+  static process_path
+  cached_path_search (const char* f, const dir_path& fb, bool po,
+                      const char* paths)
+  {
+    using traits = path::traits_type;
+
+    size_t fn (strlen (f));
+
+    // Only cache the PATH search (see path_search() for details).
+    //
+    if (traits::find_separator (f, fn) != nullptr)
+      return path_search (f, fb, po, paths);
+
+    optional<string> paths_env;
+    if (paths == nullptr && (paths_env = getenv ("PATH")))
+      paths = paths_env->c_str ();
+
+    // Only cache the search in the absolute paths (see path_search() for
+    // the semantics of the empty paths).
+    //
+    for (const char* b (paths), *e;
+         b != nullptr;
+         b = (e != nullptr ? e + 1 : e))
+    {
+      e = strchr (b, traits::path_separator);
+
+      size_t n (e != nullptr ? e - b : strlen (b));
+
+      if (n == 0 || !traits::absolute (b, n))
+        return path_search (f, fb, po, paths);
+    }
+
+    if (!fb.empty () && fb.relative ())
+      return path_search (f, fb, po, paths);
+
+    string k (f, fn);
+    k += '\n';
+    if (paths != nullptr)
+      k += paths;
+    k += '\n';
+    k += fb.string ();
+
+    // Return true if the cached directory modification times are still
+    // valid and the found file (if any) is still executable.
+    //
+    auto valid = [] (const path_cache_entry& e)
+    {
+      try
+      {
+        for (const pair<string, timestamp>& d: e.dirs)
+        {
+          if (dir_mtime (d.first.c_str ()) != d.second)
+            return false;
+        }
+      }
+      catch (const system_error&)
+      {
+        return false;
+      }
+
+      struct stat si;
+      return (!e.found ||
+              (stat (e.effect.string ().c_str (), &si) == 0 &&
+               S_ISREG (si.st_mode) &&
+               (si.st_mode & (S_IEXEC | S_IXGRP | S_IXOTH)) != 0));
+    };
+
+    {
+      lock_guard<mutex> l (path_cache_mutex);
+
+      auto i (path_cache_map.find (k));
+      if (i != path_cache_map.end ())
+      {
+        path_cache_entry& e (i->second);
+
+        // Only revalidate the entry once per interval so that most of the
+        // hits don't perform any system calls.
+        //
+        chrono::steady_clock::time_point now (chrono::steady_clock::now ());
+        bool v (now - e.checked < path_cache_interval);
+
+        if (!v && (v = valid (e)))
+          e.checked = now;
+
+        if (v)
+        {
+          ++path_cache_stats_.hits;
+
+          return e.found
+            ? process_path (f, path (e.recall), path (e.effect))
+            : process_path ();
+        }
+
+        path_cache_map.erase (i);
+        ++path_cache_stats_.invalidations;
+      }
+
+      ++path_cache_stats_.misses;
+    }
+
+    // Collect the directories to search in and their modification times.
+    // Note that we do it before searching not to miss changes made during
+    // the search.
+    //
+    path_cache_entry e;
+    timestamp now (system_clock::now ());
+
+    try
+    {
+      auto add = [&e] (const char* d, size_t n)
+      {
+        string s (d, n);
+
+        if (!traits::is_separator (s.back ()))
+          s += traits::directory_separator;
+
+        timestamp t (dir_mtime (s.c_str ()));
+        e.dirs.emplace_back (move (s), t);
+      };
+
+      for (const char* b (paths), *e;
+           b != nullptr;
+           b = (e != nullptr ? e + 1 : e))
+      {
+        e = strchr (b, traits::path_separator);
+        add (b, e != nullptr ? e - b : strlen (b));
+      }
+
+      if (!fb.empty ())
+        add (fb.string ().c_str (), fb.string ().size ());
+    }
+    catch (const system_error&)
+    {
+      return path_search (f, fb, po, paths);
+    }
+
+    process_path r (path_search (f, fb, po, paths));
+
+    // If found, then only the directories up to and including the one
+    // containing the file are relevant.
+    //
+    if ((e.found = !r.empty ()))
+    {
+      const char* p (r.effect_string ());
+      size_t pn (strlen (p));
+
+      auto i (find_if (e.dirs.begin (), e.dirs.end (),
+                       [p, pn, fn] (const pair<string, timestamp>& d)
+                       {
+                         const string& s (d.first);
+                         return s.size () + fn == pn &&
+                                s.compare (0, s.size (), p, s.size ()) == 0;
+                       }));
+
+      assert (i != e.dirs.end ());
+      e.dirs.erase (i + 1, e.dirs.end ());
+
+      e.recall = r.recall;
+      e.effect = r.effect;
+    }
+
+    // Don't cache the result if any of the directories has been modified
+    // recently since a subsequent modification may not change its
+    // modification time due to the filesystem timestamp granularity.
+    //
+    for (const pair<string, timestamp>& d: e.dirs)
+    {
+      if (d.second != timestamp_nonexistent && now - d.second < 1s)
+        return r;
+    }
+
+    e.checked = chrono::steady_clock::now ();
+
+    lock_guard<mutex> l (path_cache_mutex);
+    path_cache_map[move (k)] = move (e);
+
+    return r;
+  }
+
+  process::path_cache_stats_type process::
+  path_cache_stats ()
+  {
+    lock_guard<mutex> l (path_cache_mutex);
+
+    path_cache_stats_type r (path_cache_stats_);
+    r.entries = path_cache_map.size ();
+    return r;
+  }
+
+  void process::
+  path_cache_clear ()
+  {
+    lock_guard<mutex> l (path_cache_mutex);
+
+    path_cache_map.clear ();
+    path_cache_stats_ = path_cache_stats_type ();
+  }
+
   process::
   process (const process_path& pp, const char* const* args,
            pipe pin, pipe pout, pipe perr,
            const char* cwd,
-           const char* const* evars)
+           const char* const* evars,
+           const char* const* env,
+           const process_limits* limits)
+      : start_time_ (chrono::steady_clock::now ())
   {
+    if (limits != nullptr && limits->empty ())
+      limits = nullptr;
+
+#ifndef __linux__
+    if (limits != nullptr && limits->cgroup)
+      throw process_error (ENOTSUP);
+#endif
+
     int in  (pin.in);
     int out (pout.out);
     int err (perr.out);
@@ -564,14 +907,24 @@ namespace butl
         cwd = twd->c_str ();
     }
 
-    const char* const* tevars (thread_env ());
+    // Note that the complete environment overrides everything.
+    //
+    const char* const* tevars (env == nullptr ? thread_env () : nullptr);
+
+    if (env != nullptr)
+      evars = nullptr;
 
     // The posix_spawn()-based implementation.
     //
+    // Note that the resource limits can only be applied by the fork()-based
+    // implementation (see below).
+    //
 #ifdef LIBBUTL_POSIX_SPAWN
+    if (limits == nullptr
 #ifndef LIBBUTL_POSIX_SPAWN_CHDIR
-    if (cwd == nullptr || *cwd == '\0') // Not changing CWD.
+        && (cwd == nullptr || *cwd == '\0') // Not changing CWD.
 #endif
+        )
     {
       // Reimplement the child process housekeeping actions of the fork-based
       // implementation (see below) into the equivalent file action sequence
@@ -752,7 +1105,22 @@ namespace butl
       // Retry to create the child process after the "resource temporarily
       // unavailable" (EAGAIN) failure for 1050ms.
       //
-      ulock l (process_spawn_mutex);
+      // If the concurrent startup is enabled, then don't acquire the
+      // process_spawn_mutex (see concurrent_startup() for details). Note
+      // that we can only do this if all the file descriptors created by the
+      // library have the close-on-exec flag set atomically (see
+      // fdopen_pipe() and fddup() for details).
+      //
+#if defined(__linux__) || defined(__FreeBSD__)
+      bool cs (concurrent_startup ());
+#else
+      bool cs (false);
+#endif
+
+      ulock l (process_spawn_mutex, defer_lock);
+
+      if (!cs)
+        l.lock ();
 
       for (size_t i (0);; ++i)
       {
@@ -760,39 +1128,42 @@ namespace butl
         // the parent thread until the child process calls exec() or
         // terminates. This avoids "text file busy" issue (see the fork-based
         // code below): due to the process_spawn_mutex lock the execution of
-        // the script is delayed until the child closes the descriptor.
+        // the script is delayed until the child closes the descriptor. With
+        // the concurrent startup we retry on ETXTBSY instead.
         //
         int r (posix_spawn (&handle,
                             pp.effect_string (),
                             &fa,
                             &attr,
                             const_cast<char* const*> (&args[0]),
-                            (new_env.empty ()
+                            (env != nullptr
+                             ? const_cast<char* const*> (env)
+                             : new_env.empty ()
                              ? environ
                              : const_cast<char* const*> (new_env.data ()))));
 
-        l.unlock (); // Release the lock in parent.
+        if (!cs)
+          l.unlock (); // Release the lock in parent.
 
         if (r == 0)
           break;
 
-        if (i != 15 && r == EAGAIN)
+        if (i != 15 && (r == EAGAIN || (cs && r == ETXTBSY)))
         {
           this_thread::sleep_for (i * 10ms);
-          l.lock ();
+
+          if (!cs)
+            l.lock ();
         }
         else
           fail (r);
       }
     }
-#ifndef LIBBUTL_POSIX_SPAWN_CHDIR
     else
-#endif
 #endif // LIBBUTL_POSIX_SPAWN
 
     // The fork-based implementation.
     //
-#ifndef LIBBUTL_POSIX_SPAWN_CHDIR
     {
       auto fail = [] (bool child)
       {
@@ -802,6 +1173,12 @@ namespace butl
           throw process_error (errno);
       };
 
+#ifdef __linux__
+      string cgroup_procs;
+      if (limits != nullptr && limits->cgroup)
+        cgroup_procs = (*limits->cgroup / path ("cgroup.procs")).string ();
+#endif
+
       // Retry to create the child process after the "resource temporarily
       // unavailable" (EAGAIN) failure for 1050ms.
       //
@@ -974,6 +1351,45 @@ namespace butl
         if (cwd != nullptr && *cwd != '\0' && chdir (cwd) != 0)
           fail (true /* child */);
 
+        // Apply the resource limits, if requested.
+        //
+        if (limits != nullptr)
+        {
+          auto set_limit = [&fail] (int r, const optional<uint64_t>& v)
+          {
+            if (v)
+            {
+              rlimit l;
+              l.rlim_cur = l.rlim_max = static_cast<rlim_t> (*v);
+
+              if (setrlimit (r, &l) != 0)
+                fail (true /* child */);
+            }
+          };
+
+          set_limit (RLIMIT_AS,     limits->address_space);
+          set_limit (RLIMIT_CPU,    limits->cpu_time);
+          set_limit (RLIMIT_NOFILE, limits->open_files);
+
+#ifdef __linux__
+          // Move ourselves into the cgroup by writing 0 to its cgroup.procs
+          // file (the path is prepared in the parent not to allocate).
+          //
+          if (!cgroup_procs.empty ())
+          {
+            int fd (open (cgroup_procs.c_str (), O_WRONLY | O_CLOEXEC));
+
+            if (fd == -1)
+              fail (true /* child */);
+
+            if (write (fd, "0", 1) != 1)
+              fail (true /* child */);
+
+            close (fd);
+          }
+#endif
+        }
+
         // Set/unset non-overridden environment variables.
         //
         auto set_vars = [] (const char* const* vs,
@@ -1036,11 +1452,16 @@ namespace butl
 
         // Try to re-exec after the "text file busy" failure for 450ms.
         //
-        // Note that execv() does not return on success.
+        // Note that execv[e]() does not return on success.
         //
         for (size_t i (1); i != 10; ++i)
         {
-          execv (pp.effect_string (), const_cast<char**> (&args[0]));
+          if (env != nullptr)
+            execve (pp.effect_string (),
+                    const_cast<char**> (&args[0]),
+                    const_cast<char**> (env));
+          else
+            execv (pp.effect_string (), const_cast<char**> (&args[0]));
 
           if (errno != ETXTBSY)
             break;
@@ -1051,7 +1472,6 @@ namespace butl
         fail (true /* child */);
       }
     }  // Release the lock in parent.
-#endif // LIBBUTL_POSIX_SPAWN_CHDIR
 
     assert (handle != 0); // Shouldn't get here unless in the parent process.
 
@@ -1082,6 +1502,40 @@ namespace butl
     }
   }
 
+  // Return the resource usage statistics of a process that has started at
+  // the specified time and has just been waited for.
+  //
+  static process_stats
+  to_stats (const rusage& ru, chrono::steady_clock::time_point st)
+  {
+    using namespace chrono;
+
+    auto time = [] (const timeval& tv)
+    {
+      return microseconds (static_cast<int64_t> (tv.tv_sec) * 1000000 +
+                           tv.tv_usec);
+    };
+
+    process_stats r;
+    r.wall_time = duration_cast<nanoseconds> (steady_clock::now () - st);
+    r.user_time = time (ru.ru_utime);
+    r.system_time = time (ru.ru_stime);
+
+    // Note that ru_maxrss is in bytes on Mac OS and in kilobytes elsewhere.
+    //
+#ifdef __APPLE__
+    r.max_rss = static_cast<uint64_t> (ru.ru_maxrss);
+#else
+    r.max_rss = static_cast<uint64_t> (ru.ru_maxrss) * 1024;
+#endif
+
+    r.input_ops = static_cast<uint64_t> (ru.ru_inblock);
+    r.output_ops = static_cast<uint64_t> (ru.ru_oublock);
+    r.voluntary_switches = static_cast<uint64_t> (ru.ru_nvcsw);
+    r.involuntary_switches = static_cast<uint64_t> (ru.ru_nivcsw);
+    return r;
+  }
+
   bool process::
   wait (bool ie)
   {
@@ -1095,8 +1549,10 @@ namespace butl
       in_efd.reset ();
 
       int es;
-      int r (waitpid (handle, &es, 0));
+      rusage ru;
+      int r (wait4 (handle, &es, 0, &ru));
       handle = 0; // We have tried.
+      reset_termination_fd ();
 
       if (r == -1)
       {
@@ -1109,6 +1565,7 @@ namespace butl
       else
       {
         exit = process_exit (es, process_exit::as_status);
+        exit->stats = to_stats (ru, start_time_);
 
         // If the child process terminated abnormally due to the SIGINT or
         // SIGTERM signal, then wait if/while this signal stays pending for
@@ -1158,17 +1615,20 @@ namespace butl
     if (handle != 0)
     {
       int es;
-      int r (waitpid (handle, &es, WNOHANG));
+      rusage ru;
+      int r (wait4 (handle, &es, WNOHANG, &ru));
 
       if (r == 0) // Not exited yet.
         return nullopt;
 
       handle = 0; // We have tried.
+      reset_termination_fd ();
 
       if (r == -1)
         throw process_error (errno);
 
       exit = process_exit (es, process_exit::as_status);
+      exit->stats = to_stats (ru, start_time_);
 
       // If the child process terminated abnormally due to the SIGINT or
       // SIGTERM signal, then wait while this signal stays pending (see above
@@ -1186,28 +1646,150 @@ namespace butl
     return exit ? static_cast<bool> (*exit) : optional<bool> ();
   }
 
+#ifdef SYS_pidfd_open
+  // Set to true if pidfd_open() is not supported by the kernel or is not
+  // permitted (for example, by a seccomp profile predating this system call),
+  // so that we don't try it over and over again.
+  //
+  static atomic<bool> pidfd_unsupported (false);
+#endif
+
+  int process::
+  termination_fd ()
+  {
+    if (handle == 0)
+      return -1;
+
+    if (termination_fd_ == nullfd)
+    {
+      // Note that until waited for, the (potentially terminated) process
+      // stays a zombie and so its pid cannot be reused.
+      //
+#if defined(SYS_pidfd_open)
+      if (pidfd_unsupported.load (memory_order_relaxed))
+        return -1;
+
+      // Note: the close-on-exec flag is set on the descriptor.
+      //
+      int fd (static_cast<int> (syscall (SYS_pidfd_open, handle, 0)));
+
+      if (fd == -1)
+      {
+        // Note that seccomp profiles that predate pidfd_open() (such as the
+        // older Docker and Podman defaults) fail it with EPERM rather than
+        // ENOSYS. Also treat EACCES and EINVAL (which we should never get
+        // for our own child) the same way, falling back to polling.
+        //
+        int e (errno);
+        if (e == ENOSYS || e == EPERM || e == EACCES || e == EINVAL)
+        {
+          pidfd_unsupported.store (true, memory_order_relaxed);
+          return -1;
+        }
+
+        throw process_error (e);
+      }
+
+      termination_fd_.reset (fd);
+#elif defined(LIBBUTL_KQUEUE)
+      // Note that the kqueue descriptor is not inherited by the child
+      // processes.
+      //
+      auto_fd fd (kqueue ());
+
+      if (fd == nullfd)
+        throw process_error (errno);
+
+      // Note that the exit event stays pending (and so the descriptor stays
+      // readable) since we never retrieve it.
+      //
+      struct kevent ev;
+      EV_SET (&ev, handle, EVFILT_PROC, EV_ADD, NOTE_EXIT, 0, 0);
+
+      if (kevent (fd.get (), &ev, 1, nullptr, 0, nullptr) == -1)
+      {
+        // The process may have already exited and some implementations
+        // don't allow to watch zombies. In this case return the read end of
+        // the pipe with the write end closed, which is always readable.
+        //
+        if (errno != ESRCH)
+          throw process_error (errno);
+
+        try
+        {
+          fd = fdopen_pipe ().in;
+        }
+        catch (const ios_base::failure& e)
+        {
+          throw process_error (e.code ().value ());
+        }
+      }
+
+      termination_fd_ = move (fd);
+#else
+      return -1;
+#endif
+    }
+
+    return termination_fd_.get ();
+  }
+
   template <>
   optional<bool> process::
   timed_wait (const chrono::milliseconds& tm)
   {
     using namespace chrono;
 
-    // On POSIX this seems to be the best way for multi-threaded processes.
+    // If possible, wait for the termination descriptor to become readable.
     //
-    const milliseconds sd (10);
-    for (milliseconds d (tm); !try_wait (); d -= sd)
+    // Note that we don't calculate the deadline since the timeout can be
+    // as large as milliseconds::max() and so we would overflow. Instead, we
+    // subtract the elapsed time from the remaining timeout.
+    //
+    int fd (termination_fd ());
+
+    if (fd != -1)
     {
-      this_thread::sleep_for (d < sd ? d : sd);
+      pollfd pfd {fd, POLLIN, 0};
 
-      if (d < sd)
-        break;
-    }
+      for (milliseconds d (tm); d.count () > 0; )
+      {
+        int t (d.count () < numeric_limits<int>::max ()
+               ? static_cast<int> (d.count ())
+               : numeric_limits<int>::max ());
 
-    return try_wait ();
-  }
+        auto s (steady_clock::now ());
+        int r (poll (&pfd, 1, t));
 
-  void process::
-  kill ()
+        if (r == -1 && errno != EINTR)
+          throw process_error (errno);
+
+        if (r == 1)
+          break;
+
+        d -= duration_cast<milliseconds> (steady_clock::now () - s);
+      }
+
+      return try_wait ();
+    }
+
+    // Otherwise, poll. On POSIX this seems to be the best way for
+    // multi-threaded processes.
+    //
+    const milliseconds sd (10);
+    for (milliseconds d (tm); !try_wait (); d -= sd)
+    {
+      this_thread::sleep_for (d < sd ? d : sd);
+
+      if (d < sd)
+        break;
+    }
+
+    return try_wait ();
+  }
+
+  void process::
+  kill ()
   {
     if (handle != 0 && ::kill (handle, SIGKILL) == -1)
       throw process_error (errno);
@@ -1598,6 +2180,19 @@ namespace butl
     return process_path ();
   }
 
+  // The path_search() results cache is not implemented on Windows.
+  //
+  process::path_cache_stats_type process::
+  path_cache_stats ()
+  {
+    return path_cache_stats_type ();
+  }
+
+  void process::
+  path_cache_clear ()
+  {
+  }
+
   // Make handles inheritable. The process_spawn_mutex must be pre-acquired for
   // exclusive access. Revert handles inheritability state in destructor.
   //
@@ -1761,8 +2356,15 @@ namespace butl
   process (const process_path& pp, const char* const* args,
            pipe pin, pipe pout, pipe perr,
            const char* cwd,
-           const char* const* evars)
+           const char* const* evars,
+           const char* const* env,
+           const process_limits* limits)
   {
+    // Resource limits are not supported on Windows.
+    //
+    if (limits != nullptr && !limits->empty ())
+      throw process_error (ENOTSUP);
+
     int in  (pin.in);
     int out (pout.out);
     int err (perr.out);
@@ -1792,9 +2394,18 @@ namespace butl
     //
     vector<char> new_env;
 
-    const char* const* tevars (thread_env ());
+    const char* const* tevars (env == nullptr ? thread_env () : nullptr);
 
-    if (tevars != nullptr || evars != nullptr)
+    if (env != nullptr)
+    {
+      // Note that the complete environment overrides everything.
+      //
+      for (const char* const* v (env); *v != nullptr; ++v)
+        new_env.insert (new_env.end (), *v, *v + strlen (*v) + 1);
+
+      new_env.push_back ('\0'); // Terminate the new environment block.
+    }
+    else if (tevars != nullptr || evars != nullptr)
     {
       // The environment block contains the variables in the following format:
       //
@@ -2357,6 +2968,45 @@ namespace butl
     this->in_efd = move (in_efd.in);
   }
 
+  // Return the resource usage statistics of a terminated process or nullopt
+  // if they are not available.
+  //
+  static optional<process_stats>
+  to_stats (HANDLE h)
+  {
+    using namespace chrono;
+
+    FILETIME ct, et, kt, ut;
+    IO_COUNTERS io;
+    if (!GetProcessTimes (h, &ct, &et, &kt, &ut) ||
+        !GetProcessIoCounters (h, &io))
+      return nullopt;
+
+    // FILETIME is in 100-nanosecond intervals.
+    //
+    auto time = [] (const FILETIME& t)
+    {
+      return (static_cast<uint64_t> (t.dwHighDateTime) << 32) |
+             t.dwLowDateTime;
+    };
+
+    process_stats r;
+    r.wall_time = nanoseconds ((time (et) - time (ct)) * 100);
+    r.user_time = microseconds (time (ut) / 10);
+    r.system_time = microseconds (time (kt) / 10);
+
+    PROCESS_MEMORY_COUNTERS mc;
+    r.max_rss = GetProcessMemoryInfo (h, &mc, sizeof (mc))
+                ? static_cast<uint64_t> (mc.PeakWorkingSetSize)
+                : 0;
+
+    r.input_ops = io.ReadOperationCount;
+    r.output_ops = io.WriteOperationCount;
+    r.voluntary_switches = 0;
+    r.involuntary_switches = 0;
+    return r;
+  }
+
   bool process::
   wait (bool ie)
   {
@@ -2379,6 +3029,7 @@ namespace butl
       {
         exit = process_exit ();
         exit->status = es;
+        exit->stats = to_stats (h.get ());
       }
       else
       {
@@ -2399,6 +3050,15 @@ namespace butl
     return timed_wait (chrono::milliseconds (0));
   }
 
+  int process::
+  termination_fd ()
+  {
+    // Note that the process handle is not a file descriptor and can't be
+    // waited for with fdselect().
+    //
+    return -1;
+  }
+
   template <>
   optional<bool> process::
   timed_wait (const chrono::milliseconds& t)
@@ -2422,6 +3082,7 @@ namespace butl
 
       exit = process_exit ();
       exit->status = es;
+      exit->stats = to_stats (h.get ());
     }
 
     return exit ? static_cast<bool> (*exit) : optional<bool> ();
@@ -2603,4 +3264,505 @@ namespace butl
   }
 
 #endif // _WIN32
+
+  // process_spawn_spec
+  //
+  process_spawn_spec::
+  process_spawn_spec (const char* p,
+                      int in, int out, int err,
+                      const char* cwd,
+                      const char* const* evars,
+                      const process_limits* limits)
+      : process_spawn_spec (process::path_search (p, false /* init */),
+                            in, out, err,
+                            cwd,
+                            evars,
+                            limits)
+  {
+  }
+
+  process_spawn_spec::
+  process_spawn_spec (process_path p,
+                      int in, int out, int err,
+                      const char* cwd,
+                      const char* const* evars,
+                      const process_limits* limits)
+      : path_ (move (p)), in_ (in), out_ (out), err_ (err)
+  {
+    if (limits != nullptr)
+      limits_ = *limits;
+
+    if (cwd != nullptr && *cwd != '\0')
+      cwd_ = cwd;
+    else if (const string* twd = path::traits_type::thread_current_directory ())
+      cwd_ = *twd;
+
+    const char* const* tevars (thread_env ());
+
+    if (tevars == nullptr && evars == nullptr)
+      return;
+
+    // Calculate the complete environment where it is merged in the parent
+    // process (see the process constructor for details).
+    //
+#if defined(LIBBUTL_POSIX_SPAWN) || defined(_WIN32)
+    auto add = [&tevars, &evars, this] (const char* v)
+    {
+      const char* e (strchr (v, '='));
+      size_t n (e != nullptr ? e - v : strlen (v));
+
+      if (!contains_envvar (tevars, v, n) && !contains_envvar (evars, v, n))
+        env_.emplace_back (v);
+    };
+
+#ifndef _WIN32
+    for (const char* const* ev (environ); *ev != nullptr; ++ev)
+      add (*ev);
+#else
+    unique_ptr<char, void (*)(char*)> pevars (
+      GetEnvironmentStringsA (),
+      [] (char* p)
+      {
+        if (p != nullptr && !FreeEnvironmentStringsA (p))
+          assert (false);
+      });
+
+    if (pevars.get () == nullptr)
+      throw process_error (last_error_msg ());
+
+    for (const char* v (pevars.get ()); *v != '\0'; v += strlen (v) + 1)
+      add (v);
+#endif
+
+    auto set_vars = [this] (const char* const* vs,
+                            const char* const* ovs = nullptr)
+    {
+      if (vs != nullptr)
+      {
+        while (const char* v = *vs++)
+        {
+          const char* e (strchr (v, '='));
+          if (e != nullptr && !contains_envvar (ovs, v, e - v))
+            env_.emplace_back (v);
+        }
+      }
+    };
+
+    set_vars (tevars, evars);
+    set_vars (evars);
+
+    env_complete_ = true;
+#else
+    // Note that in the child process the variables are (un)set in order and
+    // so we can capture the thread environment by prepending it to envvars.
+    //
+    for (const char* const* vs: {tevars, evars})
+    {
+      if (vs != nullptr)
+      {
+        while (const char* v = *vs++)
+          env_.emplace_back (v);
+      }
+    }
+
+    env_complete_ = false;
+#endif
+
+    envp_.reserve (env_.size () + 1);
+
+    for (const string& v: env_)
+      envp_.push_back (v.c_str ());
+
+    envp_.push_back (nullptr);
+  }
+
+  process process_spawn_spec::
+  start (const char* const* args, int in, int out, int err) const
+  {
+    using pipe = process::pipe;
+
+    const char* const* envp (!envp_.empty () ? envp_.data () : nullptr);
+
+    return process (path_, args,
+                    pipe (in, -1), pipe (-1, out), pipe (-1, err),
+                    !cwd_.empty () ? cwd_.c_str () : nullptr,
+                    env_complete_ ? nullptr : envp,
+                    env_complete_ ? envp : nullptr,
+                    limits_ ? &*limits_ : nullptr);
+  }
+
+  // process_pipeline
+  //
+  process_pipeline::
+  process_pipeline (const vector<stage>& ss,
+                    int in, int out, int err,
+                    size_t pipe_size)
+  {
+    if (ss.empty ())
+      throw invalid_argument ("empty pipeline");
+
+    // Make sure that the process references stay valid.
+    //
+    processes.reserve (ss.size ());
+
+    for (size_t i (0); i != ss.size (); ++i)
+    {
+      const stage& s (ss[i]);
+
+      process_path sp;
+      if (s.path == nullptr)
+        sp = process::path_search (s.args[0], true /* init */);
+
+      const process_path& pp (s.path != nullptr ? *s.path : sp);
+
+      bool last (i == ss.size () - 1);
+      int o (last ? out : -1);
+
+      if (i == 0)
+        processes.emplace_back (pp, s.args, in, o, err, s.cwd, s.envvars);
+      else
+        processes.emplace_back (pp, s.args,
+                                processes.back (), o, err,
+                                s.cwd, s.envvars);
+
+      if (!last && pipe_size != 0)
+      {
+        try
+        {
+          fdpipe_size (processes.back ().in_ofd.get (), pipe_size);
+        }
+        catch (const ios_base::failure& e)
+        {
+          // Close the pipe not to deadlock while waiting for the process.
+          //
+          processes.back ().in_ofd.reset ();
+
+          throw process_error (e.code ().value ());
+        }
+      }
+    }
+  }
+
+  bool process_pipeline::
+  wait (bool ie)
+  {
+    bool r (true);
+
+    for (auto i (processes.rbegin ()); i != processes.rend (); ++i)
+    {
+      if (!i->wait (ie))
+        r = false;
+    }
+
+    return r;
+  }
+
+  // process_set
+  //
+  void process::
+  reset_termination_fd () noexcept
+  {
+    if (set_ != nullptr)
+      set_->waited (*this); // Resets set_.
+
+    termination_fd_.reset ();
+  }
+
+  process_set::
+  process_set ()
+  try
+  {
+  }
+  catch (const ios_base::failure& e)
+  {
+    throw process_error (e.code ().value ());
+  }
+
+  process_set::
+  ~process_set ()
+  {
+    for (auto& p: procs_)
+      p.second.proc->set_ = nullptr;
+  }
+
+  void process_set::
+  add (process& p, void* data)
+  {
+    if (p.set_ != nullptr)
+      throw invalid_argument ("process is already in a set");
+
+    int fd (p.termination_fd ());
+
+    if (fd != -1)
+    {
+      try
+      {
+        selector_.add_read (fd);
+      }
+      catch (const ios_base::failure& e)
+      {
+        throw process_error (e.code ().value ());
+      }
+
+      procs_.emplace (fd, entry {&p, data});
+      p.set_ = this;
+    }
+    else
+      polled_.push_back (entry {&p, data});
+  }
+
+  void process_set::
+  remove (process& p)
+  {
+    // If the process is being waited on via its termination descriptor,
+    // then find it by this descriptor.
+    //
+    if (p.set_ == this)
+    {
+      int fd (p.termination_fd_.get ());
+
+      procs_.erase (fd);
+      p.set_ = nullptr;
+
+      try
+      {
+        selector_.remove_read (fd);
+      }
+      catch (const ios_base::failure& e)
+      {
+        throw process_error (e.code ().value ());
+      }
+
+      return;
+    }
+
+    // Otherwise, the process is either polled or has been waited for
+    // outside the set.
+    //
+    auto find = [&p] (vector<entry>& es)
+    {
+      return find_if (es.begin (), es.end (),
+                      [&p] (const entry& e) {return e.proc == &p;});
+    };
+
+    auto i (find (polled_));
+    if (i != polled_.end ())
+    {
+      polled_.erase (i);
+      return;
+    }
+
+    i = find (waited_);
+    if (i != waited_.end ())
+    {
+      waited_.erase (i);
+      return;
+    }
+
+    throw invalid_argument ("process is not in the set");
+  }
+
+  void process_set::
+  waited (process& p) noexcept
+  {
+    int fd (p.termination_fd_.get ());
+    auto i (procs_.find (fd));
+
+    assert (i != procs_.end ());
+
+    // Note that the descriptor is not closed yet and so its removal from
+    // the selector shouldn't fail. But if it does nevertheless, it is
+    // removed anyway (see fdselector::remove_read() for details).
+    //
+    try
+    {
+      selector_.remove_read (fd);
+    }
+    catch (const ios_base::failure&) {}
+
+    waited_.push_back (i->second);
+    procs_.erase (i);
+    p.set_ = nullptr;
+  }
+
+  void process_set::
+  add_read (int fd, void* data)
+  {
+    try
+    {
+      selector_.add_read (fd, data);
+    }
+    catch (const ios_base::failure& e)
+    {
+      throw process_error (e.code ().value ());
+    }
+
+    ++fds_;
+  }
+
+  void process_set::
+  remove_read (int fd)
+  {
+    if (procs_.find (fd) != procs_.end ())
+      throw invalid_argument ("file descriptor is not added");
+
+    try
+    {
+      selector_.remove_read (fd);
+    }
+    catch (const ios_base::failure& e)
+    {
+      throw process_error (e.code ().value ());
+    }
+
+    --fds_;
+  }
+
+  pair<size_t, size_t> process_set::
+  wait (const chrono::milliseconds* timeout)
+  {
+    using namespace chrono;
+
+    if (empty ())
+      throw invalid_argument ("empty process set");
+
+    terminated_.clear ();
+    read_ready_.clear ();
+
+    // Move the processes that have been waited for outside the set and the
+    // terminated polled processes into the terminated list.
+    //
+    auto poll = [this] ()
+    {
+      if (!waited_.empty ())
+      {
+        terminated_.insert (terminated_.end (),
+                            waited_.begin (), waited_.end ());
+        waited_.clear ();
+      }
+
+      for (auto i (polled_.begin ()); i != polled_.end (); )
+      {
+        if (i->proc->try_wait ())
+        {
+          terminated_.push_back (*i);
+          i = polled_.erase (i);
+        }
+        else
+          ++i;
+      }
+    };
+
+    // Note that we don't calculate the deadline since the timeout can be
+    // as large as milliseconds::max() (see process::timed_wait() for
+    // details).
+    //
+    optional<milliseconds> d;
+    if (timeout)
+      d = *timeout;
+
+    // The polling interval for processes without the termination descriptor.
+    //
+    const milliseconds pd (10);
+
+    for (;;)
+    {
+      poll ();
+
+      // Note that if some processes have terminated, then we still check the
+      // descriptors but don't block.
+      //
+      milliseconds zero (0);
+      const milliseconds* t (d ? &*d : nullptr);
+
+      if (!terminated_.empty ())
+        t = &zero;
+      else if (!polled_.empty () && (t == nullptr || *t > pd))
+        t = &pd;
+
+      auto s (steady_clock::now ());
+
+      if (!selector_.empty ())
+      {
+        try
+        {
+          if (t != nullptr)
+            selector_.wait (*t);
+          else
+            selector_.wait ();
+        }
+        catch (const ios_base::failure& e)
+        {
+          throw process_error (e.code ().value ());
+        }
+
+        for (const fdselect_state& fs: selector_.read_ready ())
+        {
+          auto i (procs_.find (fs.fd));
+
+          if (i == procs_.end ())
+          {
+            read_ready_.push_back (fs);
+            continue;
+          }
+
+          // Note that try_wait() closes the termination descriptor, so we
+          // need to remove it from the selector first. Also detach the
+          // process from the set so that it doesn't notify us about this
+          // wait and so that it is no longer in the set if try_wait() throws.
+          //
+          entry pe (i->second);
+          procs_.erase (i);
+
+          process& p (*pe.proc);
+          p.set_ = nullptr;
+
+          try
+          {
+            selector_.remove_read (fs.fd);
+          }
+          catch (const ios_base::failure& e)
+          {
+            throw process_error (e.code ().value ());
+          }
+
+          if (p.try_wait ())
+            terminated_.push_back (pe);
+          else
+            add (p, pe.data); // Shouldn't happen but who knows.
+        }
+      }
+      else if (t->count () != 0)
+      {
+        // Only polled processes are in the set, so the timeout is not NULL.
+        //
+#ifndef _WIN32
+        this_thread::sleep_for (*t);
+#else
+        Sleep (static_cast<DWORD> (t->count ()));
+#endif
+      }
+
+      if (!terminated_.empty () || !read_ready_.empty ())
+        break;
+
+      poll ();
+
+      if (!terminated_.empty ())
+        break;
+
+      if (d)
+      {
+        milliseconds e (
+          duration_cast<milliseconds> (steady_clock::now () - s));
+
+        if (e >= *d)
+          break;
+
+        *d -= e;
+      }
+    }
+
+    return make_pair (terminated_.size (), read_ready_.size ());
+  }
 }
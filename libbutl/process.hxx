@@ -11,9 +11,12 @@
 #include <vector>
 #include <chrono>
 #include <ostream>
+#include <utility>      // move()
+#include <functional>
 #include <cstddef>      // size_t
 #include <cstdint>      // uint32_t
 #include <system_error>
+#include <unordered_map>
 
 #include <libbutl/path.hxx>
 #include <libbutl/optional.hxx>
@@ -135,6 +138,92 @@ namespace butl
     const char** args0_ = nullptr;
   };
 
+  // Process resource usage statistics.
+  //
+  struct process_stats
+  {
+    // Time from the process startup until its termination. Note that on
+    // POSIX it is measured until the termination is observed by the parent
+    // (see process::wait() for details).
+    //
+    std::chrono::nanoseconds wall_time;
+
+    // CPU time spent in the user and kernel modes.
+    //
+    std::chrono::microseconds user_time;
+    std::chrono::microseconds system_time;
+
+    // Peak resident set size (peak working set size on Windows) in bytes.
+    //
+    std::uint64_t max_rss;
+
+    // Number of block input and output operations (all read and write
+    // operations on Windows).
+    //
+    std::uint64_t input_ops;
+    std::uint64_t output_ops;
+
+    // Number of voluntary and involuntary context switches (always 0 on
+    // Windows).
+    //
+    std::uint64_t voluntary_switches;
+    std::uint64_t involuntary_switches;
+  };
+
+  // Resource usage summary, for example:
+  //
+  // "wall 1.52s, user 1.31s, system 0.15s, max rss 120.3MB, i/o 0/24,
+  //  context switches 3/17"
+  //
+  // So you would normally do:
+  //
+  // process_exit e (process_run (...));
+  //
+  // if (e.stats)
+  //   cerr << args[0] << ": " << *e.stats << endl;
+  //
+  LIBBUTL_SYMEXPORT std::string
+  to_string (const process_stats&);
+
+  inline std::ostream&
+  operator<< (std::ostream& os, const process_stats& ps)
+  {
+    return os << to_string (ps);
+  }
+
+  // Child process resource limits.
+  //
+  // The address space (in bytes), CPU time (in seconds), and open files
+  // limits are set with setrlimit() as both the soft and hard limits (so
+  // exceeding the CPU time limit results in SIGXCPU and then SIGKILL).
+  //
+  // On Linux the child process can also be placed into the cgroup v2
+  // directory (by writing to its cgroup.procs file) which should be created
+  // and configured (memory.max, cpu.max, etc) by the caller. Note that the
+  // directory should be writable by the current user and the current process
+  // must have permissions to move processes from its own cgroup.
+  //
+  // The limits are applied in the child process before exec() and so their
+  // presence currently forces the fork()-based implementation instead of
+  // posix_spawn(). Specifying any limits is not supported on Windows and
+  // specifying the cgroup is only supported on Linux (process_error with
+  // ENOTSUP is thrown otherwise).
+  //
+  struct process_limits
+  {
+    optional<std::uint64_t> address_space; // RLIMIT_AS
+    optional<std::uint64_t> cpu_time;      // RLIMIT_CPU
+    optional<std::uint64_t> open_files;    // RLIMIT_NOFILE
+
+    optional<dir_path> cgroup;
+
+    bool
+    empty () const
+    {
+      return !address_space && !cpu_time && !open_files && !cgroup;
+    }
+  };
+
   // Process exit information.
   //
   struct LIBBUTL_SYMEXPORT process_exit
@@ -213,6 +302,12 @@ namespace butl
     //
     std::string
     description () const;
+
+    // Resource usage statistics of the terminated process. Absent if not
+    // available (for example, the process exit information was created
+    // rather than obtained by waiting for the process).
+    //
+    optional<process_stats> stats;
   };
 
   // Canonical exit status description:
@@ -233,6 +328,8 @@ namespace butl
     return os << to_string (pe);
   }
 
+  class process_set;
+
   class LIBBUTL_SYMEXPORT process
   {
   public:
@@ -294,6 +391,9 @@ namespace butl
     // ifdstream es (move (pr.in_efd));
     // ofdstream os (move (pr.out_fd));
     //
+    // Alternatively, use process_capture() to drain multiple pipes
+    // concurrently.
+    //
     // The cwd argument allows to change the current working directory of the
     // child process. NULL and empty arguments are ignored.
     //
@@ -408,6 +508,21 @@ namespace butl
              const char* cwd = nullptr,
              const char* const* envvars = nullptr);
 
+    // As above but also apply the resource limits in the child process (see
+    // process_limits for details).
+    //
+    process (const process_path&, const char* const*,
+             pipe in, pipe out, pipe err,
+             const char* cwd,
+             const char* const* envvars,
+             const process_limits&);
+
+    process (const process_path&, const char* const*,
+             int in, int out, int err,
+             const char* cwd,
+             const char* const* envvars,
+             const process_limits&);
+
     // The "piping" constructor, for example:
     //
     // process lhs (..., 0, -1); // Redirect stdout to a pipe.
@@ -452,6 +567,12 @@ namespace butl
     // be called multiple times with subsequent calls simply returning the
     // status.
     //
+    // Note that the resource usage statistics are also collected (see
+    // process_exit::stats) and on POSIX the wall time is measured until the
+    // termination is observed by this function (or by try_wait(), etc).
+    // Thus, for accurate results, you may want to wait for the termination
+    // with process_set or via termination_fd().
+    //
     bool
     wait (bool ignore_errors = false);
 
@@ -465,10 +586,35 @@ namespace butl
     // duration. Return the same result as wait() if the process has
     // terminated in this timeframe and nullopt otherwise.
     //
+    // Note that on Linux and BSDs/MacOS the termination is waited for using
+    // the termination descriptor (see below) rather than polling.
+    //
     template <typename R, typename P>
     optional<bool>
     timed_wait (const std::chrono::duration<R, P>&);
 
+    // Return the file descriptor that becomes ready for reading when the
+    // process terminates, creating it on the first call. Return -1 if the
+    // process has already been waited for or if such a descriptor is not
+    // supported on this platform. Throw process_error if anything goes wrong.
+    //
+    // This descriptor allows to wait for the process termination together
+    // with other descriptors, such as the child's stdout/stderr pipe ends
+    // (see fdselect() and fdselector for details). Once it is ready, call
+    // wait() or try_wait() to obtain the exit status.
+    //
+    // Note that the descriptor is owned by the process object and is closed
+    // when the process is waited for, so it should be removed from fdselector
+    // before that.
+    //
+    // Currently this is supported on Linux 5.3 and later (pidfd) and on
+    // FreeBSD, NetBSD, OpenBSD, and MacOS (kqueue). Note that on Linux -1 is
+    // also returned if pidfd_open() is not permitted (for example, in a
+    // container with a seccomp profile that predates it).
+    //
+    int
+    termination_fd ();
+
     // Note that the destructor will wait for the process but will ignore
     // any errors and the exit status.
     //
@@ -596,6 +742,44 @@ namespace butl
                      bool = false,
                      const char* = nullptr);
 
+    // Enable/disable the process-wide cache of the path_search() and
+    // try_path_search() results and return the previous value.
+    //
+    // The results are cached by the file name, the list of paths to search
+    // in, and the fallback directory. A cached result is returned as is for
+    // up to one second since it was last validated, after which it is
+    // revalidated by the next lookup and invalidated if the modification
+    // time of any of the directories that were searched changes (an
+    // executable is added, removed, renamed, etc) or the found file is no
+    // longer executable. Note that such changes are therefore only noticed
+    // with up to a second delay and that making a file executable in an
+    // earlier searched directory does not invalidate the cached result. Also
+    // note that only the search in the absolute paths is cached (a file
+    // with a directory component or a list of paths that contains relative
+    // or empty paths is always searched for).
+    //
+    // Currently the cache is only implemented on POSIX and on Windows
+    // enabling it has no effect.
+    //
+    static bool
+    path_cache (bool);
+
+    struct path_cache_stats_type
+    {
+      std::uint64_t hits = 0;
+      std::uint64_t misses = 0;        // Including the invalidated entries.
+      std::uint64_t invalidations = 0;
+      std::size_t   entries = 0;
+    };
+
+    static path_cache_stats_type
+    path_cache_stats ();
+
+    // Drop all the cached results and reset the counters.
+    //
+    static void
+    path_cache_clear ();
+
     // Print process commmand line. If the number of elements is specified,
     // then it will print the piped multi-process command line, if present.
     // In this case, the expected format is as follows:
@@ -619,6 +803,29 @@ namespace butl
     quote_argument (const char*, std::string& buffer, bool batch);
 #endif
 
+    // Enable/disable concurrent child process startup and return the
+    // previous value.
+    //
+    // By default, the child process startup is serialized (across all
+    // threads) in order to prevent file descriptors that are being created
+    // without the close-on-exec flag in other threads from leaking into the
+    // child. If this flag is set, then the startup is not serialized where
+    // the library itself creates all its file descriptors with the
+    // close-on-exec flag set atomically (currently Linux and FreeBSD with
+    // posix_spawn() available) and, on other platforms, is ignored. Note
+    // that before setting it the application must make sure that it does
+    // the same (opens files with O_CLOEXEC, creates pipes with pipe2(),
+    // etc). Also note that with concurrent startup a child process may
+    // briefly hold a copy of the write descriptor of an executable being
+    // written by another thread. To mitigate this, the startup of such an
+    // executable is retried on the "text file busy" (ETXTBSY) failure.
+    //
+    static bool
+    concurrent_startup (bool);
+
+    static bool
+    concurrent_startup ();
+
   public:
     id_type
     id () const;
@@ -643,6 +850,340 @@ namespace butl
     auto_fd out_fd; // Write to it to send to stdin.
     auto_fd in_ofd; // Read from it to receive from stdout.
     auto_fd in_efd; // Read from it to receive from stderr.
+
+  private:
+    friend class process_set;
+    friend class process_spawn_spec;
+
+    // As the above constructors but if env is not NULL, then use it as the
+    // complete child process environment (NULL-terminated list of the
+    // "name=value" strings), ignoring envvars and the thread environment.
+    // If limits is not NULL, then apply them in the child process.
+    //
+    process (const process_path&, const char* const* args,
+             pipe in, pipe out, pipe err,
+             const char* cwd,
+             const char* const* envvars,
+             const char* const* env,
+             const process_limits* limits);
+
+  private:
+    // Close the termination descriptor, notifying the process set this
+    // process is in, if any.
+    //
+    void
+    reset_termination_fd () noexcept;
+
+    auto_fd termination_fd_;
+    process_set* set_ = nullptr; // Set waiting on termination_fd_, if any.
+
+#ifndef _WIN32
+    std::chrono::steady_clock::time_point start_time_;
+#endif
+  };
+
+  // Reusable child process startup specification.
+  //
+  // Resolve the program path, calculate the child process environment, etc.,
+  // once and then start any number of processes that only differ in the
+  // command line arguments. For example:
+  //
+  // const char* vars[] = {"LC_ALL=C", nullptr};
+  // process_spawn_spec s ("g++", 0, -1, 2, nullptr /* cwd */, vars);
+  //
+  // for (...)
+  // {
+  //   const char* args[] = {"g++", "-c", ..., nullptr};
+  //   process pr (s.start (args));
+  //   ...
+  // }
+  //
+  class LIBBUTL_SYMEXPORT process_spawn_spec
+  {
+  public:
+    // The in, out, err, cwd, and envvars arguments have the same semantics
+    // as in the process constructor. Note that the specified file
+    // descriptors, if any, must stay open while the processes are started.
+    //
+    // Note that the current thread's working directory and environment
+    // overrides (see auto_thread_env) are captured on construction. Where
+    // the environment is merged in the parent process (POSIX with
+    // posix_spawn() and Windows), the complete child process environment is
+    // calculated on construction and the subsequent changes to the current
+    // process environment are not reflected. Otherwise, the envvars are
+    // applied on the process startup, as usual.
+    //
+    // If limits is not NULL, then apply them to every started process (see
+    // process_limits for details).
+    //
+    // Throw process_error if anything goes wrong.
+    //
+    process_spawn_spec (process_path,
+                        int in = 0, int out = 1, int err = 2,
+                        const char* cwd = nullptr,
+                        const char* const* envvars = nullptr,
+                        const process_limits* limits = nullptr);
+
+    // As above but search for the program (see process::path_search() for
+    // details).
+    //
+    explicit
+    process_spawn_spec (const char* program,
+                        int in = 0, int out = 1, int err = 2,
+                        const char* cwd = nullptr,
+                        const char* const* envvars = nullptr,
+                        const process_limits* limits = nullptr);
+
+    // Start the process with the specified command line (args[0] should
+    // refer to the program the same way as for the process constructor).
+    // Throw process_error if anything goes wrong.
+    //
+    process
+    start (const char* const* args) const
+    {
+      return start (args, in_, out_, err_);
+    }
+
+    process
+    start (const std::vector<const char*>& args) const
+    {
+      return start (args.data ());
+    }
+
+    // As above but override the redirects specified on construction.
+    //
+    process
+    start (const char* const* args, int in, int out, int err) const;
+
+    const process_path&
+    path () const {return path_;}
+
+  private:
+    process_path path_;
+
+    int in_;
+    int out_;
+    int err_;
+
+    std::string cwd_;
+
+    // The complete environment, if env_complete_ is true, and envvars
+    // otherwise. Both are NULL-terminated, if not empty.
+    //
+    std::vector<std::string> env_;
+    std::vector<const char*> envp_;
+    bool env_complete_ = false;
+
+    optional<process_limits> limits_;
+  };
+
+  // Multi-stage pipeline of processes, with the stdout of each stage
+  // connected to the stdin of the next stage via a pipe. For example:
+  //
+  // const char* args1[] = {"cat", "-", nullptr};
+  // const char* args2[] = {"gzip", "-c", nullptr};
+  //
+  // process_pipeline pl ({{nullptr, args1}, {nullptr, args2}},
+  //                      -1 /* in */, -1 /* out */, 2 /* err */,
+  //                      1024 * 1024 /* pipe_size */);
+  //
+  // ofdstream os (move (pl.processes.front ().out_fd));
+  // ifdstream is (move (pl.processes.back ().in_ofd));
+  // ...
+  // pl.wait ();
+  //
+  class LIBBUTL_SYMEXPORT process_pipeline
+  {
+  public:
+    struct stage
+    {
+      // If the path is NULL, then search for args[0] (see
+      // process::path_search() for details).
+      //
+      const process_path* path;
+      const char* const* args;
+
+      const char* cwd = nullptr;
+      const char* const* envvars = nullptr;
+    };
+
+    // Start the pipeline stages. The in argument is for the first stage
+    // stdin, out -- for the last stage stdout, and err -- for stderr of all
+    // the stages and have the same semantics as in the process constructor.
+    // If pipe_size is not 0, then change the capacity of the pipes between
+    // the stages to be at least that many bytes, where supported (see
+    // fdpipe_size() for details).
+    //
+    // Throw process_error if anything goes wrong and std::invalid_argument
+    // if there are no stages. Note that in the former case the already
+    // started processes are waited for.
+    //
+    process_pipeline (const std::vector<stage>&,
+                      int in = 0, int out = 1, int err = 2,
+                      std::size_t pipe_size = 0);
+
+    // Wait for all the processes to terminate, last first. Return true if
+    // all of them terminated normally and with the zero exit code (see
+    // process::wait() for details).
+    //
+    bool
+    wait (bool ignore_errors = false);
+
+  public:
+    // Note that the pipes between the stages are owned by the processes and
+    // the pipes to/from the pipeline (see the above constructor), if any,
+    // are accessible via out_fd of the first process, in_ofd of the last
+    // process, and in_efd of each process.
+    //
+    std::vector<process> processes;
+  };
+
+  // Set of processes being waited for termination, optionally together with
+  // other file descriptors (for example, the processes' output pipe ends).
+  //
+  // The termination is waited for using the processes' termination
+  // descriptors (see process::termination_fd()) and fdselector, so the wait
+  // time is proportional to the number of terminated processes and ready
+  // descriptors rather than to their total number. Processes for which the
+  // termination descriptor is not available (Windows, etc) are polled with
+  // try_wait().
+  //
+  // Note that the set doesn't own the processes and they should not be
+  // moved or destroyed while in the set.
+  //
+  // For example:
+  //
+  // process_set ps;
+  //
+  // for (process& p: procs)
+  //   ps.add (p);
+  //
+  // while (!ps.empty ())
+  // {
+  //   ps.wait ();
+  //
+  //   for (const process_set::entry& e: ps.terminated ())
+  //     ... *e.proc->exit ...
+  // }
+  //
+  class LIBBUTL_SYMEXPORT process_set
+  {
+  public:
+    struct entry
+    {
+      butl::process* proc;
+      void* data; // Arbitrary data which can be associated with the process.
+    };
+
+    // Throw process_error if anything goes wrong.
+    //
+    process_set ();
+
+    ~process_set ();
+
+    process_set (const process_set&) = delete;
+    process_set& operator= (const process_set&) = delete;
+
+    // Add the process to the set, associating arbitrary data with it. Throw
+    // process_error if anything goes wrong and std::invalid_argument if the
+    // process is already in a (potentially other) set.
+    //
+    // Note that adding an already waited for process is not an error and
+    // results in it being reported as terminated by the next wait() call.
+    // The process can also be waited for outside the set (wait(), try_wait(),
+    // etc) while in the set, in which case it is likewise reported as
+    // terminated by the next wait() call. Note, however, that such an
+    // outside wait must not happen concurrently with the set's wait().
+    //
+    void
+    add (butl::process&, void* data = nullptr);
+
+    // Remove the process from the set. Throw std::invalid_argument if the
+    // process is not in the set.
+    //
+    // Note that removing a process with the termination descriptor takes
+    // constant time while for the polled processes it is proportional to
+    // their number.
+    //
+    void
+    remove (butl::process&);
+
+    // Start/stop waiting for the file descriptor to become ready for reading
+    // (see fdselector for details).
+    //
+    void
+    add_read (int fd, void* data = nullptr);
+
+    void
+    remove_read (int fd);
+
+    // Return true if there are no processes and file descriptors in the set.
+    //
+    bool
+    empty () const {return size () == 0 && fds_ == 0;}
+
+    // Return the number of processes in the set.
+    //
+    std::size_t
+    size () const
+    {
+      return procs_.size () + polled_.size () + waited_.size ();
+    }
+
+    // Wait until one or more processes terminate or file descriptors become
+    // ready for reading. Return the pair of numbers of the terminated
+    // processes and the ready descriptors and save them in the respective
+    // lists (see below). Throw std::invalid_argument if the set is empty.
+    // Throw process_error if anything goes wrong.
+    //
+    // Note that the terminated processes are removed from the set and their
+    // exit information is available (see process::exit). The file
+    // descriptors stay in the set.
+    //
+    std::pair<std::size_t, std::size_t>
+    wait () {return wait (nullptr);}
+
+    // As above but wait up to the specified timeout returning a pair of
+    // zeroes if nothing happened.
+    //
+    template <typename R, typename P>
+    std::pair<std::size_t, std::size_t>
+    wait (const std::chrono::duration<R, P>& timeout)
+    {
+      using namespace std::chrono;
+      milliseconds t (duration_cast<milliseconds> (timeout));
+      return wait (&t);
+    }
+
+    // The processes that terminated and the descriptors that became ready
+    // during the last wait() call. Note: cleared on each call.
+    //
+    const std::vector<entry>&
+    terminated () const {return terminated_;}
+
+    const fdselect_set&
+    read_ready () const {return read_ready_;}
+
+  private:
+    std::pair<std::size_t, std::size_t>
+    wait (const std::chrono::milliseconds*);
+
+    // Called by the process that is being waited for outside the set right
+    // before its termination descriptor is closed.
+    //
+    friend class process;
+
+    void
+    waited (butl::process&) noexcept;
+
+    fdselector selector_;
+    std::size_t fds_ = 0;                  // Number of non-process fds.
+    std::unordered_map<int, entry> procs_; // By termination descriptor.
+    std::vector<entry> polled_;            // Without termination descriptor.
+    std::vector<entry> waited_;            // Waited for outside the set.
+
+    std::vector<entry> terminated_;
+    fdselect_set read_ready_;
   };
 
   // Higher-level process running interface that aims to make executing a
@@ -671,9 +1212,10 @@ namespace butl
   //
   struct process_env
   {
-    const process_path* path;
-    const dir_path*     cwd  = nullptr;
-    const char* const*  vars = nullptr;
+    const process_path*   path;
+    const dir_path*       cwd    = nullptr;
+    const char* const*    vars   = nullptr;
+    const process_limits* limits = nullptr; // See process_limits.
 
     // Return true if there is an "environment", that is, either the current
     // working directory or environment variables.
@@ -873,6 +1415,119 @@ namespace butl
                           const process_env&,
                           A&&... args);
 
+  // Start a batch of processes running the same program in the same
+  // environment, returning them in the job order. For example:
+  //
+  // process_env env ("g++");
+  //
+  // vector<process_job> jobs;
+  // for (const cstrings& args: cmds) // args[0] is env.path->recall_string ()
+  //   jobs.push_back ({args.data (), 0, -1, 2});
+  //
+  // vector<process> prs (process_start_batch (env, jobs));
+  //
+  // Compared to calling process_start() in a loop, the program path, the
+  // working directory, and the environment are resolved/merged only once
+  // (see process_spawn_spec for details).
+  //
+  // The job args are the complete command line with args[0] referring to
+  // the program (normally its recall path) and the in/out/err redirects
+  // have the same semantics as in the process constructor (so -1 creates a
+  // pipe).
+  //
+  // If any of the processes fails to start, then close the pipe ends of the
+  // already started processes, wait for them, and rethrow process_error.
+  // Note that the caller still owns the redirect descriptors and should
+  // close them after this function returns.
+  //
+  struct process_job
+  {
+    const char* const* args;
+    int in = 0;
+    int out = 1;
+    int err = 2;
+  };
+
+  LIBBUTL_SYMEXPORT std::vector<process>
+  process_start_batch (const process_env&, const std::vector<process_job>&);
+
+  // Drain the read ends of the started process pipes concurrently and in a
+  // single thread until all of them reach eof, passing the data to the
+  // caller-supplied sinks. This is the deadlock-free way to capture, for
+  // example, both stdout and stderr of a child without resorting to a thread
+  // per stream or to the skip mode ordering (see process::process() for
+  // details). For example:
+  //
+  // fdpipe op (fdopen_pipe ());
+  // fdpipe ep (fdopen_pipe ());
+  //
+  // process pr (process_start (fdopen_null (), op, ep, env, args...));
+  //
+  // op.out.close ();
+  // ep.out.close ();
+  //
+  // string out;
+  // process_sinks ss;
+  // ss.emplace_back (move (op.in), out);
+  // ss.emplace_back (move (ep.in), cerr);
+  //
+  // process_capture (ss);
+  // pr.wait ();
+  //
+  // The data is read in the non-blocking mode into a fixed-size buffer which
+  // is then passed to the sink. The sink can be a string (optionally limited
+  // in size, with the excess data read and discarded), an output stream (for
+  // example, ofdstream for a file), or a callback. As a result, the memory
+  // usage is bounded unless an unlimited string sink is used.
+  //
+  // Note that the sinks receive the data as is, without any newline
+  // translation, so you may want to put the descriptors into the binary mode
+  // on Windows, if required.
+  //
+  // Throw ios::failure on the underlying OS error as well as any exception
+  // thrown by a sink, in which case the remaining descriptors are closed. If
+  // the output stream sink fails without throwing, the rest of its data is
+  // discarded.
+  //
+  class LIBBUTL_SYMEXPORT process_sink
+  {
+  public:
+    using callback_type = std::function<void (const char*, std::size_t)>;
+
+    process_sink (auto_fd&& in,
+                  std::string& s,
+                  std::size_t limit = std::string::npos)
+        : in (std::move (in)), string_ (&s), limit_ (limit) {}
+
+    process_sink (auto_fd&& in, std::ostream& os)
+        : in (std::move (in)), stream_ (&os) {}
+
+    process_sink (auto_fd&& in, callback_type cb)
+        : in (std::move (in)), callback_ (std::move (cb)) {}
+
+    // Consume the chunk of data.
+    //
+    void
+    write (const char*, std::size_t);
+
+    auto_fd in;
+
+    // True if the string sink data was truncated due to its size limit.
+    //
+    bool truncated = false;
+
+  private:
+    std::string*  string_ = nullptr;
+    std::size_t   limit_ = std::string::npos;
+    std::ostream* stream_ = nullptr;
+    callback_type callback_;
+  };
+
+  using process_sinks = small_vector<process_sink, 2>;
+
+  LIBBUTL_SYMEXPORT void
+  process_capture (process_sinks&);
+
   // Call the callback without actually running/starting anything.
   //
   template <typename C,
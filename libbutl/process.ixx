@@ -218,6 +218,49 @@ namespace butl
   {
   }
 
+  inline process::
+  process (const process_path& pp, const char* const* args,
+           pipe in, pipe out, pipe err,
+           const char* cwd,
+           const char* const* envvars)
+      : process (pp, args,
+                 std::move (in), std::move (out), std::move (err),
+                 cwd,
+                 envvars,
+                 nullptr /* env */,
+                 nullptr /* limits */)
+  {
+  }
+
+  inline process::
+  process (const process_path& pp, const char* const* args,
+           pipe in, pipe out, pipe err,
+           const char* cwd,
+           const char* const* envvars,
+           const process_limits& limits)
+      : process (pp, args,
+                 std::move (in), std::move (out), std::move (err),
+                 cwd,
+                 envvars,
+                 nullptr /* env */,
+                 &limits)
+  {
+  }
+
+  inline process::
+  process (const process_path& pp, const char* const* args,
+           int in, int out, int err,
+           const char* cwd,
+           const char* const* envvars,
+           const process_limits& limits)
+      : process (pp, args,
+                 pipe (in, -1), pipe (-1, out), pipe (-1, err),
+                 cwd,
+                 envvars,
+                 limits)
+  {
+  }
+
   inline process::
   process (const process_path& pp, const char* const* args,
            int in, int out, int err,
@@ -416,7 +459,11 @@ namespace butl
         exit   (std::move (p.exit)),
         out_fd (std::move (p.out_fd)),
         in_ofd (std::move (p.in_ofd)),
-        in_efd (std::move (p.in_efd))
+        in_efd (std::move (p.in_efd)),
+        termination_fd_ (std::move (p.termination_fd_))
+#ifndef _WIN32
+      , start_time_ (p.start_time_)
+#endif
   {
     p.handle = 0;
   }
@@ -434,6 +481,10 @@ namespace butl
       out_fd = std::move (p.out_fd);
       in_ofd = std::move (p.in_ofd);
       in_efd = std::move (p.in_efd);
+      termination_fd_ = std::move (p.termination_fd_);
+#ifndef _WIN32
+      start_time_ = p.start_time_;
+#endif
 
       p.handle = 0;
     }
@@ -470,6 +521,7 @@ namespace butl
     if (this != &e)
     {
       cwd = e.cwd;
+      limits = e.limits;
 
       bool sp (e.path == &e.path_);
       path_ = std::move (e.path_);
@@ -21,21 +21,317 @@ extern "C"
   static void SHA256_Update (SHA256_CTX*, const void*, size_t);
   static void SHA256_Final (uint8_t[32], SHA256_CTX*);
 
+  // Block compression function dispatched at runtime (see below).
+  //
+  static void sha256_transform (uint32_t*, const unsigned char*, size_t);
+
+#define SHA256_TRANSFORM sha256_transform
 #include "sha256c.c"
 }
 
+// On x86-64 use the SHA extensions (SHA-NI), if supported by the CPU.
+//
+#if defined(__x86_64__) || defined(_M_X64)
+#  define LIBBUTL_SHA256_NI
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h> // __cpuid(), __cpuidex()
+#  else
+#    include <cpuid.h>  // __get_cpuid(), __get_cpuid_max(), __cpuid_count()
+#  endif
+#  if defined(__GNUC__) || defined(__clang__)
+#    define LIBBUTL_SHA256_NI_TARGET __attribute__ ((target ("sha,sse4.1")))
+#  else
+#    define LIBBUTL_SHA256_NI_TARGET
+#  endif
+#endif
+
 #include <cctype>    // isxdigit()
+#include <atomic>
 #include <cassert>
+#include <limits>    // numeric_limits
+#include <algorithm> // min()
 #include <istream>
+#include <functional>
 #include <stdexcept> // invalid_argument
+#include <system_error>
+
+#ifndef LIBBUTL_MINGW_STDTHREAD
+#  include <thread>
+#else
+#  include <libbutl/mingw-thread.hxx>
+#endif
 
 #include <libbutl/utility.hxx>      // *case()
 #include <libbutl/bufstreambuf.hxx>
+#include <libbutl/hash-details.hxx>
 
 using namespace std;
 
+static atomic<bool> sha256_hw (true);
+
+#ifdef LIBBUTL_SHA256_NI
+// Return true if the CPU supports the SHA extensions as well as SSSE3 and
+// SSE4.1 which are used alongside.
+//
+static bool
+sha256_ni_supported ()
+{
+  uint32_t r[4]; // eax, ebx, ecx, edx
+
+  auto cpuid = [&r] (uint32_t leaf) -> bool
+  {
+#ifdef _MSC_VER
+    int v[4];
+    __cpuid (v, 0);
+
+    if (static_cast<uint32_t> (v[0]) < leaf)
+      return false;
+
+    __cpuidex (v, static_cast<int> (leaf), 0);
+
+    for (size_t i (0); i != 4; ++i)
+      r[i] = static_cast<uint32_t> (v[i]);
+#else
+    if (__get_cpuid_max (0, nullptr) < leaf)
+      return false;
+
+    __cpuid_count (leaf, 0, r[0], r[1], r[2], r[3]);
+#endif
+    return true;
+  };
+
+  return cpuid (1)                 &&
+         (r[2] & (1U << 9))  != 0  && // SSSE3
+         (r[2] & (1U << 19)) != 0  && // SSE4.1
+         cpuid (7)                 &&
+         (r[1] & (1U << 29)) != 0;    // SHA
+}
+
+alignas (16) static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+// The SHA-NI block compression function building blocks. The state is kept
+// in the ABEF/CDGH form expected by the SHA256RNDS2 instruction while
+// processing the blocks. The L argument is the lane suffix which allows to
+// interleave the processing of multiple independent messages.
+//
+// Note that we cannot use lambdas or non-inline functions since they don't
+// inherit the target attribute.
+//
+#define SHA256_NI_LOAD_STATE(L, state)                                  \
+  t##L    = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (state)); \
+  cdgh##L = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (state + 4)); \
+  t##L    = _mm_shuffle_epi32 (t##L, 0xb1);             /* CDAB */      \
+  cdgh##L = _mm_shuffle_epi32 (cdgh##L, 0x1b);          /* EFGH */      \
+  abef##L = _mm_alignr_epi8 (t##L, cdgh##L, 8);         /* ABEF */      \
+  cdgh##L = _mm_blend_epi16 (cdgh##L, t##L, 0xf0);      /* CDGH */
+
+#define SHA256_NI_STORE_STATE(L, state)                                 \
+  t##L    = _mm_shuffle_epi32 (abef##L, 0x1b);          /* FEBA */      \
+  cdgh##L = _mm_shuffle_epi32 (cdgh##L, 0xb1);          /* DCHG */      \
+  _mm_storeu_si128 (reinterpret_cast<__m128i*> (state),                 \
+                    _mm_blend_epi16 (t##L, cdgh##L, 0xf0)); /* DCBA */  \
+  _mm_storeu_si128 (reinterpret_cast<__m128i*> (state + 4),             \
+                    _mm_alignr_epi8 (cdgh##L, t##L, 8));    /* HGFE */
+
+// Load the message words (w) at the specified offset converting them from
+// big-endian and perform 4 rounds with them.
+//
+#define SHA256_NI_LOAD(L, w, o)                                         \
+  w##L = _mm_shuffle_epi8 (                                             \
+    _mm_loadu_si128 (reinterpret_cast<const __m128i*> (src##L + o)), mask);
+
+// Perform 4 rounds with the message schedule words w (W[i..i+3]).
+//
+#define SHA256_NI_QROUND(L, w, i)                                       \
+  t##L    = _mm_add_epi32 (                                             \
+    w##L, _mm_load_si128 (reinterpret_cast<const __m128i*> (sha256_k + i))); \
+  cdgh##L = _mm_sha256rnds2_epu32 (cdgh##L, abef##L, t##L);             \
+  t##L    = _mm_shuffle_epi32 (t##L, 0x0e);                             \
+  abef##L = _mm_sha256rnds2_epu32 (abef##L, cdgh##L, t##L);
+
+// Calculate the next message schedule words (wn, already passed through
+// SHA256MSG1) from the current (w) and previous (wp) ones.
+//
+#define SHA256_NI_MSG2(L, wn, w, wp)                                    \
+  wn##L = _mm_sha256msg2_epu32 (                                        \
+    _mm_add_epi32 (wn##L, _mm_alignr_epi8 (w##L, wp##L, 4)), w##L);
+
+#define SHA256_NI_MSG1(L, wp, w) wp##L = _mm_sha256msg1_epu32 (wp##L, w##L);
+
+// The 16 steps of 4 rounds each. The first 4 steps load the message words,
+// the rest use the calculated schedule.
+//
+#define SHA256_NI_STEP0(L)                                              \
+  SHA256_NI_LOAD (L, m0,  0) SHA256_NI_QROUND (L, m0,  0)
+#define SHA256_NI_STEP1(L)                                              \
+  SHA256_NI_LOAD (L, m1, 16) SHA256_NI_QROUND (L, m1,  4)               \
+  SHA256_NI_MSG1 (L, m0, m1)
+#define SHA256_NI_STEP2(L)                                              \
+  SHA256_NI_LOAD (L, m2, 32) SHA256_NI_QROUND (L, m2,  8)               \
+  SHA256_NI_MSG1 (L, m1, m2)
+#define SHA256_NI_STEP3(L)                                              \
+  SHA256_NI_LOAD (L, m3, 48) SHA256_NI_QROUND (L, m3, 12)               \
+  SHA256_NI_MSG2 (L, m0, m3, m2) SHA256_NI_MSG1 (L, m2, m3)
+
+// Steps 4 to 12 (wn, w, and wp rotate over m0..m3).
+//
+#define SHA256_NI_STEPN(L, w, i, wn, wp)                                \
+  SHA256_NI_QROUND (L, w, i)                                            \
+  SHA256_NI_MSG2 (L, wn, w, wp) SHA256_NI_MSG1 (L, wp, w)
+
+#define SHA256_NI_STEP13(L)                                             \
+  SHA256_NI_QROUND (L, m1, 52) SHA256_NI_MSG2 (L, m2, m1, m0)
+#define SHA256_NI_STEP14(L)                                             \
+  SHA256_NI_QROUND (L, m2, 56) SHA256_NI_MSG2 (L, m3, m2, m1)
+#define SHA256_NI_STEP15(L)                                             \
+  SHA256_NI_QROUND (L, m3, 60)
+
+// Process the 64-byte block for the specified lane.
+//
+#define SHA256_NI_BLOCK(L)                                              \
+  abef_s##L = abef##L;                                                  \
+  cdgh_s##L = cdgh##L;                                                  \
+  SHA256_NI_STEP0 (L)                                                   \
+  SHA256_NI_STEP1 (L)                                                   \
+  SHA256_NI_STEP2 (L)                                                   \
+  SHA256_NI_STEP3 (L)                                                   \
+  SHA256_NI_STEPN (L, m0, 16, m1, m3)                                   \
+  SHA256_NI_STEPN (L, m1, 20, m2, m0)                                   \
+  SHA256_NI_STEPN (L, m2, 24, m3, m1)                                   \
+  SHA256_NI_STEPN (L, m3, 28, m0, m2)                                   \
+  SHA256_NI_STEPN (L, m0, 32, m1, m3)                                   \
+  SHA256_NI_STEPN (L, m1, 36, m2, m0)                                   \
+  SHA256_NI_STEPN (L, m2, 40, m3, m1)                                   \
+  SHA256_NI_STEPN (L, m3, 44, m0, m2)                                   \
+  SHA256_NI_STEPN (L, m0, 48, m1, m3)                                   \
+  SHA256_NI_STEP13 (L)                                                  \
+  SHA256_NI_STEP14 (L)                                                  \
+  SHA256_NI_STEP15 (L)                                                  \
+  abef##L = _mm_add_epi32 (abef##L, abef_s##L);                         \
+  cdgh##L = _mm_add_epi32 (cdgh##L, cdgh_s##L);
+
+#define SHA256_NI_LANE(L)                                               \
+  __m128i abef##L, cdgh##L, abef_s##L, cdgh_s##L, t##L;                 \
+  __m128i m0##L, m1##L, m2##L, m3##L;
+
+#define SHA256_NI_MASK                                                  \
+  const __m128i mask (                                                  \
+    _mm_set_epi64x (0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL));
+
+LIBBUTL_SHA256_NI_TARGET static void
+sha256_transform_ni (uint32_t* state, const unsigned char* srca, size_t n)
+{
+  SHA256_NI_MASK
+  SHA256_NI_LANE (a)
+  SHA256_NI_LOAD_STATE (a, state)
+
+  for (; n != 0; --n, srca += 64)
+  {
+    SHA256_NI_BLOCK (a)
+  }
+
+  SHA256_NI_STORE_STATE (a, state)
+}
+
+// Process the same number of blocks of two independent messages
+// interleaving the instructions to hide the SHA256RNDS2 latency.
+//
+LIBBUTL_SHA256_NI_TARGET static void
+sha256_transform_ni_x2 (uint32_t* sa, const unsigned char* srca,
+                        uint32_t* sb, const unsigned char* srcb,
+                        size_t n)
+{
+  SHA256_NI_MASK
+  SHA256_NI_LANE (a)
+  SHA256_NI_LANE (b)
+  SHA256_NI_LOAD_STATE (a, sa)
+  SHA256_NI_LOAD_STATE (b, sb)
+
+  for (; n != 0; --n, srca += 64, srcb += 64)
+  {
+    abef_sa = abefa; cdgh_sa = cdgha;
+    abef_sb = abefb; cdgh_sb = cdghb;
+
+    SHA256_NI_STEP0 (a) SHA256_NI_STEP0 (b)
+    SHA256_NI_STEP1 (a) SHA256_NI_STEP1 (b)
+    SHA256_NI_STEP2 (a) SHA256_NI_STEP2 (b)
+    SHA256_NI_STEP3 (a) SHA256_NI_STEP3 (b)
+    SHA256_NI_STEPN (a, m0, 16, m1, m3) SHA256_NI_STEPN (b, m0, 16, m1, m3)
+    SHA256_NI_STEPN (a, m1, 20, m2, m0) SHA256_NI_STEPN (b, m1, 20, m2, m0)
+    SHA256_NI_STEPN (a, m2, 24, m3, m1) SHA256_NI_STEPN (b, m2, 24, m3, m1)
+    SHA256_NI_STEPN (a, m3, 28, m0, m2) SHA256_NI_STEPN (b, m3, 28, m0, m2)
+    SHA256_NI_STEPN (a, m0, 32, m1, m3) SHA256_NI_STEPN (b, m0, 32, m1, m3)
+    SHA256_NI_STEPN (a, m1, 36, m2, m0) SHA256_NI_STEPN (b, m1, 36, m2, m0)
+    SHA256_NI_STEPN (a, m2, 40, m3, m1) SHA256_NI_STEPN (b, m2, 40, m3, m1)
+    SHA256_NI_STEPN (a, m3, 44, m0, m2) SHA256_NI_STEPN (b, m3, 44, m0, m2)
+    SHA256_NI_STEPN (a, m0, 48, m1, m3) SHA256_NI_STEPN (b, m0, 48, m1, m3)
+    SHA256_NI_STEP13 (a) SHA256_NI_STEP13 (b)
+    SHA256_NI_STEP14 (a) SHA256_NI_STEP14 (b)
+    SHA256_NI_STEP15 (a) SHA256_NI_STEP15 (b)
+
+    abefa = _mm_add_epi32 (abefa, abef_sa);
+    cdgha = _mm_add_epi32 (cdgha, cdgh_sa);
+    abefb = _mm_add_epi32 (abefb, abef_sb);
+    cdghb = _mm_add_epi32 (cdghb, cdgh_sb);
+  }
+
+  SHA256_NI_STORE_STATE (a, sa)
+  SHA256_NI_STORE_STATE (b, sb)
+}
+#endif // LIBBUTL_SHA256_NI
+
+static void
+sha256_transform (uint32_t* state, const unsigned char* src, size_t n)
+{
+#ifdef LIBBUTL_SHA256_NI
+  static const bool ni (sha256_ni_supported ());
+
+  if (ni && sha256_hw.load (memory_order_relaxed))
+  {
+    sha256_transform_ni (state, src, n);
+    return;
+  }
+#endif
+
+  SHA256_Transform_blocks_c (state, src, n);
+}
+
 namespace butl
 {
+  bool sha256::
+  hardware_acceleration (bool v)
+  {
+    return sha256_hw.exchange (v, memory_order_relaxed);
+  }
+
+  bool sha256::
+  hardware_acceleration ()
+  {
+#ifdef LIBBUTL_SHA256_NI
+    static const bool ni (sha256_ni_supported ());
+    return ni && sha256_hw.load (memory_order_relaxed);
+#else
+    return false;
+#endif
+  }
+
   void sha256::
   reset ()
   {
@@ -107,6 +403,346 @@ namespace butl
     return buf_;
   }
 
+  using sha256_digest = array<uint8_t, 32>;
+  using sha256_batch_input = vector<pair<const void*, size_t>>;
+
+#ifndef LIBBUTL_MINGW_STDTHREAD
+  using thread_type = std::thread;
+#else
+  using thread_type = mingw_stdthread::thread;
+#endif
+
+#ifdef LIBBUTL_SHA256_NI
+  // A chunk being hashed by the interleaved compression. Its stream of
+  // blocks consists of the full blocks of the chunk data followed by one or
+  // two blocks of the padded tail.
+  //
+  namespace
+  {
+    struct sha256_lane
+    {
+      uint32_t state[8];
+
+      const unsigned char* data;
+      size_t blocks;              // Number of full blocks in data.
+      size_t total;               // Number of blocks including the tail.
+      size_t pos = 0;             // Next block.
+      unsigned char tail[128];
+
+      sha256_lane (const void* d, size_t n)
+          : data (static_cast<const unsigned char*> (d)),
+            blocks (n / 64)
+      {
+        static const uint32_t h0[8] = {
+          0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+        memcpy (state, h0, sizeof (state));
+
+        size_t r (n % 64);
+        if (r != 0)
+          memcpy (tail, data + blocks * 64, r);
+
+        size_t e (r < 56 ? 64 : 128);
+        tail[r] = 0x80;
+        memset (tail + r + 1, 0, e - r - 9);
+
+        uint64_t bits (static_cast<uint64_t> (n) << 3);
+        for (size_t i (1); i != 9; ++i, bits >>= 8)
+          tail[e - i] = static_cast<unsigned char> (bits);
+
+        total = blocks + e / 64;
+      }
+
+      // Return the number of blocks available contiguously at the current
+      // position.
+      //
+      size_t
+      available () const
+      {
+        return pos < blocks ? blocks - pos : total - pos;
+      }
+
+      const unsigned char*
+      current () const
+      {
+        return pos < blocks ? data + pos * 64 : tail + (pos - blocks) * 64;
+      }
+
+      void
+      finish (sha256_digest& r)
+      {
+        for (size_t n; (n = available ()) != 0; pos += n)
+          sha256_transform_ni (state, current (), n);
+
+        for (size_t i (0); i != 8; ++i)
+        {
+          r[i * 4]     = static_cast<uint8_t> (state[i] >> 24);
+          r[i * 4 + 1] = static_cast<uint8_t> (state[i] >> 16);
+          r[i * 4 + 2] = static_cast<uint8_t> (state[i] >> 8);
+          r[i * 4 + 3] = static_cast<uint8_t> (state[i]);
+        }
+      }
+    };
+  }
+#endif
+
+  // Hash the chunks in the [b, e) range.
+  //
+  static void
+  sha256_batch_range (const sha256_batch_input& in,
+                      vector<sha256_digest>& r,
+                      size_t b, size_t e)
+  {
+#ifdef LIBBUTL_SHA256_NI
+    if (sha256::hardware_acceleration ())
+    {
+      // Hash the chunks in pairs advancing both lanes in lockstep while
+      // they both have blocks and finishing the longer one on its own.
+      //
+      for (; e - b >= 2; b += 2)
+      {
+        sha256_lane x (in[b].first, in[b].second);
+        sha256_lane y (in[b + 1].first, in[b + 1].second);
+
+        for (;;)
+        {
+          size_t n (min (x.available (), y.available ()));
+
+          if (n == 0)
+            break;
+
+          sha256_transform_ni_x2 (x.state, x.current (),
+                                  y.state, y.current (),
+                                  n);
+          x.pos += n;
+          y.pos += n;
+        }
+
+        x.finish (r[b]);
+        y.finish (r[b + 1]);
+      }
+
+      if (b != e)
+        sha256_lane (in[b].first, in[b].second).finish (r[b]);
+
+      return;
+    }
+#endif
+
+    for (; b != e; ++b)
+    {
+      const sha256::digest_type& d (
+        sha256 (in[b].first, in[b].second).binary ());
+
+      memcpy (r[b].data (), d, 32);
+    }
+  }
+
+  void
+  hash_batch (const vector<pair<const void*, size_t>>& in,
+              size_t threads,
+              size_t min_size,
+              size_t granularity,
+              const function<void (size_t, size_t)>& hash)
+  {
+    size_t n (in.size ());
+
+    if (threads == 0)
+    {
+      threads = thread_type::hardware_concurrency ();
+
+      if (threads == 0)
+        threads = 1;
+    }
+
+    size_t group (min<size_t> (max<size_t> (n / threads / 8, granularity),
+                               64));
+    group -= group % granularity;
+
+    if (threads > 1 && n > granularity)
+    {
+      size_t s (0);
+      for (size_t i (0); i != n && s < min_size; ++i)
+        s += in[i].second;
+
+      if (s < min_size)
+        threads = 1;
+    }
+    else
+      threads = 1;
+
+    if (threads == 1)
+    {
+      hash (0, n);
+      return;
+    }
+
+    atomic<size_t> next (0);
+
+    auto work = [&hash, &next, n, group] ()
+    {
+      for (size_t b; (b = next.fetch_add (group)) < n; )
+        hash (b, min (b + group, n));
+    };
+
+    // Start the helper threads and join the work ourselves.
+    //
+    vector<thread_type> ts;
+    ts.reserve (threads - 1);
+
+    try
+    {
+      for (size_t i (1); i != threads; ++i)
+        ts.emplace_back (work);
+    }
+    catch (const system_error&)
+    {
+      // Proceed with whatever threads we have managed to start.
+    }
+
+    work ();
+
+    for (thread_type& t: ts)
+      t.join ();
+  }
+
+  vector<sha256_digest>
+  sha256_batch (const sha256_batch_input& in, size_t threads)
+  {
+    vector<sha256_digest> r (in.size ());
+
+    // Hand out the chunks in groups of an even size to keep the lanes
+    // paired.
+    //
+    hash_batch (in, threads, 1024 * 1024 /* min_size */, 2,
+                [&in, &r] (size_t b, size_t e)
+                {
+                  sha256_batch_range (in, r, b, e);
+                });
+
+    return r;
+  }
+
+  // sha256_tree
+  //
+  sha256_tree::
+  sha256_tree (size_t cs, size_t ts)
+      : chunk_size_ (cs), threads_ (ts)
+  {
+    if (cs == 0)
+      throw invalid_argument ("zero SHA256 tree chunk size");
+
+    reset ();
+  }
+
+  void sha256_tree::
+  reset ()
+  {
+    chunk_.reset ();
+    root_.reset ();
+    pos_ = 0;
+    done_ = false;
+    empty_ = true;
+  }
+
+  void sha256_tree::
+  append (const void* b, size_t n)
+  {
+    if (n == 0)
+      return;
+
+    if (empty_)
+      empty_ = false;
+
+    const char* p (static_cast<const char*> (b));
+
+    // Complete the current partial chunk, if any.
+    //
+    if (pos_ != 0)
+    {
+      size_t k (min (n, chunk_size_ - pos_));
+      chunk_.append (p, k);
+      p += k;
+      n -= k;
+
+      if ((pos_ += k) != chunk_size_)
+        return;
+
+      root_.append (chunk_.binary (), 32);
+      chunk_.reset ();
+      pos_ = 0;
+    }
+
+    // Hash the whole chunks in place, potentially in parallel.
+    //
+    if (size_t c = n / chunk_size_)
+    {
+      vector<pair<const void*, size_t>> in;
+      in.reserve (c);
+
+      for (size_t i (0); i != c; ++i, p += chunk_size_)
+        in.emplace_back (p, chunk_size_);
+
+      n -= c * chunk_size_;
+
+      for (const sha256_digest& d: sha256_batch (in, threads_))
+        root_.append (d.data (), d.size ());
+    }
+
+    if (n != 0)
+    {
+      chunk_.append (p, n);
+      pos_ = n;
+    }
+  }
+
+  void sha256_tree::
+  append (istream& is)
+  {
+    bufstreambuf* buf (dynamic_cast<bufstreambuf*> (is.rdbuf ()));
+    assert (buf != nullptr);
+
+    // Note that the get area (potentially memory-mapped) can be larger than
+    // what gbump() can handle, so we consume it in pieces.
+    //
+    const size_t m (static_cast<size_t> (numeric_limits<int>::max ()));
+
+    while (is.peek () != istream::traits_type::eof () && is.good ())
+    {
+      size_t n (min (static_cast<size_t> (buf->egptr () - buf->gptr ()), m));
+      append (buf->gptr (), n);
+      buf->gbump (static_cast<int> (n));
+    }
+  }
+
+  const sha256::digest_type& sha256_tree::
+  binary () const
+  {
+    if (!done_)
+    {
+      if (pos_ != 0)
+        root_.append (chunk_.binary (), 32);
+
+      unsigned char s[8];
+      uint64_t v (chunk_size_);
+      for (size_t i (8); i != 0; --i, v >>= 8)
+        s[i - 1] = static_cast<unsigned char> (v);
+
+      root_.append (s, sizeof (s));
+      done_ = true;
+    }
+
+    return root_.binary ();
+  }
+
+  const char* sha256_tree::
+  string () const
+  {
+    binary ();
+    return root_.string ();
+  }
+
   string
   sha256_to_fingerprint (const string& s)
   {
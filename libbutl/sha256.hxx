@@ -3,7 +3,10 @@
 
 #pragma once
 
+#include <array>
 #include <string>
+#include <vector>
+#include <utility>     // pair
 #include <iosfwd>      // istream
 #include <cstddef>     // size_t
 #include <cstdint>
@@ -130,6 +133,21 @@ namespace butl
       return std::string (string (), n < 64 ? n : 64);
     }
 
+    // Enable or disable the hardware-accelerated implementation (currently
+    // SHA-NI on x86-64) returning the previous value. It is enabled by
+    // default and is used if supported by the CPU, with the portable
+    // implementation used as a fallback. The results are the same either
+    // way, so this is primarily useful for testing and benchmarking.
+    //
+    static bool
+    hardware_acceleration (bool);
+
+    // Return true if the hardware-accelerated implementation is enabled and
+    // is supported by the CPU.
+    //
+    static bool
+    hardware_acceleration ();
+
   private:
     struct context // Note: identical to SHA256_CTX.
     {
@@ -149,6 +167,104 @@ namespace butl
     bool empty_;
   };
 
+  // Calculate SHA256 checksums of multiple independent chunks of data,
+  // returning them in the binary representation in the chunk order.
+  //
+  // For many small chunks this is faster than calculating each checksum
+  // with a separate sha256 instance: with the hardware acceleration the
+  // compression of two chunks is interleaved to hide the instruction
+  // latencies. Additionally, if the number of threads is greater than one
+  // (0 means the number of hardware threads), then a sufficiently large
+  // batch is split between helper threads.
+  //
+  LIBBUTL_SYMEXPORT std::vector<std::array<std::uint8_t, 32>>
+  sha256_batch (const std::vector<std::pair<const void*, std::size_t>>&,
+                std::size_t threads = 1);
+
+  // SHA256 tree checksum calculator.
+  //
+  // The data is split into fixed-size chunks which are hashed independently
+  // and the resulting chunk checksums (in the binary representation),
+  // followed by the chunk size (as a 64-bit big-endian value), are hashed
+  // into the root checksum. As a result, the checksum differs from the plain
+  // SHA256 checksum of the same data as well as between the chunk sizes.
+  //
+  // The benefit of this scheme is that chunks can be hashed in parallel. If
+  // the number of threads is greater than one (0 means the number of
+  // hardware threads), then the whole chunks of sufficiently large data
+  // appended at once are hashed using multiple threads (see sha256_batch()
+  // for details). Note that for a stream this happens for the whole chunks
+  // in its get area, so it should be memory-mapped or read with a buffer
+  // that is a multiple of the chunk size (see fdstream_mode::mmap and
+  // fdstreambuf::bufsize() for details).
+  //
+  // Throw invalid_argument if the chunk size is zero.
+  //
+  class LIBBUTL_SYMEXPORT sha256_tree
+  {
+  public:
+    static const std::size_t default_chunk_size = 1024 * 1024;
+
+    explicit
+    sha256_tree (std::size_t chunk_size = default_chunk_size,
+                 std::size_t threads = 0);
+
+    // Append binary data.
+    //
+    void
+    append (const void*, std::size_t);
+
+    sha256_tree (const void* b, std::size_t n,
+                 std::size_t chunk_size = default_chunk_size,
+                 std::size_t threads = 0)
+        : sha256_tree (chunk_size, threads) {append (b, n);}
+
+    // Append stream.
+    //
+    // Note that currently the stream is expected to be bufstreambuf-based
+    // (e.g., ifdstream).
+    //
+    void
+    append (std::istream&);
+
+    explicit
+    sha256_tree (std::istream& i,
+                 std::size_t chunk_size = default_chunk_size,
+                 std::size_t threads = 0)
+        : sha256_tree (chunk_size, threads) {append (i);}
+
+    // Check if any data has been hashed.
+    //
+    bool
+    empty () const {return empty_;}
+
+    std::size_t
+    chunk_size () const {return chunk_size_;}
+
+    // Reset to the default-constructed state (with the same chunk size and
+    // number of threads).
+    //
+    void
+    reset ();
+
+    // Extract the root checksum (see sha256 for details).
+    //
+    const sha256::digest_type&
+    binary () const;
+
+    const char*
+    string () const;
+
+  private:
+    std::size_t chunk_size_;
+    std::size_t threads_;
+    std::size_t pos_;     // Size of the current partial chunk.
+    mutable sha256 chunk_;
+    mutable sha256 root_;
+    mutable bool done_;
+    bool empty_;
+  };
+
   // Convert a SHA256 string representation (64 hex digits) to the fingerprint
   // canonical representation (32 colon-separated upper case hex digit pairs,
   // like 01:AB:CD:...). Throw invalid_argument if the argument is not a valid
@@ -109,7 +109,8 @@ be64enc(void *pp, uint64_t u)
 #endif /* __FreeBSD__ || __NetBSD__ */
 
 /* The rest is the unmodified (except for a few explicit casts to make
-   compilable in C++) latest implementation from FreeBSD sys/crypto/sha2/. */
+   compilable in C++ and the SHA256_TRANSFORM hook) latest implementation
+   from FreeBSD sys/crypto/sha2/. */
 
 #include <string.h>
 
@@ -183,7 +184,7 @@ be32dec_vect(uint32_t *dst, const unsigned char *src, size_t len)
  * the 512-bit input block to produce a new state.
  */
 static void
-SHA256_Transform(uint32_t * state, const unsigned char block[64])
+SHA256_Transform_c(uint32_t * state, const unsigned char block[64])
 {
 	uint32_t W[64];
 	uint32_t S[8];
@@ -269,6 +270,24 @@ SHA256_Transform(uint32_t * state, const unsigned char block[64])
 		state[i] += S[i];
 }
 
+/*
+ * Process the specified number of 64-byte blocks. The includer can
+ * override this function with a faster implementation (for example,
+ * a hardware-accelerated one) by defining SHA256_TRANSFORM.
+ */
+static void
+SHA256_Transform_blocks_c(uint32_t * state, const unsigned char * src,
+    size_t n)
+{
+
+	for (; n != 0; n--, src += 64)
+		SHA256_Transform_c(state, src);
+}
+
+#ifndef SHA256_TRANSFORM
+#define SHA256_TRANSFORM SHA256_Transform_blocks_c
+#endif
+
 static unsigned char PAD[64] = {
 	0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -342,15 +361,15 @@ SHA256_Update(SHA256_CTX * ctx, const void *in, size_t len)
 
 	/* Finish the current block */
 	memcpy(&ctx->buf[r], src, 64 - r);
-	SHA256_Transform(ctx->state, ctx->buf);
+	SHA256_TRANSFORM(ctx->state, ctx->buf, 1);
 	src += 64 - r;
 	len -= 64 - r;
 
 	/* Perform complete blocks */
-	while (len >= 64) {
-		SHA256_Transform(ctx->state, src);
-		src += 64;
-		len -= 64;
+	if (len >= 64) {
+		SHA256_TRANSFORM(ctx->state, src, len / 64);
+		src += len & ~(size_t)63;
+		len &= 63;
 	}
 
 	/* Copy left over data into buffer */
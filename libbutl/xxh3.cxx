@@ -0,0 +1,269 @@
+// file      : libbutl/xxh3.cxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#include <libbutl/xxh3.hxx>
+
+#define XXH_INLINE_ALL // Makes API static and includes the implementation.
+#include "xxhash3.h"
+
+#include <limits>    // numeric_limits
+#include <cassert>
+#include <istream>
+#include <algorithm> // min()
+
+#include <libbutl/bufstreambuf.hxx>
+
+using namespace std;
+
+static_assert (sizeof (butl::xxh3_state) == sizeof (XXH3_state_t) &&
+               alignof (butl::xxh3_state) == alignof (XXH3_state_t),
+               "xxh3_state does not match XXH3_state_t");
+
+namespace butl
+{
+  static const char hex_map[16] =
+  {
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+    'a', 'b', 'c', 'd', 'e', 'f'
+  };
+
+  static inline void
+  hex_encode (const uint8_t* b, size_t n, char* s)
+  {
+    for (size_t i (0); i != n; ++i)
+    {
+      s[i * 2]     = hex_map[b[i] >> 4];
+      s[i * 2 + 1] = hex_map[b[i] & 0x0f];
+    }
+
+    s[n * 2] = '\0';
+  }
+
+  static inline XXH3_state_t*
+  state (xxh3_state& s)
+  {
+    return reinterpret_cast<XXH3_state_t*> (&s);
+  }
+
+  // Append the bufstreambuf-based stream to the hash calculator.
+  //
+  // Note that the get area (potentially memory-mapped) can be larger than
+  // what gbump() can handle, so we consume it in pieces.
+  //
+  template <typename H>
+  static void
+  append_stream (H& h, istream& is)
+  {
+    bufstreambuf* buf (dynamic_cast<bufstreambuf*> (is.rdbuf ()));
+    assert (buf != nullptr);
+
+    const size_t m (static_cast<size_t> (numeric_limits<int>::max ()));
+
+    while (is.peek () != istream::traits_type::eof () && is.good ())
+    {
+      size_t n (min (static_cast<size_t> (buf->egptr () - buf->gptr ()), m));
+      h.append (buf->gptr (), n);
+      buf->gbump (static_cast<int> (n));
+    }
+  }
+
+  // xxh3_64
+  //
+  uint64_t xxh3_64::
+  hash (const void* b, size_t n)
+  {
+    return static_cast<uint64_t> (XXH3_64bits (b, n));
+  }
+
+  array<uint8_t, 8> xxh3_64::
+  binary (const void* b, size_t n)
+  {
+    array<uint8_t, 8> r;
+    XXH64_canonicalFromHash (reinterpret_cast<XXH64_canonical_t*> (r.data ()),
+                             XXH3_64bits (b, n));
+    return r;
+  }
+
+  array<char, 17> xxh3_64::
+  string (const void* b, size_t n)
+  {
+    array<uint8_t, 8> r (binary (b, n));
+    array<char, 17> s;
+    hex_encode (r.data (), r.size (), s.data ());
+    return s;
+  }
+
+  void xxh3_64::
+  reset ()
+  {
+    // Note: does not fail even though returns XXH_errorcode.
+    //
+    XXH3_64bits_reset (state (state_));
+    done_ = false;
+    empty_ = true;
+  }
+
+  void xxh3_64::
+  append (const void* b, size_t n)
+  {
+    if (n != 0)
+    {
+      assert (b != nullptr);
+
+      // Note: only fails if passed NULL input pointer.
+      //
+      XXH3_64bits_update (state (state_), b, n);
+
+      if (empty_)
+        empty_ = false;
+    }
+  }
+
+  void xxh3_64::
+  append (istream& is)
+  {
+    append_stream (*this, is);
+  }
+
+  uint64_t xxh3_64::
+  hash () const
+  {
+    if (!done_)
+    {
+      hash_ = static_cast<uint64_t> (XXH3_64bits_digest (state (state_)));
+
+      XXH64_canonicalFromHash (reinterpret_cast<XXH64_canonical_t*> (&bin_),
+                               static_cast<XXH64_hash_t> (hash_));
+
+      str_[0] = '\0'; // Indicate we haven't computed the string yet.
+      done_ = true;
+    }
+
+    return hash_;
+  }
+
+  const xxh3_64::digest_type& xxh3_64::
+  binary () const
+  {
+    if (!done_)
+      hash ();
+
+    return bin_;
+  }
+
+  const char* xxh3_64::
+  string () const
+  {
+    if (!done_)
+      hash ();
+
+    if (str_[0] == '\0')
+      hex_encode (bin_, sizeof (bin_), str_);
+
+    return str_;
+  }
+
+  // xxh3_128
+  //
+  static inline xxh3_128::hash_type
+  to_hash (XXH128_hash_t h)
+  {
+    return xxh3_128::hash_type {h.low64, h.high64};
+  }
+
+  xxh3_128::hash_type xxh3_128::
+  hash (const void* b, size_t n)
+  {
+    return to_hash (XXH3_128bits (b, n));
+  }
+
+  array<uint8_t, 16> xxh3_128::
+  binary (const void* b, size_t n)
+  {
+    array<uint8_t, 16> r;
+    XXH128_canonicalFromHash (
+      reinterpret_cast<XXH128_canonical_t*> (r.data ()),
+      XXH3_128bits (b, n));
+    return r;
+  }
+
+  array<char, 33> xxh3_128::
+  string (const void* b, size_t n)
+  {
+    array<uint8_t, 16> r (binary (b, n));
+    array<char, 33> s;
+    hex_encode (r.data (), r.size (), s.data ());
+    return s;
+  }
+
+  void xxh3_128::
+  reset ()
+  {
+    // Note: does not fail even though returns XXH_errorcode.
+    //
+    XXH3_128bits_reset (state (state_));
+    done_ = false;
+    empty_ = true;
+  }
+
+  void xxh3_128::
+  append (const void* b, size_t n)
+  {
+    if (n != 0)
+    {
+      assert (b != nullptr);
+
+      // Note: only fails if passed NULL input pointer.
+      //
+      XXH3_128bits_update (state (state_), b, n);
+
+      if (empty_)
+        empty_ = false;
+    }
+  }
+
+  void xxh3_128::
+  append (istream& is)
+  {
+    append_stream (*this, is);
+  }
+
+  xxh3_128::hash_type xxh3_128::
+  hash () const
+  {
+    if (!done_)
+    {
+      XXH128_hash_t h (XXH3_128bits_digest (state (state_)));
+      hash_ = to_hash (h);
+
+      XXH128_canonicalFromHash (reinterpret_cast<XXH128_canonical_t*> (&bin_),
+                                h);
+
+      str_[0] = '\0'; // Indicate we haven't computed the string yet.
+      done_ = true;
+    }
+
+    return hash_;
+  }
+
+  const xxh3_128::digest_type& xxh3_128::
+  binary () const
+  {
+    if (!done_)
+      hash ();
+
+    return bin_;
+  }
+
+  const char* xxh3_128::
+  string () const
+  {
+    if (!done_)
+      hash ();
+
+    if (str_[0] == '\0')
+      hex_encode (bin_, sizeof (bin_), str_);
+
+    return str_;
+  }
+}
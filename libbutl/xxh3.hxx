@@ -0,0 +1,275 @@
+// file      : libbutl/xxh3.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <iosfwd>      // istream
+#include <cstddef>     // size_t
+#include <cstdint>
+#include <cstring>     // strlen()
+#include <type_traits> // enable_if, is_integral
+
+#include <libbutl/export.hxx>
+
+namespace butl
+{
+  // The XXH3 streaming state (see xxh3_64 and xxh3_128 below for details).
+  //
+  struct xxh3_state // Note: identical to XXH3_state_s.
+  {
+    alignas (64) std::uint64_t acc[8];
+    alignas (64) unsigned char custom_secret[192];
+    alignas (64) unsigned char buffer[256];
+    std::uint32_t buffered_size;
+    std::uint32_t use_seed;
+    std::size_t nb_stripes_so_far;
+    std::uint64_t total_len;
+    std::size_t nb_stripes_per_block;
+    std::size_t secret_limit;
+    std::uint64_t seed;
+    std::uint64_t reserved64;
+    const unsigned char* ext_secret;
+  };
+
+  // xxHash variant XXH3 (64-bit) checksum calculator.
+  //
+  // XXH3 is a newer member of the xxHash family that is significantly faster
+  // than XXH64, especially for short inputs. Note, however, that the
+  // resulting checksums differ from the XXH64 ones.
+  //
+  // The interface mirrors that of xxh64, for example:
+  //
+  // cerr << xxh3_64 ("123").string () << endl;
+  // cerr << xxh3_64::string ("123").data () << endl;
+  //
+  class LIBBUTL_SYMEXPORT xxh3_64
+  {
+    // Fast one-shot stateless API.
+    //
+  public:
+    // The result can be obtained as either a uint64_t number, an 8-byte
+    // canonical binary representation (the same for LE/BE) or as a
+    // 16-character hex-encoded C-string (of the canonical binary
+    // representation).
+    //
+    static std::uint64_t
+    hash (const void*, std::size_t);
+
+    // Note that the hash of a string includes the '\0' terminator (see xxh64
+    // for details).
+    //
+    static std::uint64_t
+    hash (const std::string& s) {return hash (s.c_str (), s.size () + 1);}
+
+    static std::uint64_t
+    hash (const char* s) {return hash (s, std::strlen (s) + 1);}
+
+    static std::array<std::uint8_t, 8>
+    binary (const void*, std::size_t);
+
+    static std::array<std::uint8_t, 8>
+    binary (const std::string& s) {return binary (s.c_str (), s.size () + 1);}
+
+    static std::array<std::uint8_t, 8>
+    binary (const char* s) {return binary (s, std::strlen (s) + 1);}
+
+    static std::array<char, 17>
+    string (const void*, std::size_t);
+
+    static std::array<char, 17>
+    string (const std::string& s) {return string (s.c_str (), s.size () + 1);}
+
+    static std::array<char, 17>
+    string (const char* s) {return string (s, std::strlen (s) + 1);}
+
+    // Incremental stateful API.
+    //
+  public:
+    xxh3_64 () {reset ();}
+
+    // Append binary data.
+    //
+    void
+    append (const void*, std::size_t);
+
+    xxh3_64 (const void* b, std::size_t n): xxh3_64 () {append (b, n);}
+
+    // Append string.
+    //
+    // Note that the hash includes the '\0' terminator.
+    //
+    void
+    append (const std::string& s) {append (s.c_str (), s.size () + 1);}
+
+    void
+    append (const char* s) {append (s, std::strlen (s) + 1);}
+
+    explicit
+    xxh3_64 (const std::string& s): xxh3_64 () {append (s);}
+
+    explicit
+    xxh3_64 (const char* s): xxh3_64 () {append (s);}
+
+    // Append an integral type. Note that the resulting hash will be
+    // endian'ness-dependent.
+    //
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type
+    append (T x) {append (&x, sizeof (x));}
+
+    // Append stream.
+    //
+    // Note that currently the stream is expected to be bufstreambuf-based
+    // (e.g., ifdstream).
+    //
+    void
+    append (std::istream&);
+
+    explicit
+    xxh3_64 (std::istream& i): xxh3_64 () {append (i);}
+
+    // Check if any data has been hashed.
+    //
+    bool
+    empty () const {return empty_;}
+
+    // Reset to the default-constructed state.
+    //
+    void
+    reset ();
+
+    // Extract result (see the one-shot API above for details).
+    //
+    // Note that the binary and string representations are returned as
+    // references to the state of the xxh3_64 instance.
+    //
+    using digest_type = std::uint8_t[8];
+
+    std::uint64_t
+    hash () const;
+
+    const digest_type&
+    binary () const;
+
+    const char*
+    string () const;
+
+  private:
+    mutable xxh3_state state_;
+
+    mutable std::uint64_t hash_;
+    mutable digest_type bin_;
+    mutable char str_[17];
+    mutable bool done_;
+    bool empty_;
+  };
+
+  // xxHash variant XXH3 (128-bit, also known as XXH128) checksum calculator.
+  //
+  // The interface is the same as that of xxh3_64 except for the result
+  // representations which are twice as long.
+  //
+  class LIBBUTL_SYMEXPORT xxh3_128
+  {
+    // Fast one-shot stateless API.
+    //
+  public:
+    struct hash_type
+    {
+      std::uint64_t low;
+      std::uint64_t high;
+    };
+
+    // The result can be obtained as either a pair of uint64_t numbers, a
+    // 16-byte canonical binary representation (the same for LE/BE; the high
+    // part first) or as a 32-character hex-encoded C-string (of the canonical
+    // binary representation).
+    //
+    static hash_type
+    hash (const void*, std::size_t);
+
+    static hash_type
+    hash (const std::string& s) {return hash (s.c_str (), s.size () + 1);}
+
+    static hash_type
+    hash (const char* s) {return hash (s, std::strlen (s) + 1);}
+
+    static std::array<std::uint8_t, 16>
+    binary (const void*, std::size_t);
+
+    static std::array<std::uint8_t, 16>
+    binary (const std::string& s) {return binary (s.c_str (), s.size () + 1);}
+
+    static std::array<std::uint8_t, 16>
+    binary (const char* s) {return binary (s, std::strlen (s) + 1);}
+
+    static std::array<char, 33>
+    string (const void*, std::size_t);
+
+    static std::array<char, 33>
+    string (const std::string& s) {return string (s.c_str (), s.size () + 1);}
+
+    static std::array<char, 33>
+    string (const char* s) {return string (s, std::strlen (s) + 1);}
+
+    // Incremental stateful API.
+    //
+  public:
+    xxh3_128 () {reset ();}
+
+    void
+    append (const void*, std::size_t);
+
+    xxh3_128 (const void* b, std::size_t n): xxh3_128 () {append (b, n);}
+
+    void
+    append (const std::string& s) {append (s.c_str (), s.size () + 1);}
+
+    void
+    append (const char* s) {append (s, std::strlen (s) + 1);}
+
+    explicit
+    xxh3_128 (const std::string& s): xxh3_128 () {append (s);}
+
+    explicit
+    xxh3_128 (const char* s): xxh3_128 () {append (s);}
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type
+    append (T x) {append (&x, sizeof (x));}
+
+    void
+    append (std::istream&);
+
+    explicit
+    xxh3_128 (std::istream& i): xxh3_128 () {append (i);}
+
+    bool
+    empty () const {return empty_;}
+
+    void
+    reset ();
+
+    using digest_type = std::uint8_t[16];
+
+    hash_type
+    hash () const;
+
+    const digest_type&
+    binary () const;
+
+    const char*
+    string () const;
+
+  private:
+    mutable xxh3_state state_;
+
+    mutable hash_type hash_;
+    mutable digest_type bin_;
+    mutable char str_[33];
+    mutable bool done_;
+    bool empty_;
+  };
+}
@@ -10,10 +10,14 @@
 #include "xxhash.h"
 
 #include <cassert>
+#include <limits>    // numeric_limits
+#include <algorithm> // min()
 #include <istream>
+#include <stdexcept> // invalid_argument
 
 #include <libbutl/utility.hxx>      // *case()
 #include <libbutl/bufstreambuf.hxx>
+#include <libbutl/hash-details.hxx>
 
 using namespace std;
 
@@ -141,4 +145,155 @@ namespace butl
 
     return buf_;
   }
+
+  vector<array<uint8_t, 8>>
+  xxh64_batch (const vector<pair<const void*, size_t>>& in, size_t threads)
+  {
+    vector<array<uint8_t, 8>> r (in.size ());
+
+    // Note that XXH64 is several times faster than SHA256 so the threshold
+    // is higher than in sha256_batch().
+    //
+    hash_batch (in, threads, 4 * 1024 * 1024 /* min_size */, 1,
+                [&in, &r] (size_t b, size_t e)
+                {
+                  for (; b != e; ++b)
+                    XXH64_canonicalFromHash (
+                      reinterpret_cast<XXH64_canonical_t*> (r[b].data ()),
+                      XXH64 (in[b].first, in[b].second, 0 /* seed */));
+                });
+
+    return r;
+  }
+
+  // xxh64_tree
+  //
+  xxh64_tree::
+  xxh64_tree (size_t cs, size_t ts)
+      : chunk_size_ (cs), threads_ (ts)
+  {
+    if (cs == 0)
+      throw invalid_argument ("zero XXH64 tree chunk size");
+
+    reset ();
+  }
+
+  void xxh64_tree::
+  reset ()
+  {
+    chunk_.reset ();
+    root_.reset ();
+    pos_ = 0;
+    done_ = false;
+    empty_ = true;
+  }
+
+  void xxh64_tree::
+  append (const void* b, size_t n)
+  {
+    if (n == 0)
+      return;
+
+    if (empty_)
+      empty_ = false;
+
+    const char* p (static_cast<const char*> (b));
+
+    // Complete the current partial chunk, if any.
+    //
+    if (pos_ != 0)
+    {
+      size_t k (min (n, chunk_size_ - pos_));
+      chunk_.append (p, k);
+      p += k;
+      n -= k;
+
+      if ((pos_ += k) != chunk_size_)
+        return;
+
+      root_.append (chunk_.binary (), 8);
+      chunk_.reset ();
+      pos_ = 0;
+    }
+
+    // Hash the whole chunks in place, potentially in parallel.
+    //
+    if (size_t c = n / chunk_size_)
+    {
+      vector<pair<const void*, size_t>> in;
+      in.reserve (c);
+
+      for (size_t i (0); i != c; ++i, p += chunk_size_)
+        in.emplace_back (p, chunk_size_);
+
+      n -= c * chunk_size_;
+
+      for (const array<uint8_t, 8>& d: xxh64_batch (in, threads_))
+        root_.append (d.data (), d.size ());
+    }
+
+    if (n != 0)
+    {
+      chunk_.append (p, n);
+      pos_ = n;
+    }
+  }
+
+  void xxh64_tree::
+  append (istream& is)
+  {
+    bufstreambuf* buf (dynamic_cast<bufstreambuf*> (is.rdbuf ()));
+    assert (buf != nullptr);
+
+    // Note that the get area (potentially memory-mapped) can be larger than
+    // what gbump() can handle, so we consume it in pieces.
+    //
+    const size_t m (static_cast<size_t> (numeric_limits<int>::max ()));
+
+    while (is.peek () != istream::traits_type::eof () && is.good ())
+    {
+      size_t n (min (static_cast<size_t> (buf->egptr () - buf->gptr ()), m));
+      append (buf->gptr (), n);
+      buf->gbump (static_cast<int> (n));
+    }
+  }
+
+  void xxh64_tree::
+  finish () const
+  {
+    if (!done_)
+    {
+      if (pos_ != 0)
+        root_.append (chunk_.binary (), 8);
+
+      unsigned char s[8];
+      uint64_t v (chunk_size_);
+      for (size_t i (8); i != 0; --i, v >>= 8)
+        s[i - 1] = static_cast<unsigned char> (v);
+
+      root_.append (s, sizeof (s));
+      done_ = true;
+    }
+  }
+
+  uint64_t xxh64_tree::
+  hash () const
+  {
+    finish ();
+    return root_.hash ();
+  }
+
+  const xxh64::digest_type& xxh64_tree::
+  binary () const
+  {
+    finish ();
+    return root_.binary ();
+  }
+
+  const char* xxh64_tree::
+  string () const
+  {
+    finish ();
+    return root_.string ();
+  }
 }
@@ -5,6 +5,8 @@
 
 #include <array>
 #include <string>
+#include <vector>
+#include <utility>     // pair
 #include <iosfwd>      // istream
 #include <cstddef>     // size_t
 #include <cstdint>
@@ -191,4 +193,95 @@ namespace butl
     mutable bool done_;
     bool empty_;
   };
+
+  // Calculate XXH64 checksums of multiple independent chunks of data,
+  // returning them in the canonical binary representation in the chunk
+  // order.
+  //
+  // If the number of threads is greater than one (0 means the number of
+  // hardware threads), then a sufficiently large batch is split between
+  // helper threads. See also sha256_batch().
+  //
+  LIBBUTL_SYMEXPORT std::vector<std::array<std::uint8_t, 8>>
+  xxh64_batch (const std::vector<std::pair<const void*, std::size_t>>&,
+               std::size_t threads = 1);
+
+  // XXH64 tree checksum calculator.
+  //
+  // The data is split into fixed-size chunks which are hashed independently,
+  // potentially in parallel, and the resulting chunk checksums (in the
+  // canonical binary representation), followed by the chunk size, are hashed
+  // into the root checksum. See sha256_tree for details.
+  //
+  class LIBBUTL_SYMEXPORT xxh64_tree
+  {
+  public:
+    static const std::size_t default_chunk_size = 1024 * 1024;
+
+    explicit
+    xxh64_tree (std::size_t chunk_size = default_chunk_size,
+                std::size_t threads = 0);
+
+    // Append binary data.
+    //
+    void
+    append (const void*, std::size_t);
+
+    xxh64_tree (const void* b, std::size_t n,
+                std::size_t chunk_size = default_chunk_size,
+                std::size_t threads = 0)
+        : xxh64_tree (chunk_size, threads) {append (b, n);}
+
+    // Append stream.
+    //
+    // Note that currently the stream is expected to be bufstreambuf-based
+    // (e.g., ifdstream).
+    //
+    void
+    append (std::istream&);
+
+    explicit
+    xxh64_tree (std::istream& i,
+                std::size_t chunk_size = default_chunk_size,
+                std::size_t threads = 0)
+        : xxh64_tree (chunk_size, threads) {append (i);}
+
+    // Check if any data has been hashed.
+    //
+    bool
+    empty () const {return empty_;}
+
+    std::size_t
+    chunk_size () const {return chunk_size_;}
+
+    // Reset to the default-constructed state (with the same chunk size and
+    // number of threads).
+    //
+    void
+    reset ();
+
+    // Extract the root checksum (see xxh64 for details).
+    //
+    std::uint64_t
+    hash () const;
+
+    const xxh64::digest_type&
+    binary () const;
+
+    const char*
+    string () const;
+
+  private:
+    void
+    finish () const;
+
+  private:
+    std::size_t chunk_size_;
+    std::size_t threads_;
+    std::size_t pos_;     // Size of the current partial chunk.
+    mutable xxh64 chunk_;
+    mutable xxh64 root_;
+    mutable bool done_;
+    bool empty_;
+  };
 }
@@ -3,10 +3,16 @@
 
 #include <ios>
 #include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>  // uint64_t
+#include <iomanip>
+#include <iostream>
 #include <system_error>
 
 #include <libbutl/path.hxx>
 #include <libbutl/fdstream.hxx>
+#include <libbutl/timestamp.hxx>
 #include <libbutl/filesystem.hxx>
 
 #undef NDEBUG
@@ -36,9 +42,134 @@ to_file (const path& f, const char* s)
   ofs.close ();
 }
 
+// Create a file of the specified size filled with the non-repeating (within
+// the 4K block) content.
+//
+static void
+to_file (const path& f, uint64_t size)
+{
+  string b (1024 * 1024, '\0');
+  for (size_t i (0); i != b.size (); ++i)
+    b[i] = static_cast<char> ('0' + (i / 4096 + i) % 75);
+
+  ofdstream ofs (f, fdopen_mode::binary);
+
+  for (uint64_t n (0); n != size; )
+  {
+    size_t k (static_cast<size_t> (min<uint64_t> (b.size (), size - n)));
+    ofs.write (b.data (), k);
+    n += k;
+  }
+
+  ofs.close ();
+}
+
+// Copy the file via the fdstream buffers, as cpfile() does if the kernel-side
+// copying is unavailable.
+//
+static void
+cpfile_buffered (const path& from, const path& to)
+{
+  ifdstream ifs (from, fdopen_mode::binary);
+  ofdstream ofs (to, fdopen_mode::truncate | fdopen_mode::binary);
+
+  if (ifs.peek () != ifdstream::traits_type::eof ())
+    ofs << ifs.rdbuf ();
+
+  ifs.close ();
+  ofs.close ();
+}
+
+// Copy the file of the specified size (repeatedly, for small sizes) using the
+// different copying methods and print the throughput for each of them.
+//
+static void
+benchmark (const dir_path& td, uint64_t size)
+{
+  path from (td / path ("from"));
+  path to (td / path ("to"));
+
+  to_file (from, size);
+
+  // Copy at least 1GB in total.
+  //
+  uint64_t n (size != 0 ? max<uint64_t> (1024 * 1024 * 1024 / size, 1) : 1);
+
+  auto measure = [&to, size, n] (const char* what, auto copy)
+  {
+    timestamp t (system_clock::now ());
+
+    for (uint64_t i (0); i != n; ++i)
+    {
+      try_rmfile (to);
+      copy ();
+    }
+
+    duration d (system_clock::now () - t);
+
+    double s (chrono::duration<double> (d).count ());
+    double mb (static_cast<double> (size) * n / 1024 / 1024);
+
+    cerr << "  " << left << setw (10) << what << right
+         << fixed << setprecision (2)
+         << setw (10) << s << " sec "
+         << setw (10) << (s != 0 ? mb / s : 0) << " MB/sec" << endl;
+  };
+
+  cerr << size << " bytes x " << n << ':' << endl;
+
+  measure ("default", [&from, &to] {cpfile (from, to);});
+
+  measure ("no-reflink",
+           [&from, &to] {cpfile (from, to, cpflags::no_reflink);});
+
+  measure ("buffered", [&from, &to] {cpfile_buffered (from, to);});
+
+  try_rmfile (to);
+  try_rmfile (from);
+}
+
+// Usage: argv[0] [-b [<size>...]]
+//
+// Test cpfile() or, if -b is specified, benchmark copying of files of the
+// specified sizes (in bytes, with an optional K, M, or G suffix; 4K, 1M,
+// 256M, and 4G by default) and print the results to stderr. The benchmark
+// compares the default (kernel-side, on Linux) copying, the copying with
+// cloning forbidden, and the buffered copying.
+//
 int
-main ()
+main (int argc, const char* argv[])
 {
+  bool bench (false);
+  vector<uint64_t> sizes;
+
+  for (int i (1); i != argc; ++i)
+  {
+    string a (argv[i]);
+
+    if (a == "-b")
+    {
+      bench = true;
+    }
+    else
+    {
+      assert (bench && !a.empty ());
+
+      uint64_t m (1);
+      switch (a.back ())
+      {
+      case 'K': m = 1024;               break;
+      case 'M': m = 1024 * 1024;        break;
+      case 'G': m = 1024 * 1024 * 1024; break;
+      }
+
+      if (m != 1)
+        a.pop_back ();
+
+      sizes.push_back (stoull (a) * m);
+    }
+  }
+
   dir_path td (dir_path::temp_directory () / dir_path ("butl-cpfile"));
 
   // Recreate the temporary directory (that possibly exists from the previous
@@ -48,6 +179,21 @@ main ()
   try_rmdir_r (td);
   assert (try_mkdir (td) == mkdir_status::success);
 
+  if (bench)
+  {
+    if (sizes.empty ())
+      sizes = {4096,
+               1024 * 1024,
+               256 * 1024 * 1024,
+               uint64_t (4) * 1024 * 1024 * 1024};
+
+    for (uint64_t s: sizes)
+      benchmark (td, s);
+
+    rmdir_r (td);
+    return 0;
+  }
+
   path from (td / path ("from"));
   path to (td / path ("to"));
 
@@ -99,6 +245,43 @@ main ()
   {
   }
 
+  // Check that content of a large file is copied properly, whether in kernel
+  // or via the buffered copying, with cloning allowed or forbidden.
+  //
+  {
+    path lf (td / path ("large-from"));
+    path lt (td / path ("large-to"));
+
+    to_file (lf, 3 * 1024 * 1024 + 123);
+
+    string c (from_file (lf));
+
+    cpfile (lf, lt);
+    assert (from_file (lt) == c);
+
+    cpfile (lf, lt, cpflags::overwrite_content | cpflags::no_reflink);
+    assert (from_file (lt) == c);
+
+    // Note that cloning is only supported by some filesystems (Btrfs, XFS,
+    // etc) and so it is allowed to fail. If that's the case, the incomplete
+    // copy must be deleted.
+    //
+    assert (try_rmfile (lt) == rmfile_status::success);
+
+    try
+    {
+      cpfile (lf, lt, cpflags::reflink);
+      assert (from_file (lt) == c);
+      assert (try_rmfile (lt) == rmfile_status::success);
+    }
+    catch (const system_error&)
+    {
+      assert (!entry_exists (lt));
+    }
+
+    assert (try_rmfile (lf) == rmfile_status::success);
+  }
+
   // Copy to the directory.
   //
   dir_path sd (td / dir_path ("sub"));
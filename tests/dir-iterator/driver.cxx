@@ -1,7 +1,15 @@
 // file      : tests/dir-iterator/driver.cxx -*- C++ -*-
 // license   : MIT; see accompanying LICENSE file
 
+#ifndef _WIN32
+#  include <dirent.h>   // opendir(), readdir(), closedir()
+#  include <sys/stat.h> // lstat(), stat()
+#endif
+
+#include <chrono>
+#include <string>
 #include <cstddef> // size_t
+#include <iomanip>
 #include <iostream>
 
 #include <libbutl/path.hxx>
@@ -27,7 +35,81 @@ operator<< (ostream& os, entry_type e)
   return os << entry_type_string[static_cast<size_t> (e)];
 }
 
-// Usage: argv[0] [-v] [-i|-d] <dir>
+// Iterate over the directory the specified number of times, obtaining the
+// entry types (and the target types for symlinks), and print the elapsed
+// time to stderr. On POSIX also do the same using the opendir()/readdir()
+// and [l]stat() functions on the full entry paths, for comparison.
+//
+// Note that the d_type dirent member, while not POSIX, is available on all
+// the platforms we support.
+//
+static void
+benchmark (const dir_path& d, dir_iterator::mode m, size_t n)
+{
+  using chrono::steady_clock;
+
+  auto print = [n] (const char* what, size_t es, steady_clock::duration t)
+  {
+    cerr << left << setw (14) << what << right
+         << es / n << " entries x " << n << ": "
+         << fixed << setprecision (3)
+         << chrono::duration<double, milli> (t).count () << " ms" << endl;
+  };
+
+  size_t es (0);
+  steady_clock::time_point s (steady_clock::now ());
+
+  for (size_t i (0); i != n; ++i)
+  {
+    for (const dir_entry& de: dir_iterator (d, m))
+    {
+      if (de.ltype () == entry_type::symlink)
+        de.type ();
+
+      ++es;
+    }
+  }
+
+  print ("dir_iterator", es, steady_clock::now () - s);
+
+#ifndef _WIN32
+  es = 0;
+  s = steady_clock::now ();
+
+  for (size_t i (0); i != n; ++i)
+  {
+    DIR* h (opendir (d.string ().c_str ()));
+    assert (h != nullptr);
+
+    while (struct dirent* de = readdir (h))
+    {
+      string n (de->d_name);
+
+      if (n == "." || n == "..")
+        continue;
+
+      string p ((d / path (n)).string ());
+
+      bool l (de->d_type == DT_LNK);
+
+      struct stat s;
+      if (de->d_type == DT_UNKNOWN)
+        l = lstat (p.c_str (), &s) == 0 && S_ISLNK (s.st_mode);
+
+      if (l)
+        stat (p.c_str (), &s);
+
+      ++es;
+    }
+
+    closedir (h);
+  }
+
+  print ("readdir", es, steady_clock::now () - s);
+#endif
+}
+
+// Usage: argv[0] [-v] [-i|-d] [-b <count>] <dir>
 //
 // Iterates over a directory filesystem sub-entries, obtains their types and
 // target types for symlinks.
@@ -43,6 +125,10 @@ operator<< (ostream& os, entry_type e)
 //    Detect dangling symlinks, rather than fail trying to obtain the target
 //    type.
 //
+// -b <count>
+//    Benchmark the iteration repeating it the specified number of times and
+//    printing the elapsed time to STDERR.
+//
 int
 main (int argc, const char* argv[])
 {
@@ -51,6 +137,7 @@ main (int argc, const char* argv[])
   bool verbose (false);
   bool ignore_dangling (false);
   bool detect_dangling (false);
+  size_t bench (0);
 
   int i (1);
   for (; i != argc; ++i)
@@ -63,13 +150,21 @@ main (int argc, const char* argv[])
       ignore_dangling = true;
     else if (v == "-d")
       detect_dangling = true;
+    else if (v == "-b")
+    {
+      ++i;
+
+      assert (i != argc);
+      bench = stoul (argv[i]);
+    }
     else
       break;
   }
 
   if (i != argc - 1)
   {
-    cerr << "usage: " << argv[0] << " [-v] [-i] <dir>" << endl;
+    cerr << "usage: " << argv[0] << " [-v] [-i|-d] [-b <count>] <dir>"
+         << endl;
     return 1;
   }
 
@@ -77,13 +172,19 @@ main (int argc, const char* argv[])
 
   const char* d (argv[i]);
 
+  dir_iterator::mode m (ignore_dangling ? dir_iterator::ignore_dangling :
+                        detect_dangling ? dir_iterator::detect_dangling :
+                                          dir_iterator::no_follow);
+
   try
   {
-    for (const dir_entry& de:
-           dir_iterator (dir_path (d),
-                         (ignore_dangling ? dir_iterator::ignore_dangling :
-                          detect_dangling ? dir_iterator::detect_dangling :
-                                            dir_iterator::no_follow)))
+    if (bench != 0)
+    {
+      benchmark (dir_path (d), m, bench);
+      return 0;
+    }
+
+    for (const dir_entry& de: dir_iterator (dir_path (d), m))
     {
       timestamp mt (de.mtime ());
       timestamp at (de.atime ());
@@ -7,6 +7,8 @@
 
 #ifndef _WIN32
 #  include <chrono>
+
+#  include <fcntl.h> // fcntl(), F_DUPFD
 #endif
 
 #include <ios>
@@ -16,6 +18,7 @@
 #include <sstream>
 #include <fstream>
 #include <utility>   // move()
+#include <algorithm> // sort()
 #include <iostream>
 #include <exception>
 
@@ -119,6 +122,142 @@ read_time (const path& p, const T& s, size_t n)
   return d;
 }
 
+// Measure the throughput of writing and reading data of the specified size
+// in 64KB chunks through the file and the pipe using fdstreams with the
+// specified buffer size and print the results to stderr.
+//
+static void
+bufsize_benchmark (const dir_path& td, size_t bufsize, uint64_t size)
+{
+#ifndef LIBBUTL_MINGW_STDTHREAD
+  using std::thread;
+#else
+  using mingw_stdthread::thread;
+#endif
+
+  string b (64 * 1024, '\0');
+  for (size_t i (0); i != b.size (); ++i)
+    b[i] = static_cast<char> ('0' + i % 75);
+
+  // Note that the data is written in the unaligned (to the buffer size)
+  // chunks, so both the buffered and direct writes are exercised.
+  //
+  auto write = [&b, size] (ofdstream& os)
+  {
+    for (uint64_t n (0); n != size; )
+    {
+      size_t k (static_cast<size_t> (min<uint64_t> (b.size () - 7,
+                                                    size - n)));
+      os.write (b.data (), k);
+      n += k;
+    }
+
+    os.close ();
+  };
+
+  auto read = [size] (ifdstream& is)
+  {
+    string b (64 * 1024, '\0');
+
+    uint64_t n (0);
+    while (is.read (&b[0], b.size ()) || is.gcount () != 0)
+      n += static_cast<uint64_t> (is.gcount ());
+
+    assert (n == size);
+    is.close ();
+  };
+
+  auto print = [size] (const char* what, const duration& d)
+  {
+    double s (chrono::duration<double> (d).count ());
+    double mb (static_cast<double> (size) / 1024 / 1024);
+
+    cerr << "  " << left << setw (12) << what << right
+         << fixed << setprecision (2)
+         << setw (10) << s << " sec "
+         << setw (10) << (s != 0 ? mb / s : 0) << " MB/sec" << endl;
+  };
+
+  cerr << bufsize << " bytes buffer:" << endl;
+
+  // File.
+  //
+  path f (td / path ("bufsize"));
+  {
+    timestamp t (system_clock::now ());
+
+    ofdstream os (f, fdopen_mode::binary, ofdstream::badbit, bufsize);
+    write (os);
+
+    print ("file write", system_clock::now () - t);
+  }
+
+  {
+    timestamp t (system_clock::now ());
+
+    ifdstream is (f,
+                  fdopen_mode::binary,
+                  ifdstream::badbit,
+                  bufsize);
+    read (is);
+
+    print ("file read", system_clock::now () - t);
+  }
+
+  {
+    timestamp t (system_clock::now ());
+
+    ifdstream is (fdopen (f, fdopen_mode::in | fdopen_mode::binary),
+                  fdstream_mode::mmap,
+                  ifdstream::badbit,
+                  0 /* pos */,
+                  bufsize);
+    read (is);
+
+    print ("file mmap", system_clock::now () - t);
+  }
+
+  try_rmfile (f);
+
+  // Pipe.
+  //
+  {
+    timestamp t (system_clock::now ());
+
+    fdpipe pipe (fdopen_pipe (fdopen_mode::binary));
+
+    ofdstream os (move (pipe.out),
+                  fdstream_mode::binary,
+                  ofdstream::badbit,
+                  0 /* pos */,
+                  bufsize);
+
+    ifdstream is (move (pipe.in),
+                  fdstream_mode::binary,
+                  ifdstream::badbit,
+                  0 /* pos */,
+                  bufsize);
+
+    thread th ([&write, &os] {write (os);});
+    read (is);
+    th.join ();
+
+    print ("pipe", system_clock::now () - t);
+  }
+}
+
+// Usage: argv[0] [-v] [-c] [-b [<bufsize>...]]
+//
+// Test fdstreams. If -v is specified, then also print the fdstream/fstream
+// performance comparison results to stderr.
+//
+// If -b is specified, then instead benchmark the fdstreams throughput with
+// the specified buffer sizes (in bytes, with an optional K or M suffix; 512,
+// 8K, 64K, 1M, and 4M by default) and print the results to stderr. The file
+// reading is also benchmarked in the memory-mapped mode.
+//
+// The -c option is used internally to run the driver as a child process.
+//
 int
 main (int argc, const char* argv[])
 {
@@ -130,6 +269,8 @@ main (int argc, const char* argv[])
 
   bool v (false);
   bool child (false);
+  bool bench (false);
+  vector<size_t> bufsizes;
 
   int i (1);
   for (; i != argc; ++i)
@@ -139,9 +280,26 @@ main (int argc, const char* argv[])
       child = true;
     else if (a == "-v")
       v = true;
+    else if (a == "-b")
+      bench = true;
+    else if (bench && !a.empty () && a[0] != '-')
+    {
+      size_t m (1);
+      switch (a.back ())
+      {
+      case 'K': m = 1024;        break;
+      case 'M': m = 1024 * 1024; break;
+      }
+
+      if (m != 1)
+        a.pop_back ();
+
+      bufsizes.push_back (static_cast<size_t> (stoull (a)) * m);
+    }
     else
     {
-      cerr << "usage: " << argv[0] << " [-v] [-c]" << endl;
+      cerr << "usage: " << argv[0] << " [-v] [-c] [-b [<bufsize>...]]"
+           << endl;
       return 1;
     }
   }
@@ -186,6 +344,18 @@ main (int argc, const char* argv[])
   try_rmdir_r (td);
   assert (try_mkdir (td) == mkdir_status::success);
 
+  if (bench)
+  {
+    if (bufsizes.empty ())
+      bufsizes = {512, 8 * 1024, 64 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+
+    for (size_t n: bufsizes)
+      bufsize_benchmark (td, n, 256 * 1024 * 1024);
+
+    rmdir_r (td);
+    return 0;
+  }
+
   path f (td / path ("file"));
 
   try
@@ -207,6 +377,93 @@ main (int argc, const char* argv[])
   to_file (f, text1, fdopen_mode::out | fdopen_mode::create);
   assert (from_file (f) == text1);
 
+  // Read and write with the custom buffer sizes.
+  //
+  path bf (td / path ("bufsize"));
+  {
+    string s;
+    for (size_t i (0); i != 100000; ++i)
+      s.push_back ('0' + i % 75);
+
+    for (size_t n: {1, 3, 4096, 1024 * 1024})
+    {
+      ofdstream os (bf, fdopen_mode::binary, ofdstream::badbit, n);
+      assert (os.bufsize () == n);
+      to_stream (os, s);
+
+      ifdstream is (bf, fdopen_mode::binary, ifdstream::badbit, n);
+      assert (from_stream (is) == s);
+    }
+  }
+
+  // Change the buffer size of the open streams, preserving the buffered
+  // data.
+  //
+  {
+    ofdstream os (bf);
+    os << "ABC";
+    os.bufsize (4);
+    os << "DEF";
+    os.bufsize (1024);
+    os << "XYZ";
+
+    // The buffered data doesn't fit the new buffer.
+    //
+    try
+    {
+      os.bufsize (3);
+      assert (false);
+    }
+    catch (const ios::failure&)
+    {
+    }
+
+    os.close ();
+
+    ifdstream is (bf);
+    is.bufsize (2);
+    assert (is.get () == 'A');
+    is.bufsize (1);
+    assert (is.get () == 'B');
+    is.bufsize (4096);
+    assert (from_stream (is) == "CDEFXYZ");
+  }
+
+  // Write the data chunks with write_iov().
+  //
+  {
+    string s1 ("abc");
+    string s2 (20000, 'x');
+    string s3 ("def");
+
+    // All chunks fit the buffer (note: including the empty one), a chunk
+    // doesn't fit, and the chunk count exceeds the writev() limit.
+    //
+    vector<fdstream_iov> v;
+    string e;
+    for (size_t i (0); i != 5000; ++i)
+    {
+      v.push_back ({s1.data (), i % 3});
+      e.append (s1, 0, i % 3);
+    }
+
+    ofdstream os (bf, fdopen_mode::binary, ofdstream::badbit, 16);
+    os << '<';
+    os.write_iov ({{s1.data (), s1.size ()},
+                   {nullptr, 0},
+                   {s3.data (), s3.size ()}});
+    os.write_iov ({{s1.data (), s1.size ()},
+                   {s2.data (), s2.size ()},
+                   {s3.data (), s3.size ()}});
+    os.write_iov (v.data (), v.size ());
+    os << '>';
+    os.close ();
+
+    assert (from_file (bf) == '<' + s1 + s3 + s1 + s2 + s3 + e + '>');
+  }
+
+  assert (try_rmfile (bf) == rmfile_status::success);
+
   // Check that skip on close as requested.
   //
   {
@@ -647,6 +904,128 @@ main (int argc, const char* argv[])
       t.join ();
   }
 
+  // Test fdselector.
+  //
+  using sizes = pair<size_t, size_t>;
+  {
+    vector<fdpipe> pipes;
+    vector<size_t> ids;
+
+    for (size_t i (0); i != 100; ++i)
+    {
+      pipes.push_back (fdopen_pipe ());
+      ids.push_back (i);
+    }
+
+    fdselector fs;
+    assert (fs.empty ());
+
+    for (size_t i (0); i != pipes.size (); ++i)
+      fs.add_read (pipes[i].in.get (), &ids[i]);
+
+    try
+    {
+      fs.add_read (pipes[0].in.get ());
+      assert (false);
+    }
+    catch (const invalid_argument&) {}
+
+    // Nothing is ready.
+    //
+    assert (fs.wait (chrono::milliseconds (10)) == sizes (0, 0));
+
+    // Make some of the descriptors ready for reading.
+    //
+    auto ready = [&pipes] (size_t i)
+    {
+      assert (fdwrite (pipes[i].out.get (), "a", 1) == 1);
+    };
+
+    ready (3);
+    ready (42);
+    pipes[99].out.close (); // EOF.
+
+    pair<size_t, size_t> r (fs.wait ());
+    assert (r == sizes (3, 0));
+
+    vector<size_t> rs;
+    for (const fdselect_state& s: fs.read_ready ())
+    {
+      assert (s.ready);
+
+      size_t i (*static_cast<size_t*> (s.data));
+      assert (s.fd == pipes[i].in.get ());
+      rs.push_back (i);
+    }
+
+    sort (rs.begin (), rs.end ());
+    assert (rs == vector<size_t> ({3, 42, 99}));
+
+    // Wait for the write end to become ready.
+    //
+    fs.add_write (pipes[5].out.get (), &ids[5]);
+    assert (fs.wait () == sizes (3, 1));
+    assert (fs.write_ready ()[0].fd == pipes[5].out.get ());
+
+    // Stop waiting for the ready descriptors.
+    //
+    fs.remove_write (pipes[5].out.get ());
+    fs.remove_read (pipes[3].in.get ());
+    fs.remove_read (pipes[99].in.get ());
+
+    try
+    {
+      fs.remove_read (pipes[3].in.get ());
+      assert (false);
+    }
+    catch (const invalid_argument&) {}
+
+    r = fs.wait ();
+    assert (r == sizes (1, 0) &&
+            fs.read_ready ()[0].fd == pipes[42].in.get ());
+
+    // Regular files are always ready.
+    //
+    auto_fd fd (fdopen (f, fdopen_mode::in));
+    fs.add_read (fd.get ());
+    assert (fs.wait () == sizes (2, 0));
+    fs.remove_read (fd.get ());
+
+    for (size_t i (0); i != pipes.size (); ++i)
+    {
+      if (i != 3 && i != 99)
+        fs.remove_read (pipes[i].in.get ());
+    }
+
+    assert (fs.empty ());
+  }
+
+#ifndef _WIN32
+  // Test waiting on the descriptors beyond FD_SETSIZE, if the process
+  // descriptor limit allows.
+  //
+  {
+    fdpipe p (fdopen_pipe ());
+
+    int fd (fcntl (p.in.get (), F_DUPFD, 2048));
+    if (fd != -1)
+    {
+      auto_fd in (fd);
+      p.in.close ();
+
+      assert (fdwrite (p.out.get (), "a", 1) == 1);
+
+      fdselect_set rds {in.get ()};
+      assert (ifdselect (rds) == 1 && rds[0].ready);
+
+      fdselector fs;
+      fs.add_read (in.get ());
+      assert (fs.wait () == sizes (1, 0));
+      fs.remove_read (in.get ());
+    }
+  }
+#endif
+
   // Test setting and getting position via the non-standard fdstreambuf
   // interface.
   //
@@ -764,6 +1143,142 @@ main (int argc, const char* argv[])
     assert (from_stream (is) == "89");
   }
 
+  // Read the memory-mapped file.
+  //
+#ifndef _WIN32
+  const bool mmap_supported (true);
+#else
+  const bool mmap_supported (false);
+#endif
+
+  {
+    ifdstream is (fdopen (f, fdopen_mode::in), fdstream_mode::mmap);
+
+    const fdstreambuf* buf (dynamic_cast<const fdstreambuf*> (is.rdbuf ()));
+    assert (buf != nullptr && buf->mapped () == mmap_supported);
+
+    char c;
+    is.get (c);
+    assert (c == '0');
+
+    is.seekg (5, ios::beg);
+    is.get (c);
+    assert (c == '5');
+
+    is.seekg (2, ios::cur);
+    assert (static_cast<streamoff> (is.tellg ()) == 8);
+    assert (buf->tellg () == 8);
+
+    assert (from_stream (is) == "89");
+  }
+
+  // Map the file after some data has already been read and buffered, and
+  // with the custom logical position.
+  //
+  {
+    ifdstream is (fdopen (f, fdopen_mode::in), ifdstream::badbit, 100);
+
+    fdstreambuf* buf (dynamic_cast<fdstreambuf*> (is.rdbuf ()));
+    assert (buf != nullptr);
+
+    char c;
+    is.get (c);
+    assert (c == '0');
+
+    assert (buf->mmap () == mmap_supported);
+    assert (buf->tellg () == 101);
+
+    is.get (c);
+    assert (c == '1');
+
+    buf->seekg (8);
+    assert (buf->tellg () == 8);
+    assert (from_stream (is) == "89");
+  }
+
+#ifndef _WIN32
+  // Read the memory-mapped file exposed in multiple windows, making sure
+  // that the reading and seeking moves between them. Note that we use a
+  // small odd window size to exercise the same logic as for the default
+  // (1GB) windows of a large file.
+  //
+  {
+    path lf (td / path ("windows"));
+
+    const size_t w (4097);
+    const size_t n (w * 5 + 10);
+
+    string s;
+    for (size_t i (0); i != n; ++i)
+      s += static_cast<char> ('a' + i % 26);
+
+    to_file (lf, s);
+
+    size_t ow (fdstreambuf::map_window (w));
+
+    ifdstream is (fdopen (lf, fdopen_mode::in), fdstream_mode::mmap);
+
+    fdstreambuf* buf (dynamic_cast<fdstreambuf*> (is.rdbuf ()));
+    assert (buf != nullptr && buf->mapped ());
+
+    size_t p (0);
+    while (is.peek () != ifdstream::traits_type::eof ())
+    {
+      size_t k (buf->egptr () - buf->gptr ());
+      assert (k <= w && string (buf->gptr (), k) == s.substr (p, k));
+
+      buf->gbump (static_cast<int> (k));
+      p += k;
+      assert (buf->tellg () == p);
+    }
+
+    assert (p == n);
+
+    // Seek back into the middle of a window and read across its end.
+    //
+    is.clear ();
+    is.seekg (w * 2 - 1, ios::beg);
+
+    char c[3];
+    is.read (c, 3);
+    assert (string (c, 3) == s.substr (w * 2 - 1, 3));
+    assert (static_cast<size_t> (is.tellg ()) == w * 2 + 2);
+
+    is.close ();
+    fdstreambuf::map_window (ow);
+
+    assert (try_rmfile (lf) == rmfile_status::success);
+  }
+#endif
+
+  // Fallback to the buffered reading for an empty file and a pipe.
+  //
+  {
+    path ef (td / path ("empty"));
+    to_file (ef, "");
+
+    ifdstream is (fdopen (ef, fdopen_mode::in), fdstream_mode::mmap);
+
+    const fdstreambuf* buf (dynamic_cast<const fdstreambuf*> (is.rdbuf ()));
+    assert (buf != nullptr && !buf->mapped ());
+    assert (from_stream (is) == "");
+
+    assert (try_rmfile (ef) == rmfile_status::success);
+  }
+
+  {
+    fdpipe pipe (fdopen_pipe ());
+
+    ofdstream os (move (pipe.out));
+    ifdstream is (move (pipe.in), fdstream_mode::mmap);
+
+    const fdstreambuf* buf (dynamic_cast<const fdstreambuf*> (is.rdbuf ()));
+    assert (buf != nullptr && !buf->mapped ());
+
+    to_stream (os, text1);
+    assert (from_stream (is) == text1);
+  }
+
   // Seek for write.
   //
   {
@@ -966,6 +1481,77 @@ main (int argc, const char* argv[])
 
 #endif
 
+  // Test changing the pipe capacity and copying in kernel.
+  //
+  {
+    string d;
+    for (size_t i (0); i != 100 * 1024; ++i)
+      d += static_cast<char> ('0' + i % 75);
+
+    path sf (td / path ("splice"));
+    path cf (td / path ("splice-copy"));
+
+    {
+      ofdstream os (sf, fdopen_mode::binary);
+      os << d;
+      os.close ();
+    }
+
+    // Note that fdsplice() writes the whole file into the pipe before we
+    // start reading, so make sure it fits.
+    //
+    fdpipe pipe (fdopen_pipe (fdopen_mode::binary));
+    size_t n (fdpipe_size (pipe.in.get (), 1024 * 1024));
+
+#ifdef __linux__
+    assert (n >= 1024 * 1024);
+
+    {
+      auto_fd fd (fdopen (sf, fdopen_mode::in | fdopen_mode::binary));
+      assert (fdsplice (fd.get (), pipe.out.get ()));
+    }
+
+    pipe.out.close ();
+
+    ifdstream is (move (pipe.in), fdstream_mode::binary);
+    assert (is.read_text () == d);
+    is.close ();
+
+    // File to file.
+    //
+    {
+      auto_fd ifd (fdopen (sf, fdopen_mode::in | fdopen_mode::binary));
+      auto_fd ofd (fdopen (cf,
+                           fdopen_mode::out    |
+                           fdopen_mode::create |
+                           fdopen_mode::binary));
+
+      assert (fdsplice (ifd.get (), ofd.get ()));
+    }
+
+    assert (from_file (cf, fdopen_mode::binary) == d);
+
+    // Appending is not supported.
+    //
+    {
+      auto_fd ifd (fdopen (sf, fdopen_mode::in | fdopen_mode::binary));
+      auto_fd ofd (fdopen (cf,
+                           fdopen_mode::out    |
+                           fdopen_mode::append |
+                           fdopen_mode::binary));
+
+      assert (!fdsplice (ifd.get (), ofd.get ()));
+    }
+#else
+    assert (n == 0);
+
+    {
+      auto_fd fd (fdopen (sf, fdopen_mode::in | fdopen_mode::binary));
+      assert (!fdsplice (fd.get (), pipe.out.get ()));
+    }
+#endif
+  }
+
   // Test fdterm().
   //
   assert (!fdterm (fdopen_null ().get ())); // /dev/null is not a terminal.
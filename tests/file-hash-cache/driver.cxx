@@ -0,0 +1,203 @@
+// file      : tests/file-hash-cache/driver.cxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstddef> // size_t
+#include <iostream>
+#include <stdexcept> // invalid_argument
+#ifndef _WIN32
+#  include <thread>
+#endif
+
+#include <libbutl/path.hxx>
+#include <libbutl/xxh3.hxx>
+#include <libbutl/xxh64.hxx>
+#include <libbutl/sha256.hxx>
+#include <libbutl/fdstream.hxx>
+#include <libbutl/filesystem.hxx> // auto_rmfile
+#include <libbutl/file-hash-cache.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace butl;
+
+using algorithm = file_hash_cache::algorithm;
+
+static void
+write (const path& p, const string& s)
+{
+  ofdstream os (p);
+  os << s;
+  os.close ();
+}
+
+// Calculate the file checksum directly.
+//
+static string
+checksum (const path& p, algorithm a)
+{
+  ifdstream is (p, fdopen_mode::binary);
+
+  string r;
+  switch (a)
+  {
+  case algorithm::sha256:  r = sha256  (is).string (); break;
+  case algorithm::xxh64:   r = xxh64   (is).string (); break;
+  case algorithm::xxh3_64: r = xxh3_64 (is).string (); break;
+  }
+
+  is.close ();
+  return r;
+}
+
+static const algorithm algorithms[] = {
+  algorithm::sha256, algorithm::xxh64, algorithm::xxh3_64};
+
+// Usage: argv[0]
+//
+int
+main ()
+{
+  path cp (path::temp_path ("butl-file-hash-cache"));
+  auto_rmfile cr (cp);
+
+  path fp (path::temp_path ("butl-file-hash-cache-data"));
+  auto_rmfile fr (fp);
+
+  write (fp, "foo\nbar\n");
+
+  // Correctness.
+  //
+  {
+    file_hash_cache c (cp, 64);
+
+    for (algorithm a: algorithms)
+    {
+      assert (c.checksum (fp, a) == checksum (fp, a));
+      assert (c.checksum (fp, a, fdopen_mode::none) == checksum (fp, a));
+    }
+
+    assert (c.hits () + c.misses () == 6);
+
+    try
+    {
+      c.checksum (path::temp_path ("butl-file-hash-cache-none"),
+                  algorithm::sha256);
+      assert (false);
+    }
+    catch (const ios::failure&) {}
+  }
+
+#ifndef _WIN32
+  // Once the file timestamps are old enough, the checksum is stored and
+  // retrieved by subsequent lookups, including from a different instance.
+  //
+  {
+    file_hash_cache c (cp);
+
+    string cs (checksum (fp, algorithm::xxh64));
+    for (size_t i (0); i != 30 && c.hits () == 0; ++i)
+    {
+      assert (c.checksum (fp, algorithm::xxh64) == cs);
+      this_thread::sleep_for (chrono::milliseconds (200));
+    }
+
+    assert (c.hits () != 0);
+
+    file_hash_cache c2 (cp);
+    assert (c2.checksum (fp, algorithm::xxh64) == cs && c2.hits () == 1);
+
+    // The same file but a different algorithm is a miss.
+    //
+    assert (c2.checksum (fp, algorithm::xxh3_64) ==
+            checksum (fp, algorithm::xxh3_64));
+    assert (c2.misses () == 1);
+  }
+
+  // Modifying the file invalidates the cached checksum.
+  //
+  {
+    write (fp, "foo\nbaz\n");
+
+    file_hash_cache c (cp);
+    assert (c.checksum (fp, algorithm::xxh64) ==
+            checksum (fp, algorithm::xxh64));
+    assert (c.misses () == 1);
+  }
+
+  // Multiple processes (emulated with the instance per thread) sharing the
+  // same cache file.
+  //
+  {
+    vector<path> ps;
+    vector<auto_rmfile> rs;
+    vector<string> css;
+
+    for (size_t i (0); i != 16; ++i)
+    {
+      ps.push_back (path::temp_path ("butl-file-hash-cache-data"));
+      rs.emplace_back (ps.back ());
+
+      write (ps.back (), string (i * 1000 + 1, 'a' + i));
+      css.push_back (checksum (ps.back (), algorithm::sha256));
+    }
+
+    vector<thread> ts;
+    for (size_t i (0); i != 8; ++i)
+    {
+      ts.emplace_back ([&cp, &ps, &css] ()
+      {
+        file_hash_cache c (cp, 8);
+
+        for (size_t j (0); j != 20; ++j)
+          for (size_t k (0); k != ps.size (); ++k)
+            assert (c.checksum (ps[k], algorithm::sha256) == css[k]);
+      });
+    }
+
+    for (thread& t: ts)
+      t.join ();
+  }
+
+  // A file that is not a cache file is not overwritten.
+  //
+  write (cp, "garbage");
+
+  try
+  {
+    file_hash_cache c (cp);
+    assert (false);
+  }
+  catch (const invalid_argument&) {}
+
+  {
+    ifdstream is (cp);
+    assert (is.read_text () == "garbage");
+  }
+
+  // An invalid cache file (for example, created by an incompatible version)
+  // is reinitialized.
+  //
+  write (cp, string ("butlfhc\0", 8) + string (200000, '\xff'));
+
+  {
+    file_hash_cache c (cp);
+    assert (c.checksum (fp, algorithm::sha256) ==
+            checksum (fp, algorithm::sha256));
+  }
+
+  // As is an empty file.
+  //
+  write (cp, "");
+
+  {
+    file_hash_cache c (cp);
+    assert (c.checksum (fp, algorithm::sha256) ==
+            checksum (fp, algorithm::sha256));
+  }
+#endif
+}
@@ -2,11 +2,16 @@
 // license   : MIT; see accompanying LICENSE file
 
 #include <string>
+#include <vector>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
 #include <iostream>
 
 #include <libbutl/path.hxx>
 #include <libbutl/process.hxx>
 #include <libbutl/fdstream.hxx>
+#include <libbutl/timestamp.hxx>
 #include <libbutl/small-vector.hxx>
 
 #undef NDEBUG
@@ -33,6 +38,75 @@ run (I&& in,
                       forward<A> (args)...);
 }
 
+// Start the specified number of processes in batches of 100 jobs using
+// process_start() in a loop (searching for the program every time and with
+// the pre-searched program) and process_start_batch(), and print the
+// timings to stderr.
+//
+static void
+benchmark (const string& p, size_t n)
+{
+  static const size_t batch (100);
+
+  auto measure = [n] (const char* what, auto start)
+  {
+    timestamp t (system_clock::now ());
+
+    for (size_t i (0); i < n; i += batch)
+    {
+      vector<process> prs (start (min (batch, n - i)));
+
+      for (process& pr: prs)
+        assert (pr.wait ());
+    }
+
+    chrono::duration<double> d (system_clock::now () - t);
+
+    cerr << "  " << left << setw (20) << what << right
+         << fixed << setprecision (3)
+         << setw (8) << d.count () << " sec "
+         << setw (10) << setprecision (0) << n / d.count () << " proc/sec"
+         << endl;
+  };
+
+  cerr << n << " processes:" << endl;
+
+  measure ("process_start",
+           [&p] (size_t n)
+           {
+             vector<process> r;
+             for (size_t i (0); i != n; ++i)
+               r.push_back (process_start (0, 1, 2, p, "-c"));
+             return r;
+           });
+
+  process_env env (p);
+
+  measure ("process_start (env)",
+           [&env] (size_t n)
+           {
+             vector<process> r;
+             for (size_t i (0); i != n; ++i)
+               r.push_back (process_start (0, 1, 2, env, "-c"));
+             return r;
+           });
+
+  const char* args[] = {env.path->recall_string (), "-c", nullptr};
+
+  measure ("process_start_batch",
+           [&env, &args] (size_t n)
+           {
+             return process_start_batch (env,
+                                         vector<process_job> (n, {args}));
+           });
+}
+
+// Usage: argv[0] (-c ... | -p | -B [<num>])
+//
+// Run the tests (-p), act as a child (-c), or benchmark starting the
+// specified number of processes (1000 by default) individually and in
+// batches (-B).
+//
 int
 main (int argc, const char* argv[])
 {
@@ -47,6 +121,8 @@ main (int argc, const char* argv[])
     // -o write argument to stdout
     // -e write argument to stderr
     // -x exit with argument
+    // -b write argument number of 'o' and 'e' to stdout and stderr,
+    //    interleaving
     //
     for (int i (2); i != argc; ++i)
     {
@@ -56,10 +132,28 @@ main (int argc, const char* argv[])
       else if (a == "-o") cout << argv[++i] << endl;
       else if (a == "-e") cerr << argv[++i] << endl;
       else if (a == "-x") return atoi (argv[++i]);
+      else if (a == "-b")
+      {
+        string o (1024, 'o');
+        string e (1024, 'e');
+
+        for (size_t n (stoul (argv[++i])); n != 0; )
+        {
+          size_t k (min (n, o.size ()));
+          cout.write (o.data (), k) << flush;
+          cerr.write (e.data (), k) << flush;
+          n -= k;
+        }
+      }
     }
 
     return 0;
   }
+  else if (a == "-B")
+  {
+    benchmark (argv[0], argc > 2 ? stoul (argv[2]) : 1000);
+    return 0;
+  }
   else
     assert (a == "-p");
 
@@ -90,6 +184,97 @@ main (int argc, const char* argv[])
     assert (pr.wait ());
   }
 
+  // Capture stdout and stderr concurrently. Note that the amount of data
+  // exceeds the pipe capacity and so reading the streams one after another
+  // would deadlock.
+  //
+  {
+    const size_t n (1024 * 1024);
+
+    // String sinks.
+    //
+    {
+      fdpipe op (fdopen_pipe ());
+      fdpipe ep (fdopen_pipe ());
+
+      process pr (process_start (fdopen_null (), op, ep, p, "-c", "-b", n));
+
+      op.out.close ();
+      ep.out.close ();
+
+      string o, e;
+      process_sinks ss;
+      ss.emplace_back (move (op.in), o);
+      ss.emplace_back (move (ep.in), e, 1000);
+
+      process_capture (ss);
+      assert (pr.wait ());
+
+      assert (o == string (n, 'o') && !ss[0].truncated);
+      assert (e == string (1000, 'e') && ss[1].truncated);
+    }
+
+    // Stream and callback sinks.
+    //
+    {
+      fdpipe op (fdopen_pipe ());
+      fdpipe ep (fdopen_pipe ());
+
+      process pr (process_start (fdopen_null (), op, ep, p, "-c", "-b", n));
+
+      op.out.close ();
+      ep.out.close ();
+
+      ostringstream os;
+      size_t es (0);
+
+      process_sinks ss;
+      ss.emplace_back (move (op.in), os);
+      ss.emplace_back (move (ep.in),
+                       [&es] (const char* b, size_t n)
+                       {
+                         for (size_t i (0); i != n; ++i)
+                           assert (b[i] == 'e');
+
+                         es += n;
+                       });
+
+      process_capture (ss);
+      assert (pr.wait ());
+
+      assert (os.str () == string (n, 'o') && es == n);
+    }
+  }
+
+  // Start a batch of processes.
+  //
+  {
+    process_env env (p);
+
+    vector<string> os {"abc", "def", "xyz"};
+    vector<vector<const char*>> args;
+    vector<process_job> jobs;
+
+    for (const string& o: os)
+      args.push_back ({env.path->recall_string (), "-c", "-o", o.c_str (),
+                       nullptr});
+
+    for (const vector<const char*>& a: args)
+      jobs.push_back ({a.data (), 0, -1, 2});
+
+    vector<process> prs (process_start_batch (env, jobs));
+    assert (prs.size () == os.size ());
+
+    for (size_t i (0); i != prs.size (); ++i)
+    {
+      ifdstream is (move (prs[i].in_ofd));
+      assert (is.read_text () == os[i] + '\n');
+      is.close ();
+
+      assert (prs[i].wait ());
+    }
+  }
+
   // Argument conversion.
   //
   assert (run (0, 1, 2, p, "-c", "-o", "abc"));
@@ -400,4 +400,84 @@ main (int argc, const char* argv[])
     assert (p.exit->normal ());
     assert (p.exit->code () == 5);
   }
+
+  // Wait for a process with timeout.
+  //
+  {
+    process p (process_start (0, 1, 2, argv[0], "-s", 60));
+
+    assert (!p.timed_wait (chrono::milliseconds (100)));
+
+    p.kill ();
+
+    optional<bool> r (p.timed_wait (chrono::seconds (60)));
+    assert (r && !*r);
+    assert (!p.exit->normal ());
+
+    assert (p.termination_fd () == -1); // Already waited for.
+  }
+
+  {
+    process p (process_start (0, 1, 2, argv[0], "-s", 1, "-c", 5));
+
+    optional<bool> r (p.timed_wait (chrono::seconds (60)));
+    assert (r && !*r);
+    assert (p.exit->normal () && p.exit->code () == 5);
+  }
+
+  // Wait for a process termination together with its stdout.
+  //
+  {
+    fdpipe pipe (fdopen_pipe ());
+    process p (process_start (0, pipe, 2, argv[0], "-s", 1, "-e"));
+    pipe.out.close ();
+
+    int tfd (p.termination_fd ());
+
+    // Note that the termination descriptor is not supported on some
+    // platforms (Windows, etc).
+    //
+    if (tfd != -1)
+    {
+      assert (p.termination_fd () == tfd); // Cached.
+
+      ifdstream is (move (pipe.in), fdstream_mode::non_blocking);
+
+      fdselector fs;
+      fs.add_read (is.fd ());
+      fs.add_read (tfd);
+
+      string o;
+      for (bool term (false); !term; )
+      {
+        fs.wait ();
+
+        for (const fdselect_state& s: fs.read_ready ())
+        {
+          if (s.fd == tfd)
+          {
+            term = true;
+          }
+          else if (s.fd == is.fd ())
+          {
+            char buf[256];
+            for (streamsize n; (n = is.readsome (buf, sizeof (buf))) > 0; )
+              o.append (buf, static_cast<size_t> (n));
+
+            if (is.eof ())
+              fs.remove_read (is.fd ());
+          }
+        }
+      }
+
+      fs.remove_read (tfd);
+
+      assert (p.try_wait () && *p.try_wait ());
+      is.close ();
+
+      assert (o.empty () || o == "exiting");
+    }
+    else
+      assert (p.wait ());
+  }
 }
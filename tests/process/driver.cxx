@@ -1,14 +1,20 @@
 // file      : tests/process/driver.cxx -*- C++ -*-
 // license   : MIT; see accompanying LICENSE file
 
+#ifndef _WIN32
+#  include <sys/resource.h> // getrlimit()
+#endif
+
 #include <ios>
 #include <string>
 #include <vector>
 #include <chrono>
+#include <thread>
 #include <sstream>
 #include <iterator>  // istreambuf_iterator, ostream_iterator
 #include <algorithm> // copy()
 #include <iostream>
+#include <stdexcept> // invalid_argument
 
 #include <libbutl/path.hxx>
 #include <libbutl/utility.hxx>    // setenv(), getenv()
@@ -25,6 +31,7 @@ using namespace std;
 using namespace butl;
 
 using cstrings = vector<const char*>;
+using sizes = pair<size_t, size_t>;
 
 bool
 roundtrip_arg (const path& p, const string& a)
@@ -213,11 +220,311 @@ exec (const path& p,
     p, vector<char> (i.begin (), i.end ()), o, e, pipeline, false, wd, env);
 }
 
+// Test process_set.
+//
+static void
+process_set_test (const path& p)
+{
+  string ps (p.string ());
+
+  // Wait for multiple processes, in any order.
+  //
+  {
+    cstrings args {ps.c_str (), "-a", nullptr};
+
+    vector<process> prs;
+    for (size_t i (0); i != 5; ++i)
+      prs.emplace_back (args.data (), 0, -2, 2);
+
+    process_set s;
+    for (process& pr: prs)
+      s.add (pr, &pr);
+
+    assert (s.size () == 5);
+
+    size_t n (0);
+    while (!s.empty ())
+    {
+      sizes r (s.wait ());
+      assert (r.first != 0 && r.second == 0);
+
+      for (const process_set::entry& e: s.terminated ())
+      {
+        assert (e.proc == e.data);
+        assert (e.proc->exit && e.proc->exit->normal () && *e.proc->exit);
+        ++n;
+      }
+    }
+
+    assert (n == 5);
+  }
+
+  // Wait with timeout for a process that is blocked reading its stdin, also
+  // waiting for its stdout to become ready.
+  //
+  {
+    cstrings args {ps.c_str (), "-c", nullptr};
+    process pr (args.data (), -1, -1, -2);
+
+    process_set s;
+    s.add (pr);
+    s.add_read (pr.in_ofd.get ());
+
+    assert (s.wait (chrono::milliseconds (50)) == sizes (0, 0));
+    assert (s.terminated ().empty () && s.read_ready ().empty ());
+
+    {
+      ofdstream os (move (pr.out_fd));
+      os << "abc";
+      os.close ();
+    }
+
+    // The output may become ready before or after the process terminates.
+    //
+    bool t (false);
+    bool r (false);
+    string o;
+
+    while (!t || !r)
+    {
+      sizes rs (s.wait ());
+      assert (rs.first + rs.second != 0);
+
+      if (rs.first != 0)
+      {
+        assert (!t && s.terminated ()[0].proc == &pr);
+        t = true;
+      }
+
+      if (rs.second != 0)
+      {
+        assert (s.read_ready ()[0].fd == pr.in_ofd.get ());
+        s.remove_read (pr.in_ofd.get ());
+        r = true;
+      }
+    }
+
+    assert (s.empty ());
+    assert (pr.exit && *pr.exit);
+
+    ifdstream is (move (pr.in_ofd));
+    assert (is.read_text () == "abc");
+  }
+
+  // Add and remove, including an already terminated process.
+  //
+  {
+    cstrings args {ps.c_str (), "-a", nullptr};
+    process p1 (args.data (), 0, -2, 2);
+    process p2 (process_exit (0));
+
+    process_set s;
+    s.add (p1);
+    s.add (p2);
+    assert (s.size () == 2);
+
+    s.remove (p1);
+    assert (s.size () == 1);
+
+    try
+    {
+      s.remove (p1);
+      assert (false);
+    }
+    catch (const invalid_argument&) {}
+
+    assert (s.wait () == sizes (1, 0) && s.terminated ()[0].proc == &p2);
+    assert (s.empty ());
+
+    try
+    {
+      s.wait ();
+      assert (false);
+    }
+    catch (const invalid_argument&) {}
+
+    assert (p1.wait ());
+  }
+
+  // Processes that were waited for outside the set are reported as
+  // terminated or can be removed.
+  //
+  {
+    cstrings args {ps.c_str (), "-a", nullptr};
+    process p1 (args.data (), 0, -2, 2);
+    process p2 (args.data (), 0, -2, 2);
+
+    process_set s;
+    s.add (p1);
+    s.add (p2);
+
+    assert (p1.wait () && p2.wait ());
+
+    s.remove (p2);
+    assert (s.wait () == sizes (1, 0) && s.terminated ()[0].proc == &p1);
+    assert (s.empty ());
+
+    // A process can only be waited on by one set at a time.
+    //
+    process p3 (args.data (), 0, -2, 2);
+    s.add (p3);
+
+    if (p3.termination_fd () != -1)
+    {
+      process_set s2;
+
+      try
+      {
+        s2.add (p3);
+        assert (false);
+      }
+      catch (const invalid_argument&) {}
+    }
+
+    s.remove (p3);
+    assert (p3.wait ());
+  }
+}
+
+// Spawn the specified number of trivial children, keeping up to 64 of them
+// running at any time, and wait for them either by spinning over
+// process::try_wait() or via process_set. Print the results to stderr.
+//
+static void
+process_set_benchmark (const path& p, size_t n)
+{
+  using namespace chrono;
+
+  string ps (p.string ());
+  cstrings args {ps.c_str (), "-a", nullptr};
+
+  const size_t jobs (64);
+
+  auto measure = [n] (const char* what, auto run)
+  {
+    auto s (steady_clock::now ());
+    run ();
+    double d (chrono::duration<double> (steady_clock::now () - s).count ());
+
+    cerr << "  " << what << ": " << d << " sec, "
+         << (d != 0 ? n / d : 0) << " processes/sec" << endl;
+  };
+
+  cerr << n << " processes, " << jobs << " jobs:" << endl;
+
+  measure ("try_wait   ", [n, jobs, &args] ()
+  {
+    vector<process> prs;
+    size_t spawned (0);
+
+    while (spawned != n || !prs.empty ())
+    {
+      for (; spawned != n && prs.size () != jobs; ++spawned)
+        prs.emplace_back (args.data (), 0, -2, 2);
+
+      for (auto i (prs.begin ()); i != prs.end (); )
+      {
+        if (i->try_wait ())
+        {
+          assert (*i->exit);
+          i = prs.erase (i);
+        }
+        else
+          ++i;
+      }
+    }
+  });
+
+  measure ("process_set", [n, jobs, &args] ()
+  {
+    // Note that the process objects must stay put while in the set.
+    //
+    vector<process> prs (jobs);
+    vector<process*> free;
+    for (process& pr: prs)
+      free.push_back (&pr);
+
+    process_set s;
+    size_t spawned (0);
+
+    while (spawned != n || !s.empty ())
+    {
+      for (; spawned != n && !free.empty (); ++spawned)
+      {
+        process* pr (free.back ());
+        free.pop_back ();
+
+        *pr = process (args.data (), 0, -2, 2);
+        s.add (*pr);
+      }
+
+      s.wait ();
+
+      for (const process_set::entry& e: s.terminated ())
+      {
+        assert (*e.proc->exit);
+        free.push_back (e.proc);
+      }
+    }
+  });
+}
+
+// Spawn (and wait for) the specified number of trivial children from the
+// specified number of threads, with the serialized and concurrent child
+// process startup. Print the results to stderr.
+//
+static void
+spawn_benchmark (const path& p, size_t threads, size_t n)
+{
+  using namespace chrono;
+
+  string ps (p.string ());
+
+  auto measure = [&ps, threads, n] (bool concurrent)
+  {
+    bool c (process::concurrent_startup (concurrent));
+
+    auto s (steady_clock::now ());
+
+    vector<thread> ts;
+    for (size_t i (0); i != threads; ++i)
+    {
+      ts.emplace_back ([&ps, threads, n, i] ()
+      {
+        cstrings args {ps.c_str (), "-a", nullptr};
+
+        for (size_t j (i); j < n; j += threads)
+        {
+          process pr (args.data (), 0, -2, 2);
+          assert (pr.wait ());
+        }
+      });
+    }
+
+    for (thread& t: ts)
+      t.join ();
+
+    double d (chrono::duration<double> (steady_clock::now () - s).count ());
+
+    cerr << "  " << (concurrent ? "concurrent" : "serialized") << ": " << d
+         << " sec, " << (d != 0 ? n / d : 0) << " processes/sec" << endl;
+
+    process::concurrent_startup (c);
+  };
+
+  cerr << n << " processes, " << threads << " threads:" << endl;
+
+  measure (false);
+  measure (true);
+}
+
 // Usages:
 //
 // argv[0]
 // argv[0] -a <args>
 // argv[0] -c [-b] [-e] [<cwd>]
+// argv[0] -s [<num>]
+// argv[0] -t <threads> [<num>]
 //
 // In the first form run some basic process execution/communication tests.
 //
@@ -227,6 +534,13 @@ exec (const path& p,
 // STDERR. Also check if the working directory argument matches the current
 // directory, if specified.
 //
+// In the fourth form benchmark waiting for the specified number of trivial
+// child processes (10000 by default) and print the results to STDERR.
+//
+// In the fifth form benchmark starting the specified number of trivial child
+// processes (10000 by default) from the specified number of threads and print
+// the results to STDERR.
+//
 // -b
 //    Set binary mode for the standard streams.
 //
@@ -254,6 +568,39 @@ main (int argc, const char* argv[])
     return 0;
   }
 
+#ifndef _WIN32
+  if (argc > 1 && string (argv[1]) == "-l")
+  {
+    for (int r: {RLIMIT_NOFILE, RLIMIT_CPU})
+    {
+      rlimit l;
+      assert (getrlimit (r, &l) == 0);
+      cout << l.rlim_cur << endl;
+    }
+
+    return 0;
+  }
+#endif
+
+  if (argc > 1 && string (argv[1]) == "-s")
+  {
+    assert (argc <= 3);
+
+    process_set_benchmark (path (argv[0]),
+                           argc == 3 ? stoul (argv[2]) : 10000);
+    return 0;
+  }
+
+  if (argc > 2 && string (argv[1]) == "-t")
+  {
+    assert (argc <= 4);
+
+    spawn_benchmark (path (argv[0]),
+                     stoul (argv[2]),
+                     argc == 4 ? stoul (argv[3]) : 10000);
+    return 0;
+  }
+
   int i (1);
   for (; i != argc; ++i)
   {
@@ -416,6 +763,43 @@ main (int argc, const char* argv[])
   //
   assert (exec (p, string (), false, false, false, dir_path (), true));
 
+  // Start processes using the reusable startup specification.
+  //
+  {
+    const char* evars[] = {
+      "PAR1", "PAR2=2P", "PAR6=66", "PAR7",
+      "THR1", "THR2=2T",
+      "CHD1",
+      "CHD2=C2",
+      nullptr};
+
+    process_spawn_spec ps (p.string ().c_str (), -2, -2, 2, nullptr, evars);
+
+    cstrings args {p.string ().c_str (), "-c", "-e", nullptr};
+
+    for (size_t i (0); i != 3; ++i)
+    {
+      process pr (ps.start (args));
+      assert (pr.wait ());
+    }
+
+    // Check that the arguments vary.
+    //
+    process_spawn_spec as (process::path_search (p, false), 0, -1, 2);
+
+    for (const char* a: {"abc", "xyz"})
+    {
+      cstrings args {p.string ().c_str (), "-a", a, nullptr};
+
+      process pr (as.start (args));
+      ifdstream is (move (pr.in_ofd));
+      assert (is.read_text () == string (a) + '\n');
+      is.close ();
+
+      assert (pr.wait ());
+    }
+  }
+
   // Transmit large binary data through the child.
   //
   vector<char> v;
@@ -434,6 +818,202 @@ main (int argc, const char* argv[])
   assert (exec (p, v, true, true));
   assert (exec (p, v, true, true, true)); // Same as above but with piping.
 
+  // Transmit large binary data through the multi-stage pipeline.
+  //
+  {
+    cstrings args {p.string ().c_str (), "-c", "-b", nullptr};
+
+    vector<process_pipeline::stage> ss (3, {nullptr, args.data ()});
+    process_pipeline pl (ss, -1, -1, -2, 1024 * 1024);
+
+    assert (pl.processes.size () == 3);
+
+    ofdstream os (move (pl.processes.front ().out_fd), fdstream_mode::binary);
+    copy (v.begin (), v.end (), ostream_iterator<char> (os));
+    os.close ();
+
+    ifdstream is (move (pl.processes.back ().in_ofd), fdstream_mode::binary);
+
+    vector<char> o ((istreambuf_iterator<char> (is)),
+                    istreambuf_iterator<char> ());
+    is.close ();
+
+    assert (o == v);
+    assert (pl.wait ());
+
+    try
+    {
+      process_pipeline pl ({});
+      assert (false);
+    }
+    catch (const invalid_argument&) {}
+  }
+
+  // Collect the child process resource usage statistics.
+  //
+  {
+    cstrings args {p.string ().c_str (), "-c", "-b", nullptr};
+
+    process pr (args.data (), -1, -2, -2);
+
+    ofdstream os (move (pr.out_fd), fdstream_mode::binary);
+    copy (v.begin (), v.end (), ostream_iterator<char> (os));
+    os.close ();
+
+    assert (pr.wait ());
+
+    const optional<process_stats>& s (pr.exit->stats);
+    assert (s);
+    assert (s->wall_time.count () > 0);
+    assert (s->max_rss != 0);
+    assert (!to_string (*s).empty ());
+
+    // Make sure the statistics are preserved by try_wait() as well.
+    //
+    assert (pr.try_wait () && pr.exit->stats);
+  }
+
+  // Apply the resource limits.
+  //
+  {
+    process_limits ls;
+    ls.open_files = 64;
+    ls.cpu_time = 100;
+
+    process_path pp (process::path_search (p, false));
+
+#ifndef _WIN32
+    const char* args[] = {p.string ().c_str (), "-l", nullptr};
+
+    try
+    {
+      process pr (pp, args, 0, -1, 2, nullptr, nullptr, ls);
+
+      ifdstream is (move (pr.in_ofd));
+      assert (is.read_text () == "64\n100\n");
+      is.close ();
+
+      assert (pr.wait ());
+    }
+    catch (const process_error& e)
+    {
+      if (e.child)
+        exit (1);
+
+      assert (false);
+    }
+
+#ifdef __linux__
+    // Fail to move the child into a non-existent cgroup.
+    //
+    ls.cgroup = dir_path ("/nonexistent-butl-cgroup");
+
+    try
+    {
+      process pr (pp, args, 0, -2, 2, nullptr, nullptr, ls);
+      assert (!pr.wait ());
+    }
+    catch (const process_error& e)
+    {
+      if (e.child)
+        exit (1);
+
+      assert (false);
+    }
+#endif
+#else
+    const char* args[] = {p.string ().c_str (), "-a", nullptr};
+
+    try
+    {
+      process pr (pp, args, 0, -2, 2, nullptr, nullptr, ls);
+      assert (false);
+    }
+    catch (const process_error& e)
+    {
+      assert (e.code ().value () == ENOTSUP);
+    }
+#endif
+  }
+
+  // Wait for multiple processes at once.
+  //
+  process_set_test (p);
+
+  // Cache the executable path search results.
+  //
+  {
+    path fp (p);
+    fp.complete ().normalize ();
+
+    string ds (fp.directory ().string ());
+    string ls (fp.leaf ().string ());
+
+    bool c (process::path_cache (true));
+    process::path_cache_clear ();
+
+    auto search = [] (const string& f, const string& ps)
+    {
+      return process::try_path_search (f, true, dir_path (), false,
+                                       ps.c_str ());
+    };
+
+    auto stats = [] ()
+    {
+      process::path_cache_stats_type s (process::path_cache_stats ());
+      return sizes (s.hits, s.misses);
+    };
+
+    // Note that a non-existent directory is never considered as recently
+    // modified and thus the result is always cached.
+    //
+    string ns ((dir_path::temp_directory () /
+                dir_path ("butl-process-nonexistent")).string ());
+
+    assert (search (ls, ns).empty () && stats () == sizes (0, 1));
+    assert (search (ls, ns).empty () && stats () == sizes (1, 1));
+
+    // Note that the directory containing the driver may have been modified
+    // recently and so the result may not be cached.
+    //
+    assert (search (ls, ds).effect == fp && stats ().second == 2);
+    assert (search (ls, ds).effect == fp);
+    assert (stats ().first + stats ().second == 4);
+
+    // Relative paths are never cached.
+    //
+    string rs (":" + ds);
+    assert (process::try_path_search (
+              ls, true, dir_path (), false, rs.c_str ()).effect == fp);
+
+    assert (stats ().first + stats ().second == 4);
+
+    process::path_cache_clear ();
+    assert (stats () == sizes (0, 0));
+
+    process::path_cache (c);
+  }
+
+  // Start processes concurrently from multiple threads.
+  //
+  {
+    bool c (process::concurrent_startup (true));
+    assert (!c);
+
+    vector<thread> ts;
+    for (size_t i (0); i != 4; ++i)
+      ts.emplace_back ([&p, &s] ()
+                       {
+                         for (size_t i (0); i != 10; ++i)
+                           assert (exec (p, s, true, true, true));
+                       });
+
+    for (thread& t: ts)
+      t.join ();
+
+    assert (process::concurrent_startup (c));
+  }
+
   // Execute the child using the full path.
   //
   path fp (p);
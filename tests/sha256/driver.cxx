@@ -1,12 +1,21 @@
 // file      : tests/sha256/driver.cxx -*- C++ -*-
 // license   : MIT; see accompanying LICENSE file
 
+#include <array>
 #include <string>
+#include <vector>
+#include <utility> // pair
+#include <chrono>
 #include <cstddef> // size_t
+#include <cstdint> // uint32_t
+#include <iomanip>
+#include <iostream>
+#include <stdexcept> // invalid_argument
 
 #include <libbutl/path.hxx>
 #include <libbutl/sha256.hxx>
 #include <libbutl/fdstream.hxx>
+#include <libbutl/timestamp.hxx>
 #include <libbutl/filesystem.hxx> // auto_rmfile
 
 #undef NDEBUG
@@ -15,9 +24,131 @@
 using namespace std;
 using namespace butl;
 
+// Generate the pseudo-random data of the specified size.
+//
+static string
+data (size_t n)
+{
+  string r (n, '\0');
+
+  uint32_t x (2463534242U);
+  for (char& c: r)
+  {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    c = static_cast<char> (x);
+  }
+
+  return r;
+}
+
+// Hash the data appending it in the chunks of the specified size.
+//
+static string
+chunked_sha256 (const string& d, size_t chunk)
+{
+  sha256 h;
+  for (size_t i (0); i < d.size (); i += chunk)
+    h.append (d.data () + i, min (chunk, d.size () - i));
+
+  return h.string ();
+}
+
+// Print the throughput of the portable and hardware-accelerated (if
+// supported) implementations for the data of the specified size, hashing
+// the data chunks one by one as well as in batches (serially and using all
+// the hardware threads).
+//
+static void
+benchmark (size_t size)
+{
+  string d (data (size));
+
+  // Hash at least 1GB in total.
+  //
+  size_t n (max<size_t> (1024 * 1024 * 1024 / size, 1));
+
+  // Hash in batches of up to 4096 chunks (of the same data).
+  //
+  size_t k (min<size_t> (n, 4096));
+  vector<pair<const void*, size_t>> in (k, make_pair (d.data (), d.size ()));
+
+  auto measure = [&d, n] (const string& what, auto hash)
+  {
+    timestamp t (system_clock::now ());
+
+    hash ();
+
+    chrono::duration<double> s (system_clock::now () - t);
+    double mb (static_cast<double> (d.size ()) * n / 1024 / 1024);
+
+    cerr << "  " << left << setw (18) << what << right
+         << fixed << setprecision (2)
+         << setw (10) << s.count () << " sec "
+         << setw (10) << mb / s.count () << " MB/sec" << endl;
+  };
+
+  auto measure_all = [&measure, &d, &in, n, k] (const string& what)
+  {
+    measure (what, [&d, n] ()
+    {
+      for (size_t i (0); i != n; ++i)
+        sha256 (d.data (), d.size ()).binary ();
+    });
+
+    for (size_t t: {1, 0})
+    {
+      measure (what + (t == 1 ? "-batch" : "-batch-mt"), [&in, n, k, t] ()
+      {
+        for (size_t i (0); i < n; i += k)
+          sha256_batch (in, t);
+      });
+    }
+
+    measure (what + "-tree-mt", [&d, n] ()
+    {
+      for (size_t i (0); i != n; ++i)
+        sha256_tree (d.data (), d.size (), 64 * 1024).binary ();
+    });
+  };
+
+  cerr << size << " bytes x " << n << ':' << endl;
+
+  bool hw (sha256::hardware_acceleration (false));
+  measure_all ("portable");
+  sha256::hardware_acceleration (hw);
+
+  if (sha256::hardware_acceleration ())
+    measure_all ("hardware");
+}
+
+// Usage: argv[0] [-b [<size>...]]
+//
+// Test sha256 or, if -b is specified, benchmark hashing of the data of the
+// specified sizes (64, 4096, and 1048576 bytes by default) and print the
+// results to stderr.
+//
 int
-main ()
+main (int argc, const char* argv[])
 {
+  if (argc > 1)
+  {
+    assert (string (argv[1]) == "-b");
+
+    vector<size_t> sizes;
+    for (int i (2); i != argc; ++i)
+      sizes.push_back (stoul (argv[i]));
+
+    if (sizes.empty ())
+      sizes = {64, 4096, 1024 * 1024};
+
+    for (size_t s: sizes)
+      benchmark (s);
+
+    return 0;
+  }
+
   assert (string (sha256 ().string ()) ==
           "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
 
@@ -82,6 +213,175 @@ main ()
     assert (string (h.string ()) == sha256 (&c, 1).string ());
   }
 
+  // Test the known answers (FIPS 180-2 examples) as well as the
+  // bit-identical results of the hardware-accelerated (if supported) and
+  // portable implementations for various data sizes and chunkings.
+  //
+  {
+    auto check = [] (const string& d, const char* r)
+    {
+      assert (string (sha256 (d.data (), d.size ()).string ()) == r);
+    };
+
+    auto test = [&check] ()
+    {
+      check ("abc",
+             "ba7816bf8f01cfea414140de5dae2223"
+             "b00361a396177a9cb410ff61f20015ad");
+
+      check ("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+             "248d6a61d20638b8e5c026930c3e6039"
+             "a33ce45964ff2167f6ecedd419db06c1");
+
+      check (string (1000000, 'a'),
+             "cdc76e5c9914fb9281a1c7e284d73e67"
+             "f1809a48a497200e046d39ccc7112cd0");
+    };
+
+    test ();
+
+    bool hw (sha256::hardware_acceleration (false));
+    assert (!sha256::hardware_acceleration ());
+
+    test ();
+
+    // Calculate the reference checksums using the portable implementation.
+    //
+    const size_t sizes[] = {0, 1, 55, 56, 63, 64, 65, 127, 128, 129, 1000,
+                            4096, 100003};
+
+    const size_t chunks[] = {1, 7, 64, 100, 4096, 100003};
+
+    vector<string> rs;
+    for (size_t n: sizes)
+      rs.push_back (chunked_sha256 (data (n), 100003));
+
+    sha256::hardware_acceleration (hw);
+
+    for (size_t i (0); i != rs.size (); ++i)
+    {
+      string d (data (sizes[i]));
+
+      for (size_t c: chunks)
+        assert (chunked_sha256 (d, c) == rs[i]);
+    }
+  }
+
+  // Test the batch hashing, with the hardware acceleration (if supported)
+  // and without, serially and using multiple threads.
+  //
+  {
+    vector<string> ds;
+    for (size_t i (0); i != 1000; ++i)
+      ds.push_back (data (i * 37 % 300 + (i % 50 == 0 ? 100000 : 0)));
+
+    vector<pair<const void*, size_t>> in;
+    for (const string& d: ds)
+      in.emplace_back (d.data (), d.size ());
+
+    vector<string> rs;
+    for (const string& d: ds)
+      rs.push_back (sha256 (d.data (), d.size ()).string ());
+
+    auto test = [&in, &rs] (size_t threads)
+    {
+      for (size_t n: {size_t (0), size_t (1), size_t (2), size_t (3),
+                      in.size ()})
+      {
+        vector<pair<const void*, size_t>> i (in.begin (), in.begin () + n);
+        vector<array<uint8_t, 32>> r (sha256_batch (i, threads));
+
+        assert (r.size () == n);
+
+        for (size_t j (0); j != n; ++j)
+        {
+          string s;
+          for (uint8_t b: r[j])
+          {
+            const char* x ("0123456789abcdef");
+            s += x[b >> 4];
+            s += x[b & 0x0f];
+          }
+
+          assert (s == rs[j]);
+        }
+      }
+    };
+
+    test (1);
+    test (4);
+    test (0);
+
+    bool hw (sha256::hardware_acceleration (false));
+
+    test (1);
+    test (4);
+
+    sha256::hardware_acceleration (hw);
+  }
+
+  // Test the tree checksum calculation. Verify the result against the
+  // checksum calculated manually and check that it doesn't depend on the
+  // way the data is appended and on the number of threads.
+  //
+  {
+    auto manual = [] (const string& d, size_t cs)
+    {
+      sha256 r;
+      for (size_t i (0); i < d.size (); i += cs)
+        r.append (sha256 (d.data () + i, min (cs, d.size () - i)).binary (),
+                  32);
+
+      unsigned char s[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+      for (size_t i (8), v (cs); i != 0; --i, v >>= 8)
+        s[i - 1] = static_cast<unsigned char> (v);
+
+      r.append (s, 8);
+      return string (r.string ());
+    };
+
+    for (size_t n: {size_t (0), size_t (1), size_t (4096), size_t (100003)})
+    {
+      string d (data (n));
+
+      for (size_t cs: {size_t (64), size_t (1000), size_t (4096)})
+      {
+        string r (manual (d, cs));
+
+        for (size_t t: {1, 4})
+        {
+          assert (sha256_tree (d.data (), d.size (), cs, t).string () == r);
+
+          for (size_t c: {1, 7, 1000, 5000})
+          {
+            sha256_tree h (cs, t);
+            for (size_t i (0); i < d.size (); i += c)
+              h.append (d.data () + i, min (c, d.size () - i));
+
+            assert (h.string () == r);
+          }
+        }
+      }
+    }
+
+    // The tree checksum differs from the plain one as well as between the
+    // chunk sizes.
+    //
+    string d (data (10000));
+    assert (string (sha256_tree (d.data (), d.size (), 1000).string ()) !=
+            sha256 (d.data (), d.size ()).string ());
+
+    assert (string (sha256_tree (d.data (), d.size (), 1000).string ()) !=
+            sha256_tree (d.data (), d.size (), 2000).string ());
+
+    try
+    {
+      sha256_tree h (0);
+      assert (false);
+    }
+    catch (const invalid_argument&) {}
+  }
+
   //
   //
   string fp ("F4:9D:C0:02:C6:B6:62:06:A5:48:AE:87:35:32:95:64:C2:B8:C9:6D:9B:"
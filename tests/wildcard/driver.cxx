@@ -2,10 +2,12 @@
 // license   : MIT; see accompanying LICENSE file
 
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
+#include <cstddef>      // size_t
 #include <iostream>
-#include <algorithm>    // sort()
+#include <algorithm>    // sort(), find()
 #include <exception>
 #include <functional>
 #include <system_error>
@@ -37,14 +39,16 @@ int _CRT_glob = 0;
 // Usages:
 //
 // argv[0] -mn <name> <pattern>
-// argv[0] -sd [-i] [-n] <pattern> [<dir>]
-// argv[0] -sp [-i] [-n] <path> <pattern> [<dir>]
+// argv[0] -sd [-i] [-n] [-c] [-b] [-j <num>] [-o] <pattern> [<dir>]
+// argv[0] -sp [-i] [-n] [-c] <path> <pattern> [<dir>]
+// argv[0] -sm [-i] [-d (print|stop)] <dir> [-x] <pattern> [[-x] <pattern>...]
 //
 // Execute actions specified by the first option. Exit with code 0 if succeed,
 // 1 if fail, 2 on the underlying OS error (print error description to STDERR).
 //
 // -mn
-//    Match a name against the pattern.
+//    Match a name against the pattern. Also assert that the result is the
+//    same if matching against the compiled pattern.
 //
 // -sd
 //    Search for paths matching the pattern in the directory specified (absent
@@ -62,6 +66,15 @@ int _CRT_glob = 0;
 //    through contains only the specified entry. The start directory is used if
 //    the first pattern component is a self-matching wildcard.
 //
+// -sm
+//    Search for paths matching the pattern set in the directory specified
+//    (empty string means the current one). The patterns preceded with -x are
+//    exclude patterns. Print the matching paths followed by the indexes of
+//    the include patterns matched to STDOUT in the ascending order. Succeed
+//    if at least one matching path is found. For each matching path assert
+//    that it matches the pattern set and exactly the reported include
+//    patterns.
+//
 // -d (print|stop)
 //    If a inaccessible/dangling link is encountered, then print its path to
 //    stderr and, optionally, stop the search. Meaningful in combination with
@@ -76,6 +89,25 @@ int _CRT_glob = 0;
 //    Do not sort paths found. Meaningful in combination with -sd or -sp
 //    options and must follow it, if specified in the command line.
 //
+// -c
+//    Compile the pattern and search using the compiled pattern. Meaningful in
+//    combination with -sd or -sp options and must follow it, if specified in
+//    the command line.
+//
+// -b
+//    Traverse the directory tree breadth-first. Meaningful in combination
+//    with -sd and must follow it, if specified in the command line.
+//
+// -j <num>
+//    Search in the specified number of threads (0 means the number of
+//    hardware threads). Meaningful in combination with -sd and must follow
+//    it, if specified in the command line.
+//
+// -o
+//    Request the final matches to be reported in the path order. Meaningful
+//    in combination with -sd and must follow it, if specified in the command
+//    line.
+//
 int
 main (int argc, const char* argv[])
 try
@@ -92,7 +124,22 @@ try
 
     string name (argv[2]);
     string pattern (argv[3]);
-    return path_match (name, pattern) ? 0 : 1;
+
+    bool r (path_match (name, pattern));
+
+    // Note that the compiled pattern is constructed from path and so we skip
+    // the patterns that are not valid simple paths.
+    //
+    try
+    {
+      path p (pattern);
+
+      if (!p.empty () && p.simple ())
+        assert (path_match (name, compiled_path_pattern (move (p))) == r);
+    }
+    catch (const invalid_path&) {}
+
+    return r ? 0 : 1;
   }
   else if (op == "-sd" || op == "-sp")
   {
@@ -101,6 +148,11 @@ try
     bool sort (true);
     path_match_flags flags (path_match_flags::follow_symlinks);
 
+    bool compile (false);
+    path_search_order order (path_search_order::depth_first);
+    size_t threads (1);
+    bool sorted (false);
+
     bool dangle_stop (false);
     function<bool (const dir_entry&)> dangle_func;
 
@@ -112,6 +164,25 @@ try
         sort = false;
       else if (o == "-i")
         flags |= path_match_flags::match_absent;
+      else if (o == "-c")
+        compile = true;
+      else if (o == "-b")
+      {
+        assert (op == "-sd");
+        order = path_search_order::breadth_first;
+      }
+      else if (o == "-j")
+      {
+        ++i;
+
+        assert (op == "-sd" && i != argc);
+        threads = stoul (argv[i]);
+      }
+      else if (o == "-o")
+      {
+        assert (op == "-sd");
+        sorted = true;
+      }
       else if (o == "-d")
       {
         ++i;
@@ -164,10 +235,17 @@ try
     vector<path> paths;
     map<path, size_t> path_count;
 
-    auto add = [&paths, &path_count, &start] (path&& p,
-                                              const string& pt,
-                                              bool interim)
+    // Note that the callback can be called concurrently if searching in
+    // multiple threads.
+    //
+    mutex m;
+
+    auto add = [&paths, &path_count, &start, &m] (path&& p,
+                                                  const string& pt,
+                                                  bool interim)
     {
+      lock_guard<mutex> l (m);
+
       bool pd (!pt.empty () && pt[0] == '.'); // Dot-started pattern.
 
       const path& fp (!p.empty ()
@@ -205,9 +283,34 @@ try
     };
 
     if (!entry)
-      path_search (pattern, add, start, flags, dangle_func);
-    else
+    {
+      function<bool (const dir_entry&)> df;
+
+      if (dangle_func != nullptr)
+      {
+        df = [&dangle_func, &m] (const dir_entry& de)
+        {
+          lock_guard<mutex> l (m);
+          return dangle_func (de);
+        };
+      }
+
+      if (!compile)
+        path_search (pattern, add, start, flags, df, order, threads, sorted);
+      else
+        path_search (compiled_path_pattern (pattern),
+                     add,
+                     start,
+                     flags,
+                     df,
+                     order,
+                     threads,
+                     sorted);
+    }
+    else if (!compile)
       path_search (pattern, *entry, add, start, flags);
+    else
+      path_search (compiled_path_pattern (pattern), *entry, add, start, flags);
 
     if (dangle_stop)
       return 1;
@@ -249,6 +352,12 @@ try
         // Test path match.
         //
         assert (path_match (p.first, pattern, start, flags));
+
+        if (compile)
+          assert (path_match (p.first,
+                              compiled_path_pattern (pattern),
+                              start,
+                              flags));
       }
     }
     else if (entry)
@@ -264,6 +373,98 @@ try
 
     return paths.empty () ? 1 : 0;
   }
+  else if (op == "-sm")
+  {
+    path_match_flags flags (path_match_flags::follow_symlinks);
+
+    bool dangle_stop (false);
+    function<bool (const dir_entry&)> dangle_func;
+
+    int i (2);
+    for (; i != argc; ++i)
+    {
+      string o (argv[i]);
+      if (o == "-i")
+        flags |= path_match_flags::match_absent;
+      else if (o == "-d")
+      {
+        ++i;
+
+        assert (i != argc);
+
+        string v (argv[i]);
+        bool stop (v == "stop");
+
+        assert (stop || v == "print");
+
+        dangle_func = [&dangle_stop, stop] (const dir_entry& de)
+        {
+          cerr << de.base () / de.path () << endl;
+          dangle_stop = stop;
+          return !stop;
+        };
+      }
+      else
+        break; // End of options.
+    }
+
+    assert (i != argc); // Still need directory.
+    dir_path start (argv[i++]);
+
+    path_pattern_set ps;
+    for (; i != argc; ++i)
+    {
+      string a (argv[i]);
+
+      if (a == "-x")
+      {
+        assert (++i != argc);
+        ps.exclude (path (argv[i]));
+      }
+      else
+        ps.include (path (a));
+    }
+
+    assert (!ps.empty ());
+
+    vector<string> r;
+    auto add = [&r, &ps, &start, flags] (path&& p,
+                                         const vector<size_t>& is,
+                                         bool interim)
+    {
+      if (interim)
+        return true;
+
+      assert (!is.empty () && ps.match (p, start, flags));
+
+      string s (p.representation ());
+      for (size_t i (0); i != ps.size (); ++i)
+      {
+        const path_pattern_set::pattern_type& pt (ps.patterns ()[i]);
+
+        bool m (!pt.exclude && path_match (p, pt.pattern, start, flags));
+        assert (m == (find (is.begin (), is.end (), i) != is.end ()));
+
+        if (m)
+          s += ' ' + to_string (i);
+      }
+
+      r.push_back (move (s));
+      return true;
+    };
+
+    path_search (ps, add, start, flags, dangle_func);
+
+    if (dangle_stop)
+      return 1;
+
+    std::sort (r.begin (), r.end ());
+
+    for (const string& s: r)
+      cout << s << endl;
+
+    return r.empty () ? 1 : 0;
+  }
   else
     assert (false);
 }
@@ -0,0 +1,237 @@
+// file      : tests/xxh3/driver.cxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t
+#include <iomanip>
+#include <iostream>
+
+#include <libbutl/path.hxx>
+#include <libbutl/sha1.hxx>
+#include <libbutl/xxh3.hxx>
+#include <libbutl/xxh64.hxx>
+#include <libbutl/sha256.hxx>
+#include <libbutl/fdstream.hxx>
+#include <libbutl/timestamp.hxx>
+#include <libbutl/filesystem.hxx> // auto_rmfile
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace butl;
+
+// Generate the pseudo-random data of the specified size.
+//
+static string
+data (size_t n)
+{
+  string r (n, '\0');
+
+  uint32_t x (2463534242U);
+  for (char& c: r)
+  {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    c = static_cast<char> (x);
+  }
+
+  return r;
+}
+
+static volatile uint8_t sink;
+
+// Print the throughput of all the bundled hashes for the data of the
+// specified size.
+//
+static void
+benchmark (size_t size)
+{
+  string d (data (size));
+
+  // Hash at least 1GB in total.
+  //
+  size_t n (max<size_t> (1024 * 1024 * 1024 / size, 1));
+
+  auto measure = [&d, n] (const char* what, auto hash)
+  {
+    timestamp t (system_clock::now ());
+
+    // Accumulate the results not to let the compiler optimize the calls
+    // away.
+    //
+    uint8_t r (0);
+    for (size_t i (0); i != n; ++i)
+      r ^= hash (d.data (), d.size ());
+    sink = r;
+
+    chrono::duration<double> s (system_clock::now () - t);
+    double mb (static_cast<double> (d.size ()) * n / 1024 / 1024);
+
+    cerr << "  " << left << setw (10) << what << right
+         << fixed << setprecision (2)
+         << setw (10) << s.count () << " sec "
+         << setw (10) << mb / s.count () << " MB/sec" << endl;
+  };
+
+  cerr << size << " bytes x " << n << ':' << endl;
+
+  measure ("sha1",
+           [] (const char* p, size_t s) {return sha1 (p, s).binary ()[0];});
+
+  measure ("sha256",
+           [] (const char* p, size_t s) {return sha256 (p, s).binary ()[0];});
+
+  measure ("xxh64",
+           [] (const char* p, size_t s) {return xxh64::binary (p, s)[0];});
+
+  measure ("xxh3_64",
+           [] (const char* p, size_t s) {return xxh3_64::binary (p, s)[0];});
+
+  measure ("xxh3_128",
+           [] (const char* p, size_t s) {return xxh3_128::binary (p, s)[0];});
+}
+
+// Usage: argv[0] [-b [<size>...]]
+//
+// Test xxh3_64 and xxh3_128 or, if -b is specified, benchmark hashing of the
+// data of the specified sizes (16, 64, 1024, 65536, and 1048576 bytes by
+// default) with all the bundled hashes and print the results to stderr.
+//
+int
+main (int argc, const char* argv[])
+{
+  if (argc > 1)
+  {
+    assert (string (argv[1]) == "-b");
+
+    vector<size_t> sizes;
+    for (int i (2); i != argc; ++i)
+      sizes.push_back (stoul (argv[i]));
+
+    if (sizes.empty ())
+      sizes = {16, 64, 1024, 64 * 1024, 1024 * 1024};
+
+    for (size_t s: sizes)
+      benchmark (s);
+
+    return 0;
+  }
+
+  // xxh3_64
+  //
+  assert (string (xxh3_64 ().string ()) == "2d06800538d394c2");
+  assert (string (xxh3_64 ("").string ()) != "2d06800538d394c2");
+  assert (xxh3_64 ().hash () == 0x2d06800538d394c2ULL);
+  assert (xxh3_64::hash (nullptr, 0) == 0x2d06800538d394c2ULL);
+  assert (xxh3_64 ().empty () && !xxh3_64 ("").empty ());
+
+  {
+    xxh3_64 h ("123");
+    assert (string (h.string ()) == xxh3_64::string ("123").data ());
+    assert (h.hash () == xxh3_64::hash ("123"));
+
+    auto& b (h.binary ());
+    assert (equal (b, b + 8, xxh3_64::binary ("123").begin ()));
+  }
+
+  {
+    xxh3_64 h;
+    h.append ("1");
+    h.append (string ("2"));
+    h.append ("3", 1);
+
+    string s ("1\0" "2\0" "3", 5);
+    assert (h.hash () == xxh3_64::hash (s.c_str (), s.size ()));
+  }
+
+  {
+    int c (12345);
+    xxh3_64 h;
+    h.append (c);
+    assert (h.hash () == xxh3_64::hash (&c, sizeof (c)));
+  }
+
+  // xxh3_128
+  //
+  assert (string (xxh3_128 ().string ()) ==
+          "99aa06d3014798d86001c324468d497f");
+
+  {
+    xxh3_128::hash_type r (xxh3_128 ().hash ());
+    assert (r.high == 0x99aa06d3014798d8ULL &&
+            r.low  == 0x6001c324468d497fULL);
+
+    auto& b (xxh3_128 ().binary ());
+    assert (b[0] == 0x99 && b[15] == 0x7f);
+  }
+
+  {
+    xxh3_128 h ("123");
+    assert (string (h.string ()) == xxh3_128::string ("123").data ());
+
+    xxh3_128::hash_type x (h.hash ()), y (xxh3_128::hash ("123"));
+    assert (x.low == y.low && x.high == y.high);
+  }
+
+  // Test the streaming calculation against the one-shot one for various
+  // data sizes (crossing the XXH3 short input, internal buffer, and block
+  // boundaries) and chunkings.
+  //
+  for (size_t n: {0, 1, 3, 16, 17, 128, 129, 240, 241, 256, 1024, 1025, 100003})
+  {
+    string d (data (n));
+
+    for (size_t c: {1, 7, 64, 256, 4096, 100003})
+    {
+      xxh3_64 h64;
+      xxh3_128 h128;
+
+      for (size_t i (0); i < d.size (); i += c)
+      {
+        h64.append (d.data () + i, min (c, d.size () - i));
+        h128.append (d.data () + i, min (c, d.size () - i));
+      }
+
+      assert (h64.hash () == xxh3_64::hash (d.data (), d.size ()));
+      assert (string (h128.string ()) ==
+              xxh3_128::string (d.data (), d.size ()).data ());
+    }
+  }
+
+  // Stream.
+  //
+  {
+    string s;
+    for (size_t i (0); i < 1024; ++i)
+      s += "0123456789";
+
+    path p (path::temp_path ("butl-xxh3"));
+
+    auto_rmfile pr;       // Always remove the file after the stream is closed.
+    ofdstream os (p);
+    pr = auto_rmfile (p);
+
+    os << s;
+    os.close ();
+
+    {
+      ifdstream is (p);
+      assert (xxh3_64 (is).hash () == xxh3_64::hash (s.c_str (), s.size ()));
+      assert (is.eof ());
+      is.close ();
+    }
+
+    {
+      ifdstream is (p);
+      assert (string (xxh3_128 (is).string ()) ==
+              xxh3_128::string (s.c_str (), s.size ()).data ());
+      assert (is.eof ());
+      is.close ();
+    }
+  }
+}
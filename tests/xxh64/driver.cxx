@@ -1,8 +1,13 @@
 // file      : tests/xxh64/driver.cxx -*- C++ -*-
 // license   : MIT; see accompanying LICENSE file
 
+#include <array>
 #include <string>
+#include <algorithm> // min()
+#include <vector>
 #include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <utility> // pair
 
 #include <libbutl/path.hxx>
 #include <libbutl/xxh64.hxx>
@@ -79,4 +84,59 @@ main ()
     h.append (c);
     assert (string (h.string ()) == xxh64 (&c, sizeof (c)).string ());
   }
+
+  // Test the batch hashing, serially and using multiple threads.
+  //
+  {
+    vector<string> ds;
+    for (size_t i (0); i != 1000; ++i)
+      ds.push_back (string (i * 37 % 300 + (i % 20 == 0 ? 100000 : 0),
+                            static_cast<char> ('a' + i % 26)));
+
+    vector<pair<const void*, size_t>> in;
+    for (const string& d: ds)
+      in.emplace_back (d.data (), d.size ());
+
+    for (size_t t: {1, 4, 0})
+    {
+      vector<array<uint8_t, 8>> r (xxh64_batch (in, t));
+      assert (r.size () == in.size ());
+
+      for (size_t i (0); i != r.size (); ++i)
+        assert (r[i] == xxh64::binary (ds[i].data (), ds[i].size ()));
+    }
+
+    assert (xxh64_batch ({}).empty ());
+  }
+
+  // Test the tree checksum calculation (see the sha256 test for details).
+  //
+  {
+    string d;
+    for (size_t i (0); i != 100003; ++i)
+      d += static_cast<char> ('a' + i * 7 % 26);
+
+    const size_t cs (1000);
+
+    xxh64 r;
+    for (size_t i (0); i < d.size (); i += cs)
+      r.append (xxh64 (d.data () + i, min (cs, d.size () - i)).binary (), 8);
+
+    unsigned char s[8] = {0, 0, 0, 0, 0, 0, 0x03, 0xe8};
+    r.append (s, 8);
+
+    for (size_t t: {1, 4})
+    {
+      assert (xxh64_tree (d.data (), d.size (), cs, t).hash () == r.hash ());
+
+      xxh64_tree h (cs, t);
+      for (size_t i (0); i < d.size (); i += 777)
+        h.append (d.data () + i, min<size_t> (777, d.size () - i));
+
+      assert (string (h.string ()) == r.string ());
+    }
+
+    assert (xxh64_tree (d.data (), d.size (), cs).hash () !=
+            xxh64 (d.data (), d.size ()).hash ());
+  }
 }